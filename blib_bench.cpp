@@ -0,0 +1,1119 @@
+// Microbenchmarks for blib_ec.h, blib_events.h, blib_math.h and blib_fileio.h
+//
+// Usage: blib_bench [--filter <substring>] [--min-time <seconds>] [--out <file.json>]
+// Results are printed as a table on stderr and as JSON on stdout (or to --out).
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <filesystem>
+#include "blib_broadphase.h"
+#include "blib_ec.h"
+#include "blib_events.h"
+#include "blib_jobs.h"
+#include "blib_math.h"
+#include "blib_random.h"
+#include "blib_fileio.h"
+
+namespace
+{
+
+////////////////////////////////////////////////////////////////////////////////
+////							Harness
+////////////////////////////////////////////////////////////////////////////////
+
+// Keeps the compiler from optimizing away results
+volatile uint64_t g_sink = 0;
+
+template<class T>
+void consume(const T& value)
+{
+	uint64_t bits = 0;
+	memcpy(&bits, &value, std::min(sizeof(T), sizeof(bits)));
+	g_sink = g_sink + bits;
+}
+
+// Passed to every benchmark, only the time between start and stop is measured
+class state
+{
+public:
+	void start() { m_start = clock::now(); }
+	void stop() { m_elapsed += clock::now() - m_start; }
+
+private:
+	friend class runner;
+	using clock = std::chrono::steady_clock;
+	clock::time_point m_start;
+	clock::duration m_elapsed = {};
+};
+
+struct result
+{
+	std::string name;
+	uint64_t items = 0;
+	uint64_t iterations = 0;
+	double min_ns = 0.0;
+	double median_ns = 0.0;
+};
+
+class runner
+{
+public:
+	std::string filter;
+	double min_time = 0.25;
+
+	// Runs fn until min_time has been measured, items is the work done by one call
+	void run(const std::string& name, uint64_t items, const std::function<void(state&)>& fn)
+	{
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+			return;
+
+		std::vector<double> samples;
+		double total = 0.0;
+		while (samples.size() < 3 || (total < min_time && samples.size() < 1000))
+		{
+			state s;
+			fn(s);
+			double seconds = std::chrono::duration<double>(s.m_elapsed).count();
+			samples.push_back(seconds);
+			total += seconds;
+		}
+		std::sort(samples.begin(), samples.end());
+
+		result r;
+		r.name = name;
+		r.items = items;
+		r.iterations = samples.size();
+		r.min_ns = samples.front() * 1e9 / items;
+		r.median_ns = samples[samples.size() / 2] * 1e9 / items;
+		fprintf(stderr, "%-40s %12.3f ns/item %14.0f items/s  (%llu iterations)\n",
+			r.name.c_str(), r.median_ns, 1e9 / r.median_ns, static_cast<unsigned long long>(r.iterations));
+		m_results.push_back(r);
+	}
+
+	std::string json() const
+	{
+		std::ostringstream out;
+		out << "{\n\t\"benchmarks\": [";
+		for (size_t i = 0; i < m_results.size(); i++)
+		{
+			const auto& r = m_results[i];
+			out << (i ? "," : "") << "\n\t\t{ \"name\": \"" << r.name
+				<< "\", \"items\": " << r.items
+				<< ", \"iterations\": " << r.iterations
+				<< ", \"min_ns_per_item\": " << r.min_ns
+				<< ", \"median_ns_per_item\": " << r.median_ns
+				<< ", \"items_per_second\": " << 1e9 / r.median_ns << " }";
+		}
+		out << "\n\t]\n}\n";
+		return out.str();
+	}
+
+private:
+	std::vector<result> m_results;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////							Entity Component
+////////////////////////////////////////////////////////////////////////////////
+
+struct position : blib::component
+{
+	float x = 0, y = 0, z = 0;
+};
+
+template<int N>
+struct counter : blib::component
+{
+	float t = 0;
+	void update(float dt) override { t += dt; }
+};
+
+// Status effect, in either storage
+template<blib::storage S>
+struct effect : blib::component
+{
+	float t = 0;
+	void update(float dt) override { t += dt; }
+};
+
+}
+
+template<blib::storage S>
+struct blib::component_storage<effect<S>>
+{
+	static constexpr blib::storage value = S;
+};
+
+namespace
+{
+
+const char* storage_name(blib::storage s)
+{
+	return s == blib::storage::sparse_set ? "sparse_set" : "entity";
+}
+
+// Adding and removing against iterating, for both storages
+template<blib::storage S>
+void bench_storage(runner& r)
+{
+	const uint64_t n = 10000;
+	const std::string suffix = storage_name(S);
+
+	blib::entity_container ec;
+	std::vector<blib::entity*> entities;
+	for (uint64_t i = 0; i < n; i++)
+	{
+		entities.push_back(&ec.create());
+		entities.back()->create_component<position>();
+	}
+
+	r.run("ec/toggle_component/" + suffix, 2 * n, [&](state& s)
+	{
+		s.start();
+		for (auto* e : entities)
+			e->create_component<effect<S>>();
+		for (auto* e : entities)
+			e->destroy_component<effect<S>>();
+		s.stop();
+	});
+
+	for (auto* e : entities)
+		e->create_component<effect<S>>();
+
+	r.run("ec/get_component/" + suffix, n, [&](state& s)
+	{
+		s.start();
+		for (auto* e : entities)
+			consume(e->try_get_component<effect<S>>());
+		s.stop();
+	});
+
+	r.run("ec/each/" + suffix, n, [&](state& s)
+	{
+		float sum = 0.0f;
+		s.start();
+		ec.each<effect<S>>([&](blib::entity&, effect<S>& c) { sum += c.t; });
+		s.stop();
+		consume(sum);
+	});
+
+	r.run("ec/update/n=10000/" + suffix, n, [&](state& s)
+	{
+		s.start();
+		ec.update(0.016f);
+		s.stop();
+	});
+}
+
+void add_counters(blib::entity& e, int k)
+{
+	if (k > 0) e.create_component<counter<0>>();
+	if (k > 1) e.create_component<counter<1>>();
+	if (k > 2) e.create_component<counter<2>>();
+	if (k > 3) e.create_component<counter<3>>();
+}
+
+void bench_ec(runner& r)
+{
+	const uint64_t n = 100000;
+
+	r.run("ec/create", n, [&](state& s)
+	{
+		blib::entity_container ec;
+		s.start();
+		for (uint64_t i = 0; i < n; i++)
+			ec.create();
+		s.stop();
+	});
+
+	r.run("ec/create_with_component", n, [&](state& s)
+	{
+		blib::entity_container ec;
+		s.start();
+		for (uint64_t i = 0; i < n; i++)
+			ec.create().create_component<position>();
+		s.stop();
+	});
+
+	r.run("ec/create_two_components", n, [&](state& s)
+	{
+		blib::entity_container ec;
+		s.start();
+		for (uint64_t i = 0; i < n; i++)
+		{
+			auto& e = ec.create();
+			e.create_component<position>();
+			e.create_component<counter<0>>();
+		}
+		s.stop();
+	});
+
+	r.run("ec/instantiate_two_components", n, [&](state& s)
+	{
+		blib::entity_container ec;
+		blib::prefab p;
+		p.add<position>();
+		p.add<counter<0>>();
+		s.start();
+		consume(ec.instantiate(p, n).first);
+		s.stop();
+	});
+
+	r.run("ec/destroy", n, [&](state& s)
+	{
+		blib::entity_container ec;
+		std::vector<blib::entity_id> ids;
+		for (uint64_t i = 0; i < n; i++)
+			ids.push_back(ec.create().id());
+		s.start();
+		for (auto id : ids)
+			ec.destroy(id);
+		ec.update(0.0f);
+		s.stop();
+	});
+
+	{
+		blib::entity_container ec;
+		std::vector<blib::entity_id> ids;
+		for (uint64_t i = 0; i < n; i++)
+			ids.push_back(ec.create().id());
+		std::shuffle(ids.begin(), ids.end(), std::mt19937(42));
+
+		r.run("ec/lookup", n, [&](state& s)
+		{
+			s.start();
+			for (auto id : ids)
+				consume(ec.try_get(id));
+			s.stop();
+		});
+
+		ec.set_concurrent(true);
+		r.run("ec/lookup/concurrent", n, [&](state& s)
+		{
+			s.start();
+			for (auto id : ids)
+				consume(ec.try_get(id));
+			s.stop();
+		});
+	}
+
+	r.run("ec/create_concurrent", n, [&](state& s)
+	{
+		blib::entity_container ec;
+		ec.set_concurrent(true);
+		s.start();
+		blib::parallel_for(n, 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				ec.create_concurrent();
+		});
+		ec.flush_created();
+		s.stop();
+	});
+
+	{
+		blib::entity_container ec;
+		std::vector<std::string> names;
+		for (uint64_t i = 0; i < n; i++)
+		{
+			names.push_back("entity_" + std::to_string(i));
+			ec.create().set_name(names.back());
+		}
+		std::shuffle(names.begin(), names.end(), std::mt19937(42));
+		ec.enable_name_index(true);
+
+		r.run("ec/find_by_name", n, [&](state& s)
+		{
+			s.start();
+			for (auto& name : names)
+				consume(ec.find(name));
+			s.stop();
+		});
+	}
+
+	{
+		// One in 64 entities carries the tag
+		blib::entity_container ec;
+		for (uint64_t i = 0; i < n; i++)
+			ec.create().set_tag(i % 64 == 0 ? 1 : 2);
+
+		r.run("ec/each_with_tags/1_in_64", n, [&](state& s)
+		{
+			uint64_t count = 0;
+			s.start();
+			ec.each_with_tags(1, [&](blib::entity&) { count++; });
+			s.stop();
+			consume(count);
+		});
+	}
+
+	for (int k : { 1, 4 })
+	{
+		const uint64_t count = 10000;
+		blib::entity_container ec;
+		for (uint64_t i = 0; i < count; i++)
+		{
+			auto& e = ec.create();
+			e.create_component<position>();
+			add_counters(e, k);
+		}
+
+		r.run("ec/update/n=10000/k=" + std::to_string(k), count * k, [&](state& s)
+		{
+			s.start();
+			ec.update(0.016f);
+			s.stop();
+		});
+	}
+
+	{
+		// A streamed region of n entities moving into the world and back out
+		blib::entity_container world, region;
+		std::vector<blib::entity_id> ids;
+		for (uint64_t i = 0; i < n; i++)
+		{
+			auto& e = region.create();
+			e.create_component<position>();
+			e.create_component<counter<0>>();
+			ids.push_back(e.id());
+		}
+
+		r.run("ec/merge_region", n, [&](state& s)
+		{
+			s.start();
+			world.merge(region);
+			s.stop();
+			world.detach(ids, region);
+		});
+
+		r.run("ec/detach_region", n, [&](state& s)
+		{
+			world.merge(region);
+			s.start();
+			world.detach(ids, region);
+			s.stop();
+		});
+	}
+
+	{
+		// Entities created and destroyed in random order scatter their components over
+		// the free lists, compaction puts them back in update order
+		blib::entity_container ec;
+		std::vector<blib::entity_id> ids;
+		std::mt19937 rng(42);
+		for (int round = 0; round < 8; round++)
+		{
+			while (ids.size() < n)
+			{
+				auto& e = ec.create();
+				e.create_component<position>();
+				e.create_component<counter<0>>();
+				ids.push_back(e.id());
+			}
+			std::shuffle(ids.begin(), ids.end(), rng);
+			for (uint64_t i = 0; i < n / 2; i++)
+			{
+				ec.destroy(ids.back());
+				ids.pop_back();
+			}
+			ec.update(0.0f);
+		}
+
+		r.run("ec/update/churned", ids.size(), [&](state& s)
+		{
+			s.start();
+			ec.update(0.016f);
+			s.stop();
+		});
+
+		r.run("ec/compact", ids.size(), [&](state& s)
+		{
+			s.start();
+			ec.compact();
+			s.stop();
+		});
+
+		r.run("ec/update/compacted", ids.size(), [&](state& s)
+		{
+			s.start();
+			ec.update(0.016f);
+			s.stop();
+		});
+
+		r.run("ec/memory_usage", ids.size(), [&](state& s)
+		{
+			s.start();
+			consume(ec.memory_usage().total());
+			s.stop();
+		});
+	}
+
+	bench_storage<blib::storage::entity>(r);
+	bench_storage<blib::storage::sparse_set>(r);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Events
+////////////////////////////////////////////////////////////////////////////////
+
+struct hit_event
+{
+	blib::entity_id target;
+	float damage;
+};
+
+void bench_events(runner& r)
+{
+	const uint64_t n = 100000;
+
+	r.run("events/emit_dispatch", n, [&](state& s)
+	{
+		blib::event_bus bus;
+		float total = 0.0f;
+		bus.subscribe<hit_event>(0, [&](const hit_event* events, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				total += events[i].damage;
+		});
+		s.start();
+		for (uint64_t i = 0; i < n; i++)
+			bus.emit(hit_event{ { i }, 1.0f });
+		bus.dispatch(0);
+		s.stop();
+		consume(total);
+	});
+
+	r.run("events/emit_dispatch/parallel", n, [&](state& s)
+	{
+		blib::event_bus bus;
+		float total = 0.0f;
+		bus.subscribe<hit_event>(0, [&](const hit_event* events, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				total += events[i].damage;
+		});
+		s.start();
+		blib::parallel_for(n, 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				bus.emit(hit_event{ { i }, 1.0f });
+		});
+		bus.dispatch(0);
+		s.stop();
+		consume(total);
+	});
+
+	r.run("events/emit_dispatch/coalesced_1_in_16", n, [&](state& s)
+	{
+		blib::event_bus bus;
+		float total = 0.0f;
+		bus.coalesce<hit_event>([](const hit_event& e) { return e.target.id; });
+		bus.subscribe<hit_event>(0, [&](const hit_event* events, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				total += events[i].damage;
+		});
+		s.start();
+		for (uint64_t i = 0; i < n; i++)
+			bus.emit(hit_event{ { i / 16 }, 1.0f });
+		bus.dispatch(0);
+		s.stop();
+		consume(total);
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Math
+////////////////////////////////////////////////////////////////////////////////
+
+void bench_math(runner& r)
+{
+	const size_t n = 1 << 16;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
+
+	std::vector<blib::vec3> a(n), b(n), out3(n);
+	std::vector<blib::mat4> m(n), out4(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		a[i] = blib::vec3(dist(rng), dist(rng), dist(rng));
+		b[i] = blib::vec3(dist(rng), dist(rng), dist(rng));
+		for (uint32_t j = 0; j < 4; j++)
+			m[i][j] = blib::vec4(dist(rng), dist(rng), dist(rng), dist(rng));
+	}
+
+	r.run("math/vec3/dot", n, [&](state& s)
+	{
+		float sum = 0.0f;
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			sum += blib::dot(a[i], b[i]);
+		s.stop();
+		consume(sum);
+	});
+
+	r.run("math/vec3/cross", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out3[i] = blib::cross(a[i], b[i]);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	r.run("math/vec3/length", n, [&](state& s)
+	{
+		float sum = 0.0f;
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			sum += blib::length(a[i]);
+		s.stop();
+		consume(sum);
+	});
+
+	r.run("math/vec3/normalize", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out3[i] = blib::normalize(a[i]);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	r.run("math/vec3/fast_normalize", n, [&](state& s)
+	{
+		s.start();
+		blib::fast_normalize(a.data(), out3.data(), n);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	std::vector<float> angles(n), out(n), out2(n);
+	for (size_t i = 0; i < n; i++)
+		angles[i] = dist(rng);
+
+	r.run("math/std_sin", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out[i] = std::sin(angles[i]);
+		s.stop();
+		consume(out[n / 2]);
+	});
+
+	r.run("math/fast_sin", n, [&](state& s)
+	{
+		s.start();
+		blib::fast_sin(angles.data(), out.data(), n);
+		s.stop();
+		consume(out[n / 2]);
+	});
+
+	r.run("math/fast_sincos", n, [&](state& s)
+	{
+		s.start();
+		blib::fast_sincos(angles.data(), out.data(), out2.data(), n);
+		s.stop();
+		consume(out[n / 2]);
+	});
+
+	r.run("math/fast_atan2", n, [&](state& s)
+	{
+		s.start();
+		blib::fast_atan2(angles.data(), out2.data(), out.data(), n);
+		s.stop();
+		consume(out[n / 2]);
+	});
+
+	r.run("math/fast_exp", n, [&](state& s)
+	{
+		s.start();
+		blib::fast_exp(angles.data(), out.data(), n);
+		s.stop();
+		consume(out[n / 2]);
+	});
+
+	std::vector<uint16_t> halves(n);
+	r.run("math/pack/float_to_half", n, [&](state& s)
+	{
+		s.start();
+		blib::float_to_half(angles.data(), halves.data(), n);
+		s.stop();
+		consume(halves[n / 2]);
+	});
+
+	r.run("math/pack/half_to_float", n, [&](state& s)
+	{
+		s.start();
+		blib::half_to_float(halves.data(), out.data(), n);
+		s.stop();
+		consume(out[n / 2]);
+	});
+
+	std::vector<int16_t> snorms(n);
+	r.run("math/pack/snorm16", n, [&](state& s)
+	{
+		s.start();
+		blib::pack_snorm16(angles.data(), snorms.data(), n);
+		s.stop();
+		consume(snorms[n / 2]);
+	});
+
+	std::vector<blib::vec3> normals(n);
+	std::vector<uint32_t> packed(n);
+	blib::fast_normalize(a.data(), normals.data(), n);
+	r.run("math/pack/normal", n, [&](state& s)
+	{
+		s.start();
+		blib::pack_normal(normals.data(), packed.data(), n);
+		s.stop();
+		consume(packed[n / 2]);
+	});
+
+	r.run("math/pack/unpack_normal", n, [&](state& s)
+	{
+		s.start();
+		blib::unpack_normal(packed.data(), out3.data(), n);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	std::vector<blib::vec4> quats(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		blib::vec4 q = m[i][0];
+		float l = sqrtf(blib::dot(q, q));
+		quats[i] = blib::vec4(q.x / l, q.y / l, q.z / l, q.w / l);
+	}
+	r.run("math/pack/quat", n, [&](state& s)
+	{
+		s.start();
+		blib::pack_quat(quats.data(), packed.data(), n);
+		s.stop();
+		consume(packed[n / 2]);
+	});
+
+	r.run("math/pack/unpack_quat", n, [&](state& s)
+	{
+		s.start();
+		blib::unpack_quat(packed.data(), quats.data(), n);
+		s.stop();
+		consume(quats[n / 2]);
+	});
+
+	// Positions 6000 km out, made relative to a camera among them
+	const blib::dvec3 camera(6.4e6, -2.1e6, 3.5e5);
+	std::vector<blib::dvec3> world_points(n);
+	std::vector<blib::dmat4> world_transforms(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		world_points[i] = blib::dvec3(camera.x + a[i].x * 100.0, camera.y + a[i].y * 100.0, camera.z + a[i].z * 100.0);
+		for (uint32_t j = 0; j < 4; j++)
+			world_transforms[i][j] = blib::dvec4(m[i][j].x, m[i][j].y, m[i][j].z, j < 3 ? world_points[i][j] : 1.0);
+	}
+
+	r.run("math/large_world/to_relative_scalar", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out3[i] = blib::to_relative(world_points[i], camera);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	r.run("math/large_world/to_relative", n, [&](state& s)
+	{
+		s.start();
+		blib::to_relative(world_points.data(), camera, out3.data(), n);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	r.run("math/large_world/to_relative_mat4", n, [&](state& s)
+	{
+		s.start();
+		blib::to_relative(world_transforms.data(), camera, out4.data(), n);
+		s.stop();
+		consume(out4[n / 2][0]);
+	});
+
+	// Voxel coordinates a few chunks around the origin
+	std::vector<blib::ivec3> voxels(n), cells(n), locals(n);
+	std::vector<uint64_t> codes(n);
+	for (size_t i = 0; i < n; i++)
+		voxels[i] = blib::ivec3(static_cast<int>(a[i].x * 100.0f), static_cast<int>(a[i].y * 100.0f), static_cast<int>(a[i].z * 100.0f));
+
+	r.run("math/grid/morton_encode3_scalar", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			codes[i] = blib::morton_encode(voxels[i]);
+		s.stop();
+		consume(codes[n / 2]);
+	});
+
+	r.run("math/grid/morton_encode3", n, [&](state& s)
+	{
+		s.start();
+		blib::morton_encode(voxels.data(), codes.data(), n);
+		s.stop();
+		consume(codes[n / 2]);
+	});
+
+	r.run("math/grid/morton_decode3", n, [&](state& s)
+	{
+		s.start();
+		blib::morton_decode(codes.data(), cells.data(), n);
+		s.stop();
+		consume(cells[n / 2]);
+	});
+
+	r.run("math/grid/floor_divmod_scalar", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+		{
+			cells[i] = blib::floor_div(voxels[i], 24);
+			locals[i] = blib::floor_mod(voxels[i], 24);
+		}
+		s.stop();
+		consume(cells[n / 2]);
+	});
+
+	r.run("math/grid/floor_divmod", n, [&](state& s)
+	{
+		s.start();
+		blib::floor_divmod(voxels.data(), 24, cells.data(), locals.data(), n);
+		s.stop();
+		consume(cells[n / 2]);
+	});
+
+	r.run("math/grid/floor_divmod_pow2", n, [&](state& s)
+	{
+		s.start();
+		blib::floor_divmod(voxels.data(), 32, cells.data(), locals.data(), n);
+		s.stop();
+		consume(cells[n / 2]);
+	});
+
+	std::vector<blib::camera_desc> cameras(64);
+	for (size_t i = 0; i < cameras.size(); i++)
+	{
+		cameras[i].position = a[i];
+		cameras[i].forward = b[i];
+	}
+	r.run("math/view_projections/cameras", cameras.size(), [&](state& s)
+	{
+		s.start();
+		blib::view_projections(cameras.data(), out4.data(), cameras.size());
+		s.stop();
+		consume(out4[0][0]);
+	});
+
+	r.run("math/view_projections/cascades", 4, [&](state& s)
+	{
+		float splits[5];
+		s.start();
+		blib::cascade_splits(cameras[0].near, cameras[0].far, 4, 0.7f, splits);
+		blib::fit_cascades(cameras[0], blib::vec3(0.3f, -1.0f, 0.2f), splits, 4, 2048, 50.0f, out4.data());
+		s.stop();
+		consume(out4[3][0]);
+	});
+
+	r.run("math/mat4/mul", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out4[i] = blib::mul(m[i], m[n - 1 - i]);
+		s.stop();
+		consume(out4[n / 2][0]);
+	});
+
+	r.run("math/mat4/transpose", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out4[i] = blib::transpose(m[i]);
+		s.stop();
+		consume(out4[n / 2][0]);
+	});
+
+	r.run("math/mat4/perspective", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			out4[i] = blib::perspective(0.5f + a[i].x * 0.01f, 1.7f, 0.1f, 1000.0f);
+		s.stop();
+		consume(out4[n / 2][0]);
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Random
+////////////////////////////////////////////////////////////////////////////////
+
+void bench_random(runner& r)
+{
+	const size_t n = 1 << 16;
+	std::vector<uint32_t> bits(n);
+	std::vector<float> values(n);
+	std::vector<blib::vec2> p2(n), out2(n);
+	std::vector<blib::vec3> p3(n), out3(n);
+
+	blib::rng gen(7);
+	for (size_t i = 0; i < n; i++)
+	{
+		p3[i] = blib::vec3(gen.range(-100.0f, 100.0f), gen.range(-100.0f, 100.0f), gen.range(-100.0f, 100.0f));
+		p2[i] = blib::vec2(p3[i].x, p3[i].y);
+	}
+
+	r.run("random/mt19937_float", n, [&](state& s)
+	{
+		std::mt19937 mt(7);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			values[i] = dist(mt);
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/next_float", n, [&](state& s)
+	{
+		s.start();
+		for (size_t i = 0; i < n; i++)
+			values[i] = gen.next_float();
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/fill_u32", n, [&](state& s)
+	{
+		s.start();
+		gen.fill(bits.data(), n);
+		s.stop();
+		consume(bits[n / 2]);
+	});
+
+	r.run("random/fill_float", n, [&](state& s)
+	{
+		s.start();
+		gen.fill(values.data(), n, -1.0f, 1.0f);
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/value_noise2", n, [&](state& s)
+	{
+		s.start();
+		blib::value_noise(p2.data(), values.data(), n);
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/value_noise3", n, [&](state& s)
+	{
+		s.start();
+		blib::value_noise(p3.data(), values.data(), n);
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/gradient_noise2", n, [&](state& s)
+	{
+		s.start();
+		blib::gradient_noise(p2.data(), values.data(), n);
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/gradient_noise3", n, [&](state& s)
+	{
+		s.start();
+		blib::gradient_noise(p3.data(), values.data(), n);
+		s.stop();
+		consume(values[n / 2]);
+	});
+
+	r.run("random/gradient_noise3_vec3", n, [&](state& s)
+	{
+		s.start();
+		blib::gradient_noise(p3.data(), out3.data(), n);
+		s.stop();
+		consume(out3[n / 2]);
+	});
+
+	r.run("random/gradient_noise3_vec3/parallel", n, [&](state& s)
+	{
+		s.start();
+		blib::parallel_for(n, 4096, [&](size_t begin, size_t end)
+		{
+			blib::gradient_noise(p3.data() + begin, out3.data() + begin, end - begin);
+		});
+		s.stop();
+		consume(out3[n / 2]);
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Broadphase
+////////////////////////////////////////////////////////////////////////////////
+
+void bench_broadphase(runner& r)
+{
+	// Bodies spread like a level, wide along x and y, shallow along z
+	auto make_bodies = [](size_t n, std::vector<blib::vec3>& center, std::vector<blib::vec3>& extent)
+	{
+		blib::rng gen(11);
+		const float side = sqrtf(static_cast<float>(n)) * 4.0f;
+		center.resize(n);
+		extent.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			center[i] = blib::vec3(gen.range(0.0f, side), gen.range(0.0f, side), gen.range(0.0f, 8.0f));
+			extent[i] = blib::vec3(gen.range(0.25f, 1.0f), gen.range(0.25f, 1.0f), gen.range(0.25f, 1.0f));
+		}
+	};
+
+	for (size_t n : { size_t(2000), size_t(100000) })
+	{
+		std::vector<blib::vec3> center, extent;
+		make_bodies(n, center, extent);
+		blib::sweep_and_prune sap;
+		std::vector<blib::sweep_and_prune::proxy> proxies(n);
+		for (size_t i = 0; i < n; i++)
+			proxies[i] = sap.add({ i + 1 }, center[i] - extent[i], center[i] + extent[i]);
+		sap.update();
+
+		// Every body moves a little every tick
+		blib::rng gen(5);
+		r.run("broadphase/sap_tick/n=" + std::to_string(n), n, [&](state& s)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				center[i] = center[i] + blib::vec3(gen.range(-0.1f, 0.1f), gen.range(-0.1f, 0.1f), 0.0f);
+				sap.set_bounds(proxies[i], center[i] - extent[i], center[i] + extent[i]);
+			}
+			s.start();
+			auto& pairs = sap.update();
+			s.stop();
+			consume(pairs.size());
+		});
+	}
+
+	// Reference for the same 2000 bodies
+	{
+		const size_t n = 2000;
+		std::vector<blib::vec3> center, extent;
+		make_bodies(n, center, extent);
+		std::vector<blib::broadphase_pair> pairs;
+		r.run("broadphase/brute_force/n=2000", n, [&](state& s)
+		{
+			pairs.clear();
+			s.start();
+			for (size_t i = 0; i < n; i++)
+			{
+				for (size_t j = i + 1; j < n; j++)
+				{
+					blib::vec3 d = center[i] - center[j];
+					blib::vec3 e = extent[i] + extent[j];
+					if (fabsf(d.x) <= e.x && fabsf(d.y) <= e.y && fabsf(d.z) <= e.z)
+						pairs.push_back({ { i + 1 }, { j + 1 } });
+				}
+			}
+			s.stop();
+			consume(pairs.size());
+		});
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							File IO
+////////////////////////////////////////////////////////////////////////////////
+
+void bench_io(runner& r)
+{
+	const size_t size = 16 * 1024 * 1024;
+	const std::string filename = (std::filesystem::temp_directory_path() / "blib_bench.bin").string();
+	std::vector<char> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = static_cast<char>(i * 31);
+
+	r.run("io/write_binary_file/16MB", size, [&](state& s)
+	{
+		s.start();
+		blib::io::write_binary_file(data, filename);
+		s.stop();
+	});
+
+	r.run("io/read_binary_file/16MB", size, [&](state& s)
+	{
+		s.start();
+		auto read = blib::io::read_binary_file(filename);
+		s.stop();
+		consume(read.size());
+	});
+
+	r.run("io/read_binary_file_cached/16MB_hit", 1, [&](state& s)
+	{
+		blib::io::read_binary_file_cached(filename);
+		s.start();
+		auto read = blib::io::read_binary_file_cached(filename);
+		s.stop();
+		consume(read.hash);
+	});
+
+	r.run("io/hash64/16MB", size, [&](state& s)
+	{
+		s.start();
+		consume(blib::io::hash64(data.data(), data.size()));
+		s.stop();
+	});
+
+	blib::io::default_cache().clear();
+	std::filesystem::remove(filename);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	runner r;
+	std::string out;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc)
+			r.filter = argv[++i];
+		else if (arg == "--min-time" && i + 1 < argc)
+			r.min_time = std::stod(argv[++i]);
+		else if (arg == "--out" && i + 1 < argc)
+			out = argv[++i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [--filter <substring>] [--min-time <seconds>] [--out <file.json>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bench_ec(r);
+	bench_events(r);
+	bench_math(r);
+	bench_random(r);
+	bench_broadphase(r);
+	bench_io(r);
+
+	if (out.empty())
+		printf("%s", r.json().c_str());
+	else if (!blib::io::write_text_file(r.json(), out))
+		return 1;
+	return 0;
+}
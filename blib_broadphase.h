@@ -0,0 +1,296 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include "blib_ec.h"
+#include "blib_math.h"
+#include "blib_jobs.h"
+
+namespace blib
+{
+
+struct broadphase_pair
+{
+	entity_id a, b;
+};
+
+// Incremental sweep and prune over axis aligned bounds.
+//
+// Bounds live in SoA arrays sorted by their minimum along the sweep axis. Bodies move
+// little between updates, so an insertion sort restores the order in close to linear
+// time, and a full sort takes over when too much has changed. The sweep axis follows
+// the axis along which the bodies are spread the most. Large sets are swept in parallel,
+// the pairs come out in the same order either way.
+// Proxy handles stay valid while slots are re-sorted.
+class sweep_and_prune
+{
+public:
+	using proxy = uint32_t;
+	static constexpr proxy invalid = ~0u;
+
+	proxy add(entity_id entity, const vec3& min, const vec3& max);
+	void remove(proxy p);
+	void set_bounds(proxy p, const vec3& min, const vec3& max);
+	entity_id entity(proxy p) const;
+	size_t size() const { return m_slot_of.size() - m_free.size() - m_released.size(); }
+
+	// Sorts and collects every pair of overlapping bounds, touching counts as overlapping.
+	// Each pair holds the body that comes first along the sweep axis in a.
+	const std::vector<broadphase_pair>& update();
+	const std::vector<broadphase_pair>& pairs() const { return m_pairs; }
+	uint32_t axis() const { return m_axis; }
+
+private:
+	static constexpr size_t batch_size = 2048;
+
+	struct sort_entry
+	{
+		float key;
+		uint32_t slot;
+	};
+
+	void choose_axis();
+	void sort();
+	void sweep(uint32_t begin, uint32_t end, std::vector<broadphase_pair>& out) const;
+
+	// Indexed by proxy
+	std::vector<uint32_t> m_slot_of;
+	std::vector<proxy> m_free;
+	std::vector<proxy> m_released;
+
+	// Indexed by slot, sorted by minimum along m_axis after update
+	std::vector<proxy> m_proxy_of;
+	std::vector<entity_id> m_entity;
+	std::vector<float> m_min[3];
+	std::vector<float> m_max[3];
+
+	uint32_t m_axis = 0;
+	std::vector<sort_entry> m_order;
+	std::vector<proxy> m_sorted_proxy_of;	// Scratch for sort, swapped with the slot arrays
+	std::vector<entity_id> m_sorted_entity;
+	std::vector<float> m_sorted_bounds;
+	std::vector<broadphase_pair> m_pairs;
+	std::vector<std::vector<broadphase_pair>> m_batch_pairs;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+inline sweep_and_prune::proxy sweep_and_prune::add(entity_id entity, const vec3& min, const vec3& max)
+{
+	proxy p;
+	if (!m_free.empty())
+	{
+		p = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		p = static_cast<proxy>(m_slot_of.size());
+		m_slot_of.push_back(invalid);
+	}
+
+	// New bounds go at the end until the next sort
+	m_slot_of[p] = static_cast<uint32_t>(m_proxy_of.size());
+	m_proxy_of.push_back(p);
+	m_entity.push_back(entity);
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		m_min[axis].push_back(min[axis]);
+		m_max[axis].push_back(max[axis]);
+	}
+	return p;
+}
+
+// The handle is only recycled after the next update
+inline void sweep_and_prune::remove(proxy p)
+{
+	assert(p < m_slot_of.size() && m_slot_of[p] != invalid);
+	m_proxy_of[m_slot_of[p]] = invalid;
+	m_slot_of[p] = invalid;
+	m_released.push_back(p);
+}
+
+inline void sweep_and_prune::set_bounds(proxy p, const vec3& min, const vec3& max)
+{
+	assert(p < m_slot_of.size() && m_slot_of[p] != invalid);
+	uint32_t slot = m_slot_of[p];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		m_min[axis][slot] = min[axis];
+		m_max[axis][slot] = max[axis];
+	}
+}
+
+inline entity_id sweep_and_prune::entity(proxy p) const
+{
+	return m_entity[m_slot_of[p]];
+}
+
+inline const std::vector<broadphase_pair>& sweep_and_prune::update()
+{
+	choose_axis();
+	sort();
+
+	m_pairs.clear();
+	const uint32_t count = static_cast<uint32_t>(m_proxy_of.size());
+	if (count <= batch_size)
+	{
+		sweep(0, count, m_pairs);
+		return m_pairs;
+	}
+
+	// Every batch sweeps its own bodies against all later ones and keeps its own pairs,
+	// joined in batch order afterwards
+	m_batch_pairs.resize((count + batch_size - 1) / batch_size);
+	parallel_for(count, batch_size, [this](size_t begin, size_t end)
+	{
+		auto& out = m_batch_pairs[begin / batch_size];
+		out.clear();
+		sweep(static_cast<uint32_t>(begin), static_cast<uint32_t>(end), out);
+	});
+	for (auto& batch : m_batch_pairs)
+		m_pairs.insert(m_pairs.end(), batch.begin(), batch.end());
+	return m_pairs;
+}
+
+// Switches to the axis with the largest variance of centers once it clearly beats the
+// current one, so nearly equal axes do not cause a full sort every other update
+inline void sweep_and_prune::choose_axis()
+{
+	const size_t count = m_proxy_of.size();
+	if (count < 2)
+		return;
+
+	float variance[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const float* min = m_min[axis].data();
+		const float* max = m_max[axis].data();
+		double sum = 0.0, sum_sq = 0.0;
+		for (size_t i = 0; i < count; i++)
+		{
+			double c = static_cast<double>(min[i]) + max[i];
+			sum += c;
+			sum_sq += c * c;
+		}
+		double mean = sum / count;
+		variance[axis] = static_cast<float>(sum_sq / count - mean * mean);
+	}
+
+	uint32_t best = m_axis;
+	for (uint32_t axis = 0; axis < 3; axis++)
+		if (variance[axis] > variance[best] * 1.5f)
+			best = axis;
+	m_axis = best;
+}
+
+inline void sweep_and_prune::sort()
+{
+	m_free.insert(m_free.end(), m_released.begin(), m_released.end());
+	m_released.clear();
+
+	// Live slots in their current order
+	const uint32_t slot_count = static_cast<uint32_t>(m_proxy_of.size());
+	const float* key = m_min[m_axis].data();
+	m_order.clear();
+	for (uint32_t slot = 0; slot < slot_count; slot++)
+		if (m_proxy_of[slot] != invalid)
+			m_order.push_back({ key[slot], slot });
+
+	// Insertion sort, which gives up for a full sort when elements travel too far
+	const size_t count = m_order.size();
+	size_t budget = count * 8 + 64;
+	bool moved = count != slot_count;
+	for (size_t i = 1; i < count && budget > 0; i++)
+	{
+		sort_entry e = m_order[i];
+		size_t j = i;
+		for (; j > 0 && m_order[j - 1].key > e.key && budget > 0; j--, budget--)
+			m_order[j] = m_order[j - 1];
+		m_order[j] = e;
+		moved |= j != i;
+	}
+	if (budget == 0)
+		std::stable_sort(m_order.begin(), m_order.end(), [](const sort_entry& a, const sort_entry& b) { return a.key < b.key; });
+
+	if (!moved)
+		return;
+
+	// Gathers every slot array into sorted order in a scratch array and swaps the two,
+	// the scratch arrays are kept so a sort doesn't allocate once they are big enough
+	m_sorted_proxy_of.resize(count);
+	m_sorted_entity.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = m_order[i].slot;
+		m_sorted_proxy_of[i] = m_proxy_of[slot];
+		m_sorted_entity[i] = m_entity[slot];
+		m_slot_of[m_sorted_proxy_of[i]] = i;
+	}
+	m_proxy_of.swap(m_sorted_proxy_of);
+	m_entity.swap(m_sorted_entity);
+
+	for (auto* v : { &m_min[0], &m_min[1], &m_min[2], &m_max[0], &m_max[1], &m_max[2] })
+	{
+		m_sorted_bounds.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+			m_sorted_bounds[i] = (*v)[m_order[i].slot];
+		v->swap(m_sorted_bounds);
+	}
+}
+
+inline void sweep_and_prune::sweep(uint32_t begin, uint32_t end, std::vector<broadphase_pair>& out) const
+{
+	const uint32_t a1 = (m_axis + 1) % 3;
+	const uint32_t a2 = (m_axis + 2) % 3;
+	const float* min0 = m_min[m_axis].data();
+	const float* max0 = m_max[m_axis].data();
+	const float* min1 = m_min[a1].data();
+	const float* max1 = m_max[a1].data();
+	const float* min2 = m_min[a2].data();
+	const float* max2 = m_max[a2].data();
+	const uint32_t count = static_cast<uint32_t>(m_proxy_of.size());
+
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const float hi = max0[i];
+		uint32_t j = i + 1;
+#ifdef BLIB_SSE2
+		// Four candidates at a time, most fail on the other axes so the tests are
+		// combined into one mask instead of branching on each
+		const __m128 hi4 = _mm_set1_ps(hi);
+		const __m128 min1_i = _mm_set1_ps(min1[i]), max1_i = _mm_set1_ps(max1[i]);
+		const __m128 min2_i = _mm_set1_ps(min2[i]), max2_i = _mm_set1_ps(max2[i]);
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128 in_range = _mm_cmple_ps(_mm_loadu_ps(min0 + j), hi4);
+			__m128 overlap = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(min1 + j), max1_i), _mm_cmple_ps(min1_i, _mm_loadu_ps(max1 + j)));
+			overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(min2 + j), max2_i), _mm_cmple_ps(min2_i, _mm_loadu_ps(max2 + j))));
+			uint32_t hits = static_cast<uint32_t>(_mm_movemask_ps(_mm_and_ps(in_range, overlap)));
+			while (hits)
+			{
+				out.push_back({ m_entity[i], m_entity[j + detail::lowest_bit(hits)] });
+				hits &= hits - 1;
+			}
+			// Sorted by minimum, so the first candidate out of range ends the sweep
+			if (_mm_movemask_ps(in_range) != 0xf)
+				break;
+		}
+		if (j + 4 <= count)
+			continue;
+#endif
+		for (; j < count && min0[j] <= hi; j++)
+		{
+			if ((min1[j] <= max1[i]) & (min1[i] <= max1[j]) & (min2[j] <= max2[i]) & (min2[i] <= max2[j]))
+				out.push_back({ m_entity[i], m_entity[j] });
+		}
+	}
+}
+
+}
@@ -4,32 +4,555 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <unordered_map>
+#include <set>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <typeindex>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <cassert>
+#include <new>
+#include "blib_fileio.h"
+#include "blib_profiler.h"
+#include "blib_events.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace blib
 {
 
 class component;
+class entity;
 class entity_container;
+struct memory_stats;
 
 struct entity_id { uint64_t id = 0; };
 
+namespace detail
+{
+	// Index of the lowest set bit, v must not be zero
+	inline uint32_t lowest_bit(uint64_t v)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, v);
+		return index;
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(v));
+#endif
+	}
+
+	// Update of a whole group of components of one type, without virtual calls
+	struct update_batch
+	{
+		const std::type_info* type;
+		size_t (*run)(std::vector<component*>& components, float dt); // Returns the number updated
+	};
+
+	template<class T>
+	const update_batch* update_batch_of();
+
+	// Size of a component type in entity storage, how to move it into newly allocated
+	// memory, null if it can't be (see entity_container::compact), and its update batch
+	struct component_layout
+	{
+		size_t size;
+		component* (*move)(component& from);
+		const update_batch* update;
+	};
+
+	template<class T>
+	void register_layout();
+
+	// Entity pointers by id, for lookups from any thread. Three levels of nodes are
+	// allocated on first use with a compare exchange and kept until clear, so a lookup
+	// is a few atomic loads and never waits. Besides entities a slot can hold two marks
+	// that lookups skip: claimed while a thread sets up a new entity under the id, and
+	// dead once the entity is destroyed, so the id is never handed out again.
+	class id_table
+	{
+	public:
+		id_table() = default;
+		id_table(const id_table&) = delete;
+		id_table& operator=(const id_table&) = delete;
+		~id_table() { clear(); }
+
+		entity* find(uint64_t id) const
+		{
+			if (id >= capacity)
+				return nullptr;
+			const node* mid = static_cast<const node*>(m_root.slots[id >> (2 * bits)].load(std::memory_order_acquire));
+			const node* leaf = mid ? static_cast<const node*>(mid->slots[(id >> bits) & mask].load(std::memory_order_acquire)) : nullptr;
+			void* e = leaf ? leaf->slots[id & mask].load(std::memory_order_acquire) : nullptr;
+			return e == claimed() || e == dead() ? nullptr : static_cast<entity*>(e);
+		}
+
+		void set(uint64_t id, entity* e) { slot(id).store(e, std::memory_order_release); }
+
+		// Marks an unused id as taken, fails if another thread or entity has it
+		bool claim(uint64_t id)
+		{
+			void* expected = nullptr;
+			return slot(id).compare_exchange_strong(expected, claimed(), std::memory_order_acq_rel);
+		}
+
+		// Also takes over ids of destroyed entities, for ids that come back from outside
+		bool reclaim(uint64_t id)
+		{
+			std::atomic<void*>& s = slot(id);
+			void* expected = s.load(std::memory_order_acquire);
+			while (expected == nullptr || expected == dead())
+				if (s.compare_exchange_weak(expected, claimed(), std::memory_order_acq_rel))
+					return true;
+			return false;
+		}
+
+		void retire(uint64_t id) { slot(id).store(dead(), std::memory_order_release); }
+
+		// Only while no other thread uses the table
+		void clear()
+		{
+			for (auto& m : m_root.slots)
+			{
+				node* mid = static_cast<node*>(m.exchange(nullptr, std::memory_order_relaxed));
+				if (!mid)
+					continue;
+				for (auto& leaf : mid->slots)
+					delete static_cast<node*>(leaf.load(std::memory_order_relaxed));
+				delete mid;
+			}
+			m_nodes = 0;
+		}
+
+		size_t memory_usage() const { return sizeof(*this) + m_nodes.load(std::memory_order_relaxed) * sizeof(node); }
+
+	private:
+		static constexpr uint32_t bits = 12;
+		static constexpr uint64_t mask = (1ull << bits) - 1;
+		static constexpr uint64_t capacity = 1ull << (3 * bits);
+
+		struct node
+		{
+			std::atomic<void*> slots[1ull << bits] = {};
+		};
+
+		// Threads racing for an empty slot all allocate, one wins and the others free theirs
+		node* child(std::atomic<void*>& slot)
+		{
+			void* p = slot.load(std::memory_order_acquire);
+			if (p)
+				return static_cast<node*>(p);
+			node* n = new node();
+			if (slot.compare_exchange_strong(p, n, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				m_nodes.fetch_add(1, std::memory_order_relaxed);
+				return n;
+			}
+			delete n;
+			return static_cast<node*>(p);
+		}
+
+		static void* claimed() { return reinterpret_cast<void*>(uintptr_t(1)); }
+		static void* dead() { return reinterpret_cast<void*>(uintptr_t(2)); }
+
+		std::atomic<void*>& slot(uint64_t id)
+		{
+			assert(id < capacity && "Entity id out of range of the concurrent id table");
+			node* mid = child(m_root.slots[id >> (2 * bits)]);
+			node* leaf = child(mid->slots[(id >> bits) & mask]);
+			return leaf->slots[id & mask];
+		}
+
+		node m_root;
+		std::atomic<size_t> m_nodes = 0;
+	};
+
+	// Set of entity ids in blocks of 4096 bits. A block is only kept while any of its
+	// bits is set, so memory follows the ids in the set rather than the largest id.
+	class id_bitset
+	{
+	public:
+		static constexpr uint64_t block_bits = 4096;
+		static constexpr uint32_t block_words = block_bits / 64;
+
+		struct block
+		{
+			uint64_t words[block_words] = {};
+			uint32_t count = 0;
+		};
+
+		void set(uint64_t id, bool value)
+		{
+			const uint64_t bit = uint64_t(1) << (id % 64);
+			auto itr = m_blocks.find(id / block_bits);
+			if (itr == m_blocks.end())
+			{
+				if (!value)
+					return;
+				itr = m_blocks.emplace(id / block_bits, block()).first;
+			}
+
+			uint64_t& word = itr->second.words[(id % block_bits) / 64];
+			if (((word & bit) != 0) == value)
+				return;
+			word ^= bit;
+			if (value)
+				itr->second.count++;
+			else if (--itr->second.count == 0)
+				m_blocks.erase(itr);
+		}
+
+		// Block holding the ids from key * block_bits on, null if none of them is set
+		const block* find(uint64_t key) const
+		{
+			auto itr = m_blocks.find(key);
+			return itr != m_blocks.end() ? &itr->second : nullptr;
+		}
+
+		void keys(std::vector<uint64_t>& out) const
+		{
+			for (auto& b : m_blocks)
+				out.push_back(b.first);
+		}
+
+		size_t blocks() const { return m_blocks.size(); }
+		void clear() { m_blocks.clear(); }
+		size_t memory_usage() const { return m_blocks.bucket_count() * sizeof(void*) + m_blocks.size() * (sizeof(void*) + sizeof(decltype(m_blocks)::value_type)); }
+
+	private:
+		std::unordered_map<uint64_t, block> m_blocks;
+	};
+}
+
+// Size class pools behind component::operator new. Every thread allocates from blocks
+// of its own, so creating components never locks, and components created one after
+// another end up next to each other in memory. Components freed on another thread go
+// back to their block through a lock-free list that the owning thread drains. Blocks
+// of a thread that exits go to the next thread that allocates from their size class.
+// A block goes back to the system once its owner sees it empty, unless it is the
+// block the owner allocates from.
+class component_allocator
+{
+public:
+	static void* allocate(size_t size);
+	static void deallocate(void* p, size_t size);
+
+	// The next 'count' allocations of 'size' bytes on this thread come from memory that
+	// was never used before, in address order within each block
+	static void reserve(size_t size, size_t count);
+
+	// Sizes that share a size class share their pool
+	static constexpr size_t size_class_of(size_t size) { return (size + granularity - 1) / granularity; }
+
+	// Bytes taken from the system by all threads, in pool blocks and components too
+	// large for a pool. Blocks emptied by other threads are only returned after their
+	// owner allocates from the size class again.
+	static size_t reserved_bytes() { return reserved().load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t granularity = 16;
+	static constexpr size_t class_count = 32;
+	static constexpr size_t block_size = 64 * 1024;
+
+	struct pool;
+
+	// Header at the start of every block. Blocks are aligned to their size, so a slot
+	// finds its block by masking its address.
+	struct block
+	{
+		std::atomic<pool*> owner = nullptr;		// Null while no thread owns the block
+		std::atomic<void*> remote = nullptr;	// Freed on other threads
+		void* free = nullptr;					// Freed on the owning thread
+		char* next = nullptr;					// Never allocated, up to end
+		char* end = nullptr;
+		size_t size_class = 0;
+		size_t live = 0;						// Allocated and not yet freed or drained from remote
+		size_t index = 0;						// In the blocks of the owning pool
+	};
+	static constexpr size_t header_size = (sizeof(block) + granularity - 1) / granularity * granularity;
+
+	struct pool
+	{
+		std::vector<block*> blocks;
+		block* current = nullptr;	// Allocations come from here
+		size_t cursor = 0;			// Where the search for free slots goes on
+		size_t reserved = 0;
+		~pool();
+	};
+
+	// Blocks of exited threads, per size class
+	struct orphanage
+	{
+		std::mutex mutex;
+		std::vector<block*> blocks[class_count];
+	};
+
+	static pool& get_pool(size_t size_class);
+	static bool& thread_exited();
+	static block* block_of(void* p) { return reinterpret_cast<block*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(block_size - 1)); }
+	static void* allocate_slow(pool& p, size_t size_class);
+	static block* new_block(pool& p, size_t size_class);
+	static block* adopt(pool& p, size_t size_class);
+	static void release(pool& p, block* b);
+	static void take_remote(block* b);
+	static std::atomic<size_t>& reserved();
+	static orphanage& orphans();
+};
+
 class component
 {
 	friend class entity;
+	friend class entity_container;
 
 public:	
-	virtual void update(float dt) {}
+	static void* operator new(size_t size) { return component_allocator::allocate(size); }
+	static void operator delete(void* p, size_t size) { component_allocator::deallocate(p, size); }
+	static void* operator new(size_t size, std::align_val_t align) { return ::operator new(size, align); }
+	static void operator delete(void* p, size_t size, std::align_val_t align) { ::operator delete(p, size, align); }
+
+	component() = default;
+	// Copies carry the values and owner, but not the membership in an update group
+	component(const component& other) : m_parent(other.m_parent), m_version(other.m_version) { }
+	component& operator=(const component& other);
+	virtual ~component();
+
+	// Containers update components grouped by type and never visit types that keep
+	// this empty default, so only override it when there is work to do
+	virtual void update(float) {}
+
+	// Serialization hooks, only called for registered component types (see register_component)
+	virtual void serialize(io::binary_writer&) const {}
+	virtual void deserialize(io::binary_reader&) {}
+
+	// Flags the component as changed, so the next delta snapshot includes it
+	void mark_dirty();
+	uint64_t version() const { return m_version; }
 
 protected:
 	entity* m_parent = nullptr;
+
+private:
+	uint64_t m_version = 0;
+	uint32_t m_update_group = ~0u;
+	uint32_t m_update_index = 0;
+};
+
+// Where the components of a type are kept
+enum class storage
+{
+	entity,		// Heap allocated and owned by their entity, addresses only change in entity_container::compact
+	sparse_set	// Packed per type in a sparse_pool of the container, O(1) add and remove,
+				// but adding or removing moves other components of the same type
+};
+
+// Specialize to keep a component type in another storage, e.g. for components added
+// and removed all the time:
+// template<> struct blib::component_storage<burning> { static constexpr blib::storage value = blib::storage::sparse_set; };
+template<class T>
+struct component_storage
+{
+	static constexpr storage value = storage::entity;
+};
+
+namespace detail
+{
+	struct pool_base
+	{
+		virtual ~pool_base() = default;
+		virtual component* get(uint64_t id) = 0;
+		virtual void remove(uint64_t id) = 0;
+		virtual void update(float dt) = 0;
+		virtual std::unique_ptr<pool_base> create() const = 0;
+		virtual void transfer(uint64_t id, pool_base& target) = 0;
+		virtual void sort(const std::vector<uint64_t>& order) = 0;
+		virtual void sort_by_id() = 0;
+		virtual const std::type_info& type() const = 0;
+		virtual void memory_usage(memory_stats& stats) const = 0;
+	};
+}
+
+// Components of one type packed in an array, with a paged sparse array from entity id
+// to array index. Removing moves the last component into the gap. Removing during
+// update leaves a gap that is closed after the loop, adding during update is an error.
+template<class T>
+class sparse_pool : public detail::pool_base
+{
+public:
+	T* find(uint64_t id);
+	template<typename... Args>
+	T& add(uint64_t id, Args&&... args);
+	void remove(uint64_t id) override;
+	void update(float dt) override;
+	void reserve(size_t count);
+
+	// Moves the component of an entity into a pool of the same type
+	void transfer(uint64_t id, pool_base& target) override;
+
+	// Packs the components of the entities in 'order' first, in that order, followed by
+	// the rest in their current order
+	void sort(const std::vector<uint64_t>& order) override;
+
+	// Packs the components in entity id order, for deterministic updates
+	void sort_by_id() override;
+
+	// Packed components and the ids of their entities, removed ones have id 0
+	size_t size() const { return m_dense.size(); }
+	T* data() { return m_dense.data(); }
+	const uint64_t* ids() const { return m_ids.data(); }
+
+private:
+	static constexpr size_t page_size = 4096;
+
+	// Indices of the components of page_size consecutive entity ids. Ids only grow, so
+	// pages are freed once empty and the window of pages moves up with them.
+	struct page
+	{
+		std::unique_ptr<uint32_t[]> slots; // Index + 1, 0 when absent
+		uint32_t count = 0;
+	};
+
+	component* get(uint64_t id) override { return find(id); }
+	std::unique_ptr<pool_base> create() const override { return std::make_unique<sparse_pool<T>>(); }
+	const std::type_info& type() const override { return typeid(T); }
+	page* find_page(uint64_t id);
+	page& page_of(uint64_t id);
+	uint32_t& slot(uint64_t id) { return find_page(id)->slots[id % page_size]; } // For ids in the pool
+	void release_page(uint64_t id);
+	void compact();
+	void memory_usage(memory_stats& stats) const override;
+
+	std::vector<page> m_pages; // From page m_first_page on
+	size_t m_first_page = 0;
+	std::unique_ptr<uint32_t[]> m_spare; // Last freed page, all zero, for ids that come and go
+	std::vector<uint64_t> m_ids;
+	std::vector<T> m_dense;
+	bool m_updating = false;
+	bool m_has_holes = false;
+	bool m_sorted = true; // Dense in id order
+};
+
+// Maps component types to stable hashes of their names, so snapshots can recreate them.
+// Types may be registered while other threads look them up, e.g. while a
+// region_streamer loads in the background. Entries are never removed or changed, so
+// the pointers find returns stay valid.
+class component_registry
+{
+public:
+	struct type_info
+	{
+		uint64_t hash = 0;
+		std::string name;
+		std::unique_ptr<component>(*create)() = nullptr;
+		component& (*add)(entity& e) = nullptr; // create_component<T>, in the storage of T
+		void (*remove)(entity& e) = nullptr; // destroy_component<T>
+	};
+
+	template<class T>
+	static void add(const std::string& name);
+	static const type_info* find(uint64_t hash);
+	static const type_info* find(const std::type_info& type);
+
+private:
+	static component_registry& instance();
+	std::shared_mutex m_mutex;
+	std::unordered_map<uint64_t, type_info> m_types;
+	std::unordered_map<std::type_index, uint64_t> m_hashes;
+};
+
+template<class T>
+void register_component(const std::string& name) { component_registry::add<T>(name); }
+
+// Interns strings into a block arena, every distinct string gets a stable id.
+// Strings are never released, id 0 is always the empty string.
+class string_table
+{
+public:
+	using id = uint32_t;
+	static constexpr id invalid = ~0u;
+
+	string_table() { clear(); }
+	string_table(const string_table&) = delete;
+	string_table& operator=(const string_table&) = delete;
+
+	id intern(std::string_view text);
+	id find(std::string_view text) const;
+	std::string_view get(id i) const { return m_strings[i]; }
+	size_t size() const { return m_strings.size(); }
+	void clear();
+
+	// Blocks, views and an estimate of the lookup table
+	size_t memory_usage() const;
+
+private:
+	static constexpr size_t block_size = 16 * 1024;
+
+	std::vector<std::unique_ptr<char[]>> m_blocks;
+	size_t m_block_used = block_size;
+	size_t m_block_bytes = 0;
+	std::vector<std::string_view> m_strings;
+	std::unordered_map<std::string_view, id> m_lookup;
+};
+
+// A set of components with initial values, copied into every entity created by
+// entity_container::instantiate
+class prefab
+{
+	friend class entity_container;
+
+public:
+	template<class T, typename... Args>
+	T& add(Args&&... args);
+
+	void set_tag(uint64_t tag) { m_tag = tag; }
+	uint64_t tag() const { return m_tag; }
+
+private:
+	struct entry
+	{
+		std::unique_ptr<component> prototype;
+		size_t size;
+		bool allocates;	// Copies come from the component_allocator, not a sparse pool or the heap
+		component& (*copy)(entity& e, const component& prototype);
+	};
+
+	std::vector<entry> m_components;
+	uint64_t m_tag = 0;
+};
+
+// Contiguous range of entity ids, as returned by entity_container::instantiate
+struct entity_range
+{
+	struct iterator
+	{
+		uint64_t id;
+		entity_id operator*() const { return { id }; }
+		iterator& operator++() { id++; return *this; }
+		bool operator!=(const iterator& other) const { return id != other.id; }
+	};
+
+	uint64_t first = 0;
+	uint64_t count = 0;
+
+	iterator begin() const { return { first }; }
+	iterator end() const { return { first + count }; }
+	size_t size() const { return count; }
+	entity_id operator[](size_t i) const { return { first + i }; }
 };
 
 class entity
 {
 	friend class entity_container;	
+	friend class component;
 	explicit entity(entity_id id) : m_id(id) { }
 
 public:	
@@ -39,11 +562,12 @@ public:
 	entity& operator=(const entity&) = delete;
 	entity& operator=(entity&&) = default;
 
-	entity_id id() { return m_id; }
-	const std::string& name() { return m_name; }
-	void set_name(const std::string& name) { m_name = name; }
-	uint64_t tag() { return m_tag; }
-	void set_tag(uint64_t tag) { m_tag = tag; }
+	entity_id id() const { return m_id; }
+	std::string_view name() const;
+	void set_name(std::string_view name);
+	uint64_t tag() const { return m_tag; }
+	void set_tag(uint64_t tag);
+	uint64_t version() const { return m_version; }
 
 	template<class T, typename... Args>
 	T& create_component(Args&&... args);
@@ -57,29 +581,306 @@ public:
 	template<class T>
 	void destroy_component();
 
+	// Calls fn(component&) for every component, in either storage
+	template<class F>
+	void each_component(F&& fn) const;
+
 	bool valid() const { return m_id.id != 0; }
 	void update(float dt);
 
 private:	
+	component& add_component(std::unique_ptr<component> c, const detail::update_batch* update);
+	void own_component(component& c);
+	void remove_component(component* c);
+	component* find_component(uint64_t hash);
+	void mark_changed();
+
 	entity_id m_id = {};
-	std::string m_name = {};
+	string_table::id m_name = 0;
 	uint64_t m_tag = {};
+	uint64_t m_version = 0;
+	entity_container* m_container = nullptr;
 	std::vector<std::unique_ptr<component>> m_components;
 };
 
+// Memory held by an entity_container, see entity_container::memory_usage. Standard
+// containers are counted by capacity and their nodes by an estimate, without the
+// overhead of the heap itself.
+struct memory_stats
+{
+	struct component_type
+	{
+		const std::type_info* type = nullptr;
+		std::string name;		// Registered name, or the name of the type
+		size_t count = 0;
+		size_t bytes = 0;
+	};
+
+	std::vector<component_type> components; // One per type, in either storage
+	size_t component_bytes = 0;
+	size_t entity_count = 0;
+	size_t entity_bytes = 0;	// Map nodes and component lists
+	size_t index_bytes = 0;		// Hash buckets, update groups, sparse pool pages, tag bitsets and the name index
+	size_t name_bytes = 0;
+	size_t history_bytes = 0;	// Tombstones kept for write_delta
+	size_t buckets = 0;
+	float load_factor = 0.0f;
+
+	// Process wide, not part of total
+	size_t allocator_bytes = 0;	// See component_allocator::reserved_bytes
+	io::memory_stats io;
+
+	size_t total() const { return component_bytes + entity_bytes + index_bytes + name_bytes + history_bytes; }
+	const component_type* find(const std::type_info& type) const;
+};
+
+// Soft limits on sampled memory_stats, e.g. for production telemetry. Every budget
+// measures one number of a sample and calls back when it goes over the limit, once,
+// until a later sample is back under it.
+class memory_budgets
+{
+public:
+	using measure = std::function<size_t(const memory_stats& stats)>;
+	using callback = std::function<void(const std::string& name, size_t used, size_t limit)>;
+
+	// Replaces the budget of the same name
+	void set(const std::string& name, size_t limit, measure fn, callback on_exceeded);
+	void remove(const std::string& name);
+	void check(const memory_stats& stats);
+
+private:
+	struct budget
+	{
+		std::string name;
+		size_t limit;
+		measure fn;
+		callback on_exceeded;
+		bool exceeded = false;
+	};
+
+	std::vector<budget> m_budgets;
+};
+
 class entity_container
 {
+	friend class entity;
+	friend class component;
+
 public:
+	entity_container() = default;
+	entity_container(const entity_container&) = delete;
+	entity_container& operator=(const entity_container&) = delete;
+	~entity_container();
+
 	entity& create();
+	entity_range instantiate(const prefab& p, size_t count);
 	entity* try_get(entity_id id);
 	entity& get(entity_id id);
 	void destroy(entity_id id);
 	void update(float dt);
+	void clear();
+
+	// Calls fn(entity&, T&) for every component of type T. For sparse_set storage this
+	// walks the packed array, otherwise every entity is searched.
+	template<class T, class F>
+	void each(F&& fn);
+
+	// Pool of a component type in sparse_set storage, created on first use
+	template<class T>
+	sparse_pool<T>& pool();
+
+	// Names are interned in a table owned by the container. With the name index enabled
+	// find is a hash lookup, otherwise it scans all entities. If several entities share
+	// a name, both return the one with the lowest id. Interned names are kept until
+	// clear, so names that never repeat, e.g. with a counter in them, grow the table.
+	entity* find(std::string_view name);
+	void enable_name_index(bool enable);
+	const string_table& names() const { return m_names; }
+
+	// Tags are bitmasks. Every bit keeps a sparse bitset over entity ids, so filtering by
+	// tag tests 64 entities at once and only visits blocks of ids that have the rarest
+	// of the required bits. Calls fn(entity&), in id order, for every entity that has
+	// all bits of mask and none of exclude. fn may change tags.
+	template<class F>
+	void each_with_tags(uint64_t mask, F&& fn) { each_with_tags(mask, 0, std::forward<F>(fn)); }
+	template<class F>
+	void each_with_tags(uint64_t mask, uint64_t exclude, F&& fn);
+
+	// Binary snapshots of all valid entities and their registered components.
+	// Loading replaces the current contents of the container, a snapshot that fails to
+	// load leaves them untouched.
+	void write_snapshot(io::binary_writer& writer) const;
+	bool read_snapshot(io::binary_reader& reader);
+	bool save_snapshot(const std::string& filename) const;
+	bool load_snapshot(const std::string& filename);
+
+	// Moves all entities of another container, e.g. a streamed region, into this one.
+	// Entities keep their ids and addresses and components are never copied, only the
+	// per-container indices are updated. Fails without moving anything if an id is taken.
+	bool merge(entity_container& region);
+	// The reverse of merge, moves the given entities into 'region'
+	void detach(const std::vector<entity_id>& ids, entity_container& region);
+
+	// Change tracking. Structural changes and dirty components are stamped with the
+	// current version, which advances every update and every write_delta.
+	// write_delta emits everything stamped after 'since' and returns the version to
+	// pass as 'since' next time. Tombstones of removed components and destroyed
+	// entities are kept until discard_history is called with a version past them.
+	uint64_t version() const { return m_version; }
+	uint64_t write_delta(io::binary_writer& writer, uint64_t since);
+	bool apply_delta(io::binary_reader& reader);
+	void discard_history(uint64_t version);
+
+	// Updates always run in a fixed order, by component type and then by creation, or
+	// by the order of the last compaction for components that were around for it.
+	// Deterministic mode instead runs types by their registered hash and components by
+	// entity id, so a world read from a snapshot updates like the one that wrote it.
+	// It also visits entities in id order wherever all of them are walked (each,
+	// each_with_tags without a mask, find, the name index), which costs a sort per
+	// walk. Together with the same build, inputs and dt this replays bit identically,
+	// see blib_replay.h.
+	void set_deterministic(bool enable) { assert(!(enable && m_table)); m_deterministic = enable; }
+	bool deterministic() const { return m_deterministic; }
+
+	// Hash of the snapshot of the container
+	uint64_t state_hash() const;
+
+	// Concurrent mode lets other threads create entities and look them up while the
+	// owning thread runs update. Ids are taken in per-thread blocks from an atomic
+	// counter, so they stay unique but are no longer dense or in creation order, which
+	// rules out deterministic mode. try_get and get then read a lock-free id table and
+	// never wait. Every id is claimed in that table before use, so ids that merge,
+	// apply_delta or read_snapshot bring in are skipped by the blocks, and a merge or
+	// delta that brings in an id still being created on another thread fails. The ids
+	// of destroyed entities are not handed out again. Destroyed entities are released
+	// one update later than usual, so a pointer another thread got stays valid until
+	// the end of the next update.
+	// Switch modes while no other thread uses the container.
+	void set_concurrent(bool enable);
+	bool concurrent() const { return m_table != nullptr; }
+
+	// Creates an entity from any thread without locking. init(entity&) sets it up on
+	// the calling thread, after that try_get finds it and it joins the container with
+	// the next update or flush_created. Until it joins it only takes components in
+	// entity storage, is not visited by update, walks or snapshots, and can't be named
+	// or destroyed. Tags set on it apply when it joins.
+	template<class F>
+	entity_id create_concurrent(F&& init);
+	entity_id create_concurrent() { return create_concurrent([](entity&) { }); }
+	// Joins the entities created concurrently so far, on the owning thread
+	void flush_created();
+
+	// Walks all entities and pools, so sample it now and then rather than every frame
+	memory_stats memory_usage() const;
+
+	// Events between components. update dispatches pre_update_phase before any component
+	// updates and post_update_phase after all of them, other phases are up to the owner.
+	// Besides the jobs of an update, other threads may only emit while no update runs.
+	static constexpr uint32_t pre_update_phase = 0;
+	static constexpr uint32_t post_update_phase = 1;
+	event_bus& events() { return m_events; }
+
+	// Relocates the components in entity storage into contiguous memory, ordered by
+	// key(entity) and then by id, and packs the sparse pools and update groups in the
+	// same order, so after long churn updates walk memory front to back again.
+	// Ids, names, tags and entity references stay valid, pointers and references to
+	// components do not. Types that can't be moved stay where they are.
+	// Call outside of update.
+	using compaction_key = std::function<uint64_t(const entity&)>;
+	void compact(const compaction_key& key = {});
+
+	// The same pass spread over several calls, each relocating the components of whole
+	// entities until at least 'budget' were moved. The order is taken when a pass starts
+	// and entities created later wait for the next pass. The call that finishes the pass
+	// packs the pools and update groups and returns true.
+	bool compact_step(size_t budget, const compaction_key& key = {});
 
 private:
+	static constexpr uint32_t snapshot_magic = 0x4e534c42; // "BLSN"
+	static constexpr uint32_t delta_magic = 0x4c444c42; // "BLDL"
+	static constexpr uint32_t snapshot_version = 1;
+
+	struct destroyed_entity { uint64_t id; uint64_t version; };
+	struct removed_component { uint64_t id; uint64_t hash; uint64_t version; };
+
+	// All live components of one type that has its own update. Removed components
+	// leave a null behind until the next update compacts the group.
+	struct update_group
+	{
+		const detail::update_batch* batch;
+		std::vector<component*> components;
+		bool has_holes = false;
+		bool sorted = true;	// Components in entity id order
+		uint64_t order = 0;	// See type_order
+	};
+
+	entity& create(uint64_t id);
+	entity* recreate(uint64_t id);
+	bool parse_snapshot(io::binary_reader& reader, uint64_t& next_id);
+	void release_dead(uint64_t id);
+	std::vector<const entity*> sorted_entities() const;
+	template<class F>
+	void each_entity(F&& fn);
+	void rename(entity& e, string_table::id name);
+	uint64_t lowest_named(string_table::id name) const;
+	void retag(entity& e, uint64_t tag);
 	void clean();
+	void join_update_group(component& c, const detail::update_batch* batch);
+	void leave_update_group(component& c);
+	void sort_for_update();
+	static uint64_t type_order(const std::type_info& type);
+	void adopt(entity_container& from, uint64_t id);
+	entity* lookup(uint64_t id);
+	uint64_t reserve_id();
+	uint64_t claim_id();
+	void raise_next_id(uint64_t id);
+	void release_staged();
+	static uint64_t next_serial();
+	std::vector<entity*> compaction_order(const compaction_key& key);
+	void relocate(const std::vector<entity*>& entities);
+	void reorder(const std::vector<entity*>& order);
+
+	template<class T>
+	sparse_pool<T>* find_pool();
+	template<class T>
+	static size_t pool_index();
+	static size_t next_pool_index();
+
+	// Declared before the entities, so the groups outlive the components detaching from them
+	std::deque<update_group> m_update_groups;
+	std::unordered_map<const detail::update_batch*, uint32_t> m_update_group_lookup;
 	std::unordered_map<uint64_t, entity> m_entities;
-	uint64_t m_next_id = 0;
+	std::vector<std::unique_ptr<detail::pool_base>> m_pools; // By pool_index, null if unused
+	std::vector<detail::pool_base*> m_pool_order; // By type in deterministic mode, see sort_for_update
+	bool m_update_groups_sorted = true;
+	string_table m_names;
+	std::vector<std::set<uint64_t>> m_name_index; // Ids of the entities with every name, lowest first
+	bool m_name_index_enabled = false;
+	detail::id_bitset m_tag_bits[64];
+	std::atomic<uint64_t> m_next_id = 0;
+	uint64_t m_version = 1;
+	bool m_deterministic = false;
+	std::vector<destroyed_entity> m_destroyed;
+	std::vector<uint64_t> m_dead; // Destroyed, erased by the next clean
+	std::vector<std::unordered_map<uint64_t, entity>::node_type> m_dead_nodes; // Destroyed and id taken again, see release_dead
+	std::vector<removed_component> m_removed;
+	std::vector<uint64_t> m_compact_order; // Entities of the running compaction pass
+	size_t m_compact_next = 0;
+	bool m_compacting = false;
+
+	// Concurrent mode
+	struct staged_entity
+	{
+		std::unordered_map<uint64_t, entity>::node_type node;
+		staged_entity* next;
+	};
+	static constexpr uint64_t id_block_size = 256;
+	uint64_t m_serial = next_serial(); // Tells the id blocks of containers apart, renewed by clear
+	std::unique_ptr<detail::id_table> m_table; // Null unless concurrent
+	std::atomic<staged_entity*> m_staged = nullptr;
+	std::vector<std::unordered_map<uint64_t, entity>::node_type> m_retired; // Released by the next clean
+
+	event_bus m_events;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -90,98 +891,1597 @@ private:
 
 
 ////////////////////////////////////////////////////////////////////////////////
-////							Entity
+////						Static Update
 ////////////////////////////////////////////////////////////////////////////////
 
-template<class C, typename... Args >
-inline C& blib::entity::create_component(Args&&... args)
-{
-	auto c = std::make_unique<C>(std::forward<Args>(args)...);
-	c->m_parent = this;
-	auto& ref = m_components.emplace_back(move(c));
-	return *(static_cast<C*>(ref.get()));
-}
-
-template<class T>
-inline T& blib::entity::get_component()
+namespace detail
 {
-	T* found = try_get_component<T>();
-	assert(found != nullptr);
-	return *found;
-}
+	// True if T or one of its bases between T and component overrides update
+	template<class T>
+	constexpr bool has_update = !std::is_same_v<decltype(&T::update), void (component::*)(float)>;
 
-template<class T>
-inline T* entity::try_get_component()
-{
-	for (auto& c : m_components)
+	template<class T>
+	inline size_t update_all(std::vector<component*>& components, float dt)
 	{
-		T* found = dynamic_cast<T*>(c.get());
-		if (found)
-			return found;
+		// Indexed, components added during the loop are appended and updated too
+		size_t count = 0;
+		for (size_t i = 0; i < components.size(); i++)
+		{
+			if (component* c = components[i])
+			{
+				static_cast<T*>(c)->T::update(dt);
+				count++;
+			}
+		}
+		return count;
 	}
-	return nullptr;
-}
 
-template<class T>
-inline void entity::destroy_component()
-{
-	for (auto it = m_components.begin();  it != m_components.end(); ++it)
+	template<class T>
+	inline const update_batch* update_batch_of()
 	{
-		T* found = dynamic_cast<T*>(it->get());
-		if (found) {
-			m_components.erase(it);
-			break;
+		if constexpr (has_update<T>)
+		{
+			static const update_batch batch = { &typeid(T), &update_all<T> };
+			return &batch;
+		}
+		else
+		{
+			return nullptr;
 		}
 	}
 }
 
-void blib::entity::update(float dt)
+namespace detail
 {
-	for (auto& c : m_components)
-		c.get()->update(dt);
-}
+	struct layout_registry
+	{
+		std::mutex mutex;
+		std::unordered_map<std::type_index, component_layout> types;
+	};
+
+	inline layout_registry& layouts()
+	{
+		static layout_registry registry;
+		return registry;
+	}
+
+	// Once per type, when the first component of it is created in entity storage.
+	// Over aligned types bypass the component allocator, so moving them gains nothing.
+	template<class T>
+	inline void register_layout()
+	{
+		static const bool registered = []()
+		{
+			component_layout layout = { sizeof(T), nullptr, update_batch_of<T>() };
+			if constexpr (std::is_move_constructible_v<T> && alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				layout.move = [](component& from) -> component* { return new T(std::move(static_cast<T&>(from))); };
+
+			auto& registry = layouts();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.types[typeid(T)] = layout;
+			return true;
+		}();
+		(void)registered;
+	}
+
+	// Holds the registry lock while it lives. Few types are in use at a time, so the
+	// type_info pointers seen so far save hashing type names.
+	class layout_lookup
+	{
+	public:
+		layout_lookup() : m_lock(layouts().mutex) { }
+
+		const component_layout* find(const component& c)
+		{
+			const std::type_info* type = &typeid(c);
+			for (auto& s : m_seen)
+				if (s.first == type)
+					return s.second;
+			auto& types = layouts().types;
+			auto itr = types.find(std::type_index(*type));
+			m_seen.push_back({ type, itr != types.end() ? &itr->second : nullptr });
+			return m_seen.back().second;
+		}
 
+	private:
+		std::lock_guard<std::mutex> m_lock;
+		std::vector<std::pair<const std::type_info*, const component_layout*>> m_seen;
+	};
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-////						Entity Container
+////						Component Allocator
 ////////////////////////////////////////////////////////////////////////////////
 
-inline entity& blib::entity_container::create()
+inline void* component_allocator::allocate(size_t size)
 {
-	m_next_id++;
-	m_entities.emplace(m_next_id, entity({ m_next_id }));
-	return m_entities[m_next_id];
-}
+	size_t size_class = size_class_of(size);
+	if (size_class >= class_count)
+	{
+		reserved().fetch_add(size, std::memory_order_relaxed);
+		return ::operator new(size);
+	}
 
-inline entity& blib::entity_container::get(entity_id id)
-{
-	auto itr = m_entities.find(id.id);
-	assert(itr != m_entities.end());
-	return itr->second;
+	pool& p = get_pool(size_class);
+	const size_t bytes = size_class * granularity;
+	if (block* b = p.current)
+	{
+		if (b->free && p.reserved == 0)
+		{
+			void* result = b->free;
+			b->free = *static_cast<void**>(result);
+			b->live++;
+			return result;
+		}
+		if (static_cast<size_t>(b->end - b->next) >= bytes)
+		{
+			if (p.reserved > 0)
+				p.reserved--;
+			void* result = b->next;
+			b->next += bytes;
+			b->live++;
+			return result;
+		}
+	}
+	return allocate_slow(p, size_class);
 }
 
-inline void blib::entity_container::update(float dt)
+inline void component_allocator::deallocate(void* ptr, size_t size)
 {
-	for (auto& e : m_entities)
-		if(e.second.valid())
-			e.second.update(dt);
+	size_t size_class = size_class_of(size);
+	if (size_class >= class_count)
+	{
+		reserved().fetch_sub(size, std::memory_order_relaxed);
+		::operator delete(ptr);
+		return;
+	}
 
-	clean();
+	block* b = block_of(ptr);
+	pool& p = get_pool(size_class);
+	if (b->owner.load(std::memory_order_acquire) == &p && !thread_exited())
+	{
+		*static_cast<void**>(ptr) = b->free;
+		b->free = ptr;
+		if (--b->live == 0 && b != p.current)
+			release(p, b);
+		return;
+	}
+
+	// Also for orphans, the thread adopting the block takes these
+	void* head = b->remote.load(std::memory_order_relaxed);
+	do
+		*static_cast<void**>(ptr) = head;
+	while (!b->remote.compare_exchange_weak(head, ptr, std::memory_order_release, std::memory_order_relaxed));
 }
 
+// The current block is used up. Without a reservation, free slots in other blocks,
+// also those freed on other threads, and blocks left by exited threads come before
+// new memory.
+inline void* component_allocator::allocate_slow(pool& p, size_t size_class)
+{
+	assert(!thread_exited() && "Components can't be allocated while a thread exits");
+	const size_t bytes = size_class * granularity;
+	if (p.reserved == 0)
+	{
+		const size_t count = p.blocks.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			block* b = p.blocks[(p.cursor + i) % count];
+			take_remote(b);
+			if (b->free || static_cast<size_t>(b->end - b->next) >= bytes)
+			{
+				p.cursor = (p.cursor + i) % count;
+				p.current = b;
+				return allocate(bytes);
+			}
+		}
+		if (block* b = adopt(p, size_class))
+		{
+			p.current = b;
+			return allocate(bytes);
+		}
+	}
+
+	p.current = new_block(p, size_class);
+	return allocate(bytes);
+}
+
+// Leaves the rest of the current block to the reservation, as it was never used either
+inline void component_allocator::reserve(size_t size, size_t count)
+{
+	size_t size_class = size_class_of(size);
+	if (size_class >= class_count)
+		return;
+
+	pool& p = get_pool(size_class);
+	if (!p.current || static_cast<size_t>(p.current->end - p.current->next) < size_class * granularity)
+		p.current = new_block(p, size_class);
+	p.reserved = count;
+}
+
+inline component_allocator::block* component_allocator::new_block(pool& p, size_t size_class)
+{
+	void* memory = ::operator new(block_size, std::align_val_t(block_size));
+	reserved().fetch_add(block_size, std::memory_order_relaxed);
+
+	block* b = new (memory) block();
+	b->owner.store(&p, std::memory_order_relaxed);
+	b->next = static_cast<char*>(memory) + header_size;
+	b->end = static_cast<char*>(memory) + block_size;
+	b->size_class = size_class;
+	b->index = p.blocks.size();
+	p.blocks.push_back(b);
+	return b;
+}
+
+// Nothing in the block is allocated and no free of it is pending on another thread,
+// as those count as live until drained, so no other thread can still touch it
+inline void component_allocator::release(pool& p, block* b)
+{
+	p.blocks[b->index] = p.blocks.back();
+	p.blocks[b->index]->index = b->index;
+	p.blocks.pop_back();
+
+	b->~block();
+	::operator delete(b, std::align_val_t(block_size));
+	reserved().fetch_sub(block_size, std::memory_order_relaxed);
+}
+
+inline component_allocator::block* component_allocator::adopt(pool& p, size_t size_class)
+{
+	block* b = nullptr;
+	{
+		auto& o = orphans();
+		std::lock_guard<std::mutex> lock(o.mutex);
+		if (o.blocks[size_class].empty())
+			return nullptr;
+		b = o.blocks[size_class].back();
+		o.blocks[size_class].pop_back();
+	}
+	b->owner.store(&p, std::memory_order_release);
+	b->index = p.blocks.size();
+	p.blocks.push_back(b);
+	take_remote(b);
+	return b;
+}
+
+inline void component_allocator::take_remote(block* b)
+{
+	if (!b->remote.load(std::memory_order_relaxed))
+		return;
+
+	void* head = b->remote.exchange(nullptr, std::memory_order_acquire);
+	void* tail = head;
+	b->live--;
+	while (*static_cast<void**>(tail))
+	{
+		tail = *static_cast<void**>(tail);
+		b->live--;
+	}
+	*static_cast<void**>(tail) = b->free;
+	b->free = head;
+}
+
+// Runs when the thread exits, blocks with components still alive become orphans
+inline component_allocator::pool::~pool()
+{
+	thread_exited() = true;
+	current = nullptr;
+	for (size_t i = blocks.size(); i-- > 0;)
+	{
+		take_remote(blocks[i]);
+		if (blocks[i]->live == 0)
+			release(*this, blocks[i]);
+	}
+
+	auto& o = orphans();
+	std::lock_guard<std::mutex> lock(o.mutex);
+	for (block* b : blocks)
+	{
+		b->owner.store(nullptr, std::memory_order_release);
+		o.blocks[b->size_class].push_back(b);
+	}
+}
+
+inline component_allocator::pool& component_allocator::get_pool(size_t size_class)
+{
+	thread_local pool pools[class_count];
+	return pools[size_class];
+}
+
+// Trivially destructible, so still readable after the pools of the thread are gone
+inline bool& component_allocator::thread_exited()
+{
+	thread_local bool exited = false;
+	return exited;
+}
+
+inline component_allocator::orphanage& component_allocator::orphans()
+{
+	static orphanage o;
+	return o;
+}
+
+inline std::atomic<size_t>& component_allocator::reserved()
+{
+	static std::atomic<size_t> bytes = 0;
+	return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////						Component Registry
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+inline void component_registry::add(const std::string& name)
+{
+	static_assert(std::is_base_of_v<component, T>, "Registered types must derive from blib::component");
+	static_assert(std::is_default_constructible_v<T>, "Registered components must be default constructible");
+
+	type_info info;
+	info.hash = io::hash64(name.data(), name.size());
+	info.name = name;
+	info.create = []() -> std::unique_ptr<component> { return std::make_unique<T>(); };
+	info.add = [](entity& e) -> component& { return e.create_component<T>(); };
+	info.remove = [](entity& e) { e.destroy_component<T>(); };
+
+	// Registering a type again keeps the entry that readers may hold
+	auto& registry = instance();
+	std::unique_lock<std::shared_mutex> lock(registry.m_mutex);
+	assert(registry.m_types.count(info.hash) == 0 || registry.m_types[info.hash].name == name);
+	registry.m_hashes[std::type_index(typeid(T))] = info.hash;
+	registry.m_types.emplace(info.hash, std::move(info));
+}
+
+inline const component_registry::type_info* component_registry::find(uint64_t hash)
+{
+	auto& registry = instance();
+	std::shared_lock<std::shared_mutex> lock(registry.m_mutex);
+	auto itr = registry.m_types.find(hash);
+	if (itr != registry.m_types.end())
+		return &itr->second;
+	return nullptr;
+}
+
+inline const component_registry::type_info* component_registry::find(const std::type_info& type)
+{
+	auto& registry = instance();
+	std::shared_lock<std::shared_mutex> lock(registry.m_mutex);
+	auto itr = registry.m_hashes.find(std::type_index(type));
+	if (itr == registry.m_hashes.end())
+		return nullptr;
+	return &registry.m_types.find(itr->second)->second;
+}
+
+inline component_registry& component_registry::instance()
+{
+	static component_registry registry;
+	return registry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							String Table
+////////////////////////////////////////////////////////////////////////////////
+
+inline string_table::id string_table::intern(std::string_view text)
+{
+	auto itr = m_lookup.find(text);
+	if (itr != m_lookup.end())
+		return itr->second;
+
+	// Blocks never move, so views into them stay valid. Long strings get a block of their own.
+	if (m_block_used + text.size() > block_size)
+	{
+		m_blocks.push_back(std::make_unique<char[]>(std::max(block_size, text.size())));
+		m_block_bytes += std::max(block_size, text.size());
+		m_block_used = 0;
+	}
+	char* chars = m_blocks.back().get() + m_block_used;
+	memcpy(chars, text.data(), text.size());
+	m_block_used += text.size();
+
+	id i = static_cast<id>(m_strings.size());
+	m_strings.emplace_back(chars, text.size());
+	m_lookup.emplace(m_strings.back(), i);
+	return i;
+}
+
+inline string_table::id string_table::find(std::string_view text) const
+{
+	auto itr = m_lookup.find(text);
+	return itr != m_lookup.end() ? itr->second : invalid;
+}
+
+inline void string_table::clear()
+{
+	m_blocks.clear();
+	m_block_bytes = 0;
+	m_block_used = block_size;
+	m_strings.clear();
+	m_lookup.clear();
+	m_strings.emplace_back();
+	m_lookup.emplace(std::string_view(), 0);
+}
+
+inline size_t string_table::memory_usage() const
+{
+	return m_block_bytes + m_blocks.capacity() * sizeof(m_blocks[0]) + m_strings.capacity() * sizeof(m_strings[0])
+		+ m_lookup.bucket_count() * sizeof(void*) + m_lookup.size() * (sizeof(void*) * 2 + sizeof(decltype(m_lookup)::value_type));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Prefab
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, typename... Args>
+inline T& prefab::add(Args&&... args)
+{
+	static_assert(std::is_base_of_v<component, T>, "Prefab components must derive from blib::component");
+	static_assert(std::is_copy_constructible_v<T>, "Prefab components are copied, so they must be copy constructible");
+
+	entry e;
+	e.prototype = std::make_unique<T>(std::forward<Args>(args)...);
+	e.size = sizeof(T);
+	e.allocates = component_storage<T>::value == storage::entity && alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+	e.copy = [](entity& e, const component& c) -> component& { return e.create_component<T>(static_cast<const T&>(c)); };
+	return static_cast<T&>(*m_components.emplace_back(std::move(e)).prototype);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Sparse Pool
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+inline T* sparse_pool<T>::find(uint64_t id)
+{
+	page* p = find_page(id);
+	if (!p)
+		return nullptr;
+	uint32_t index = p->slots[id % page_size];
+	return index ? &m_dense[index - 1] : nullptr;
+}
+
+template<class T>
+template<typename... Args>
+inline T& sparse_pool<T>::add(uint64_t id, Args&&... args)
+{
+	assert(!m_updating && "Components can't be added to a sparse_pool while it updates");
+
+	page& p = page_of(id);
+	uint32_t& index = p.slots[id % page_size];
+	if (index)
+	{
+		m_dense[index - 1] = T(std::forward<Args>(args)...);
+		return m_dense[index - 1];
+	}
+
+	if (!m_ids.empty() && m_ids.back() > id)
+		m_sorted = false;
+	m_ids.push_back(id);
+	m_dense.emplace_back(std::forward<Args>(args)...);
+	index = static_cast<uint32_t>(m_dense.size());
+	p.count++;
+	return m_dense.back();
+}
+
+template<class T>
+inline void sparse_pool<T>::remove(uint64_t id)
+{
+	page* p = find_page(id);
+	if (!p || !p->slots[id % page_size])
+		return;
+
+	const uint32_t i = p->slots[id % page_size] - 1;
+	p->slots[id % page_size] = 0;
+	if (--p->count == 0)
+		release_page(id);
+	if (m_updating)
+	{
+		m_ids[i] = 0;
+		m_has_holes = true;
+		return;
+	}
+
+	if (i + 1 != m_dense.size())
+	{
+		m_dense[i] = std::move(m_dense.back());
+		m_ids[i] = m_ids.back();
+		slot(m_ids[i]) = i + 1;
+		m_sorted = false;
+	}
+	m_dense.pop_back();
+	m_ids.pop_back();
+}
+
+template<class T>
+inline void sparse_pool<T>::update(float dt)
+{
+	if constexpr (detail::has_update<T>)
+	{
+#ifdef BLIB_PROFILE
+		profiler::scope timer(typeid(T));
+#endif
+		m_updating = true;
+		size_t count = 0;
+		for (size_t i = 0; i < m_dense.size(); i++)
+		{
+			if (m_ids[i])
+			{
+				m_dense[i].T::update(dt);
+				count++;
+			}
+		}
+		m_updating = false;
+#ifdef BLIB_PROFILE
+		timer.set_calls(count);
+#endif
+	}
+
+	if (m_has_holes)
+		compact();
+}
+
+template<class T>
+inline void sparse_pool<T>::transfer(uint64_t id, pool_base& target)
+{
+	if (T* c = find(id))
+	{
+		static_cast<sparse_pool<T>&>(target).add(id, std::move(*c));
+		remove(id);
+	}
+}
+
+template<class T>
+inline void sparse_pool<T>::reserve(size_t count)
+{
+	m_dense.reserve(count);
+	m_ids.reserve(count);
+}
+
+template<class T>
+inline void sparse_pool<T>::sort(const std::vector<uint64_t>& order)
+{
+	assert(!m_updating && "A sparse_pool can't be sorted while it updates");
+
+	std::vector<T> dense;
+	std::vector<uint64_t> ids;
+	dense.reserve(m_dense.size());
+	ids.reserve(m_dense.size());
+
+	// Taken components get id 0, so the second loop only picks up the rest
+	for (uint64_t id : order)
+	{
+		page* p = find_page(id);
+		if (!p)
+			continue;
+		uint32_t index = p->slots[id % page_size];
+		if (!index || !m_ids[index - 1])
+			continue;
+		dense.push_back(std::move(m_dense[index - 1]));
+		ids.push_back(id);
+		m_ids[index - 1] = 0;
+	}
+	for (size_t i = 0; i < m_dense.size(); i++)
+		if (m_ids[i])
+		{
+			dense.push_back(std::move(m_dense[i]));
+			ids.push_back(m_ids[i]);
+		}
+
+	m_dense.swap(dense);
+	m_ids.swap(ids);
+	for (size_t i = 0; i < m_ids.size(); i++)
+		slot(m_ids[i]) = static_cast<uint32_t>(i + 1);
+	m_has_holes = false;
+	m_sorted = std::is_sorted(m_ids.begin(), m_ids.end());
+}
+
+template<class T>
+inline void sparse_pool<T>::sort_by_id()
+{
+	if (m_sorted)
+		return;
+
+	std::vector<uint64_t> order;
+	order.reserve(m_ids.size());
+	for (uint64_t id : m_ids)
+		if (id)
+			order.push_back(id);
+	std::sort(order.begin(), order.end());
+	sort(order);
+}
+
+template<class T>
+inline void sparse_pool<T>::memory_usage(memory_stats& stats) const
+{
+	size_t pages = 0;
+	for (auto& p : m_pages)
+		pages += p.slots ? page_size * sizeof(uint32_t) : 0;
+	pages += m_spare ? page_size * sizeof(uint32_t) : 0;
+	stats.index_bytes += pages + m_pages.capacity() * sizeof(m_pages[0]) + m_ids.capacity() * sizeof(uint64_t);
+
+	memory_stats::component_type type;
+	type.type = &typeid(T);
+	type.count = m_dense.size();
+	type.bytes = m_dense.capacity() * sizeof(T);
+	stats.components.push_back(std::move(type));
+}
+
+template<class T>
+inline typename sparse_pool<T>::page* sparse_pool<T>::find_page(uint64_t id)
+{
+	const size_t i = id / page_size;
+	if (i < m_first_page || i - m_first_page >= m_pages.size())
+		return nullptr;
+	page& p = m_pages[i - m_first_page];
+	return p.slots ? &p : nullptr;
+}
+
+template<class T>
+inline typename sparse_pool<T>::page& sparse_pool<T>::page_of(uint64_t id)
+{
+	const size_t i = id / page_size;
+	if (m_pages.empty())
+		m_first_page = i;
+	if (i < m_first_page)
+	{
+		std::vector<page> pages(m_first_page - i + m_pages.size());
+		std::move(m_pages.begin(), m_pages.end(), pages.begin() + (m_first_page - i));
+		m_pages.swap(pages);
+		m_first_page = i;
+	}
+	if (i - m_first_page >= m_pages.size())
+		m_pages.resize(i - m_first_page + 1);
+
+	page& p = m_pages[i - m_first_page];
+	if (!p.slots)
+		p.slots = m_spare ? std::move(m_spare) : std::make_unique<uint32_t[]>(page_size);
+	return p;
+}
+
+// Trims empty pages off both ends of the window
+template<class T>
+inline void sparse_pool<T>::release_page(uint64_t id)
+{
+	const size_t i = id / page_size - m_first_page;
+	m_spare = std::move(m_pages[i].slots);
+	if (i == 0)
+	{
+		size_t empty = 0;
+		while (empty < m_pages.size() && !m_pages[empty].slots)
+			empty++;
+		m_pages.erase(m_pages.begin(), m_pages.begin() + empty);
+		m_first_page += empty;
+	}
+	while (!m_pages.empty() && !m_pages.back().slots)
+		m_pages.pop_back();
+}
+
+// Keeps the order of the remaining components
+template<class T>
+inline void sparse_pool<T>::compact()
+{
+	size_t count = 0;
+	for (size_t i = 0; i < m_dense.size(); i++)
+	{
+		if (!m_ids[i])
+			continue;
+		if (count != i)
+		{
+			m_dense[count] = std::move(m_dense[i]);
+			m_ids[count] = m_ids[i];
+		}
+		slot(m_ids[count]) = static_cast<uint32_t>(count + 1);
+		count++;
+	}
+	m_dense.erase(m_dense.begin() + count, m_dense.end());
+	m_ids.resize(count);
+	m_has_holes = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Entity
+////////////////////////////////////////////////////////////////////////////////
+
+template<class C, typename... Args >
+inline C& blib::entity::create_component(Args&&... args)
+{
+	if constexpr (component_storage<C>::value == storage::sparse_set)
+	{
+		assert(m_container != nullptr && valid());
+		C& c = m_container->template pool<C>().add(m_id.id, std::forward<Args>(args)...);
+		own_component(c);
+		return c;
+	}
+	else
+	{
+		detail::register_layout<C>();
+		auto c = std::make_unique<C>(std::forward<Args>(args)...);
+		return static_cast<C&>(add_component(move(c), detail::update_batch_of<C>()));
+	}
+}
+
+template<class T>
+inline T& blib::entity::get_component()
+{
+	T* found = try_get_component<T>();
+	assert(found != nullptr);
+	return *found;
+}
+
+template<class T>
+inline T* entity::try_get_component()
+{
+	if constexpr (component_storage<T>::value == storage::sparse_set)
+	{
+		auto* pool = m_container ? m_container->template find_pool<T>() : nullptr;
+		return pool ? pool->find(m_id.id) : nullptr;
+	}
+
+	for (auto& c : m_components)
+	{
+		T* found = dynamic_cast<T*>(c.get());
+		if (found)
+			return found;
+	}
+	return nullptr;
+}
+
+template<class T>
+inline void entity::destroy_component()
+{
+	if constexpr (component_storage<T>::value == storage::sparse_set)
+	{
+		if (T* found = try_get_component<T>())
+		{
+			auto* info = component_registry::find(typeid(T));
+			if (info)
+				m_container->m_removed.push_back({ m_id.id, info->hash, m_container->m_version });
+			m_container->template find_pool<T>()->remove(m_id.id);
+			mark_changed();
+		}
+		return;
+	}
+
+	for (auto it = m_components.begin();  it != m_components.end(); ++it)
+	{
+		T* found = dynamic_cast<T*>(it->get());
+		if (found) {
+			auto* info = component_registry::find(typeid(*found));
+			if (info && m_container)
+				m_container->m_removed.push_back({ m_id.id, info->hash, m_container->m_version });
+			m_components.erase(it);
+			mark_changed();
+			break;
+		}
+	}
+}
+
+template<class F>
+inline void entity::each_component(F&& fn) const
+{
+	for (auto& c : m_components)
+		fn(*c);
+
+	if (m_container && valid())
+		for (auto& pool : m_container->m_pools)
+			if (pool)
+				if (component* c = pool->get(m_id.id))
+					fn(*c);
+}
+
+inline void blib::entity::update(float dt)
+{
+	each_component([=](component& c)
+	{
+#ifdef BLIB_PROFILE
+		profiler::scope timer(typeid(c));
+#endif
+		c.update(dt);
+	});
+}
+
+inline component& entity::add_component(std::unique_ptr<component> c, const detail::update_batch* update)
+{
+	c->m_parent = this;
+	mark_changed();
+	c->m_version = m_version;
+	component& added = *m_components.emplace_back(move(c));
+	if (update && m_container && valid())
+		m_container->join_update_group(added, update);
+	return added;
+}
+
+inline void entity::own_component(component& c)
+{
+	c.m_parent = this;
+	mark_changed();
+	c.m_version = m_version;
+}
+
+inline void entity::remove_component(component* c)
+{
+	auto itr = std::find_if(m_components.begin(), m_components.end(), [=](auto& p) { return p.get() == c; });
+	if (itr != m_components.end())
+	{
+		m_components.erase(itr);
+		return;
+	}
+
+	for (auto& pool : m_container->m_pools)
+		if (pool && pool->get(m_id.id) == c)
+			pool->remove(m_id.id);
+}
+
+inline component* entity::find_component(uint64_t hash)
+{
+	component* found = nullptr;
+	each_component([&](component& c)
+	{
+		auto* info = component_registry::find(typeid(c));
+		if (!found && info && info->hash == hash)
+			found = &c;
+	});
+	return found;
+}
+
+inline std::string_view entity::name() const
+{
+	return m_container ? m_container->m_names.get(m_name) : std::string_view();
+}
+
+inline void entity::set_name(std::string_view name)
+{
+	assert(m_container != nullptr);
+	if (!m_container)
+		return;
+
+	m_container->rename(*this, m_container->m_names.intern(name));
+	mark_changed();
+}
+
+inline void entity::set_tag(uint64_t tag)
+{
+	if (m_container)
+		m_container->retag(*this, tag);
+	m_tag = tag;
+	mark_changed();
+}
+
+inline void entity::mark_changed()
+{
+	if (m_container)
+		m_version = m_container->m_version;
+}
+
+inline component& component::operator=(const component& other)
+{
+	m_parent = other.m_parent;
+	m_version = other.m_version;
+	return *this;
+}
+
+inline component::~component()
+{
+	if (m_update_group != ~0u)
+		m_parent->m_container->leave_update_group(*this);
+}
+
+inline void component::mark_dirty()
+{
+	if (m_parent)
+	{
+		m_parent->mark_changed();
+		m_version = m_parent->m_version;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////						Entity Container
+////////////////////////////////////////////////////////////////////////////////
+
+inline entity& blib::entity_container::create()
+{
+	return create(m_table ? claim_id() : m_next_id.load(std::memory_order_relaxed) + 1);
+}
+
+// Creates all entities first and then each component type in turn, so every type
+// lands in one contiguous run of memory
+inline entity_range entity_container::instantiate(const prefab& p, size_t count)
+{
+	entity_range range;
+	range.first = m_next_id.fetch_add(count, std::memory_order_relaxed) + 1;
+	range.count = count;
+
+	m_entities.reserve(m_entities.size() + count);
+	std::vector<entity*> entities(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		entities[i] = &create(range.first + i);
+		entities[i]->m_components.reserve(p.m_components.size());
+		if (p.m_tag)
+			entities[i]->set_tag(p.m_tag);
+	}
+
+	// Reservations are only counted down by the allocator, so types it doesn't
+	// allocate must not take one
+	for (auto& c : p.m_components)
+	{
+		if (c.allocates)
+			component_allocator::reserve(c.size, count);
+		for (entity* e : entities)
+			c.copy(*e, *c.prototype);
+	}
+
+	return range;
+}
+
+// Takes an id that comes from outside of the container, from a snapshot, delta or
+// region. Null if the id is live or another thread is creating an entity under it.
+inline entity* entity_container::recreate(uint64_t id)
+{
+	release_dead(id);
+	if (m_entities.count(id) || (m_table && !m_table->reclaim(id)))
+		return nullptr;
+	return &create(id);
+}
+
+inline entity& entity_container::create(uint64_t id)
+{
+	auto& e = m_entities.emplace(id, entity({ id })).first->second;
+	e.m_container = this;
+	e.m_version = m_version;
+	raise_next_id(id);
+	if (m_table)
+		m_table->set(id, &e);
+	return e;
+}
+
+inline entity& blib::entity_container::get(entity_id id)
+{
+	entity* e = try_get(id);
+	assert(e != nullptr);
+	return *e;
+}
+
+inline void blib::entity_container::update(float dt)
+{
+	BLIB_PROFILE_SCOPE("entity_container::update");
+
+	if (m_table)
+		flush_created();
+	if (m_deterministic)
+		sort_for_update();
+	m_events.dispatch(pre_update_phase);
+
+	// Indexed, the deque keeps groups in place when new types show up during the loop
+	for (size_t i = 0; i < m_update_groups.size(); i++)
+	{
+		auto& group = m_update_groups[i];
+#ifdef BLIB_PROFILE
+		profiler::scope timer(*group.batch->type);
+		timer.set_calls(group.batch->run(group.components, dt));
+#else
+		group.batch->run(group.components, dt);
+#endif
+	}
+
+	if (m_deterministic)
+	{
+		for (size_t i = 0; i < m_pool_order.size(); i++)
+			m_pool_order[i]->update(dt);
+	}
+	else
+	{
+		for (size_t i = 0; i < m_pools.size(); i++)
+			if (m_pools[i])
+				m_pools[i]->update(dt);
+	}
+
+	// Before the groups close their holes and destroyed entities go, handlers may
+	// still remove either
+	m_events.dispatch(post_update_phase);
+
+	for (auto& group : m_update_groups)
+	{
+		if (!group.has_holes)
+			continue;
+
+		auto& components = group.components;
+		size_t count = 0;
+		for (component* c : components)
+			if (c)
+			{
+				c->m_update_index = static_cast<uint32_t>(count);
+				components[count++] = c;
+			}
+		components.resize(count);
+		group.has_holes = false;
+	}
+
+	clean();
+	m_version++;
+}
+
+// In concurrent mode other threads may still hold the entities destroyed since the
+// last clean, so they are released by the next one
 inline void blib::entity_container::clean()
 {
-	for (auto it = m_entities.begin(); it != m_entities.end();)
-		if (!it->second.valid())
-			it = m_entities.erase(it);
+	m_retired.clear();
+	for (uint64_t id : m_dead)
+	{
+		// Skips ids that were taken again, their old node is in m_dead_nodes
+		auto itr = m_entities.find(id);
+		if (itr == m_entities.end() || itr->second.valid())
+			continue;
+		if (m_table)
+			m_retired.push_back(m_entities.extract(itr));
+		else
+			m_entities.erase(itr);
+	}
+	m_dead.clear();
+
+	for (auto& node : m_dead_nodes)
+		if (m_table)
+			m_retired.push_back(std::move(node));
+	m_dead_nodes.clear();
+}
+
+// A destroyed entity holds on to its id until the next clean. An id that comes back
+// before then, from a delta or a merged region, takes the id over and the old node
+// waits for clean outside of the map.
+inline void entity_container::release_dead(uint64_t id)
+{
+	auto itr = m_entities.find(id);
+	if (itr != m_entities.end() && !itr->second.valid())
+		m_dead_nodes.push_back(m_entities.extract(itr));
+}
+
+
+inline void entity_container::join_update_group(component& c, const detail::update_batch* batch)
+{
+	auto itr = m_update_group_lookup.find(batch);
+	if (itr == m_update_group_lookup.end())
+	{
+		itr = m_update_group_lookup.emplace(batch, static_cast<uint32_t>(m_update_groups.size())).first;
+		m_update_groups.push_back({ batch, {}, false, true, type_order(*batch->type) });
+		m_update_groups_sorted = false;
+	}
+
+	auto& group = m_update_groups[itr->second];
+	if (!group.components.empty() && (!group.components.back() || group.components.back()->m_parent->m_id.id > c.m_parent->m_id.id))
+		group.sorted = false;
+	c.m_update_group = itr->second;
+	c.m_update_index = static_cast<uint32_t>(group.components.size());
+	group.components.push_back(&c);
+}
+
+inline void entity_container::leave_update_group(component& c)
+{
+	auto& group = m_update_groups[c.m_update_group];
+	group.components[c.m_update_index] = nullptr;
+	group.has_holes = true;
+	c.m_update_group = ~0u;
+}
+
+// The order types first showed up in and the order components were created in depend
+// on the history of the container, which a snapshot doesn't keep. Deterministic
+// updates run groups and pools by type hash and their components by entity id, so
+// a world loaded from a snapshot updates in the same order as the one that wrote it.
+inline void entity_container::sort_for_update()
+{
+	if (!m_update_groups_sorted)
+	{
+		std::vector<uint32_t> order(m_update_groups.size());
+		for (uint32_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return m_update_groups[a].order < m_update_groups[b].order; });
+
+		std::deque<update_group> groups;
+		m_update_group_lookup.clear();
+		for (uint32_t i = 0; i < order.size(); i++)
+		{
+			groups.push_back(std::move(m_update_groups[order[i]]));
+			m_update_group_lookup.emplace(groups.back().batch, i);
+			for (component* c : groups.back().components)
+				if (c)
+					c->m_update_group = i;
+		}
+		m_update_groups.swap(groups);
+		m_update_groups_sorted = true;
+	}
+
+	for (auto& group : m_update_groups)
+	{
+		if (group.sorted)
+			continue;
+
+		auto& components = group.components;
+		components.erase(std::remove(components.begin(), components.end(), nullptr), components.end());
+		std::stable_sort(components.begin(), components.end(), [](const component* a, const component* b) { return a->m_parent->m_id.id < b->m_parent->m_id.id; });
+		for (size_t i = 0; i < components.size(); i++)
+			components[i]->m_update_index = static_cast<uint32_t>(i);
+		group.has_holes = false;
+		group.sorted = true;
+	}
+
+	// Pools are only dropped by clear, so a new one changes the count
+	size_t pools = 0;
+	for (auto& pool : m_pools)
+		if (pool)
+		{
+			pool->sort_by_id();
+			pools++;
+		}
+	if (pools != m_pool_order.size())
+	{
+		m_pool_order.clear();
+		for (auto& pool : m_pools)
+			if (pool)
+				m_pool_order.push_back(pool.get());
+		std::sort(m_pool_order.begin(), m_pool_order.end(), [](detail::pool_base* a, detail::pool_base* b)
+		{
+			return type_order(a->type()) < type_order(b->type());
+		});
+	}
+}
+
+// The registered hash, stable across builds, or else a hash of the type name, which
+// is stable within one build
+inline uint64_t entity_container::type_order(const std::type_info& type)
+{
+	if (auto* info = component_registry::find(type))
+		return info->hash;
+	const char* name = type.name();
+	return io::hash64(name, strlen(name));
+}
+
+// The whole pass at once works on entity pointers, without any lookups
+inline void entity_container::compact(const compaction_key& key)
+{
+	m_compacting = false;
+	m_compact_order.clear();
+	std::vector<entity*> order = compaction_order(key);
+	relocate(order);
+	reorder(order);
+}
+
+// Between steps entities may be destroyed, so the pass keeps ids and looks them up
+inline bool entity_container::compact_step(size_t budget, const compaction_key& key)
+{
+	if (!m_compacting)
+	{
+		m_compact_order.clear();
+		for (entity* e : compaction_order(key))
+			m_compact_order.push_back(e->m_id.id);
+		m_compact_next = 0;
+		m_compacting = true;
+	}
+
+	std::vector<entity*> step;
+	for (size_t moved = 0; m_compact_next < m_compact_order.size() && (moved < budget || step.empty()); m_compact_next++)
+	{
+		entity* e = lookup(m_compact_order[m_compact_next]);
+		if (!e || !e->valid())
+			continue;
+		step.push_back(e);
+		moved += e->m_components.size();
+	}
+	relocate(step);
+	if (m_compact_next < m_compact_order.size())
+		return false;
+
+	std::vector<entity*> order;
+	order.reserve(m_compact_order.size());
+	for (uint64_t id : m_compact_order)
+	{
+		entity* e = lookup(id);
+		if (e && e->valid())
+			order.push_back(e);
+	}
+	reorder(order);
+	m_compact_order.clear();
+	m_compacting = false;
+	return true;
+}
+
+// Valid entities by key and then id
+inline std::vector<entity*> entity_container::compaction_order(const compaction_key& key)
+{
+	struct keyed_entity { uint64_t key, id; entity* e; };
+	std::vector<keyed_entity> keyed;
+	keyed.reserve(m_entities.size());
+	for (auto& e : m_entities)
+		if (e.second.valid())
+			keyed.push_back({ key ? key(e.second) : 0, e.first, &e.second });
+	std::sort(keyed.begin(), keyed.end(), [](auto& a, auto& b) { return a.key != b.key ? a.key < b.key : a.id < b.id; });
+
+	std::vector<entity*> order(keyed.size());
+	for (size_t i = 0; i < keyed.size(); i++)
+		order[i] = keyed[i].e;
+	return order;
+}
+
+// Moves the components of the entities in order into fresh memory, one contiguous
+// range per size class
+inline void entity_container::relocate(const std::vector<entity*>& entities)
+{
+	detail::layout_lookup layouts;
+	struct size_count { size_t size_class, size, count; };
+	std::vector<size_count> counts;
+	std::vector<std::pair<std::unique_ptr<component>*, const detail::component_layout*>> moves;
+	for (entity* e : entities)
+		for (auto& c : e->m_components)
+			if (auto* r = layouts.find(*c); r && r->move)
+			{
+				const size_t size_class = component_allocator::size_class_of(r->size);
+				auto itr = std::find_if(counts.begin(), counts.end(), [=](auto& sc) { return sc.size_class == size_class; });
+				if (itr == counts.end())
+					itr = counts.insert(counts.end(), { size_class, r->size, 0 });
+				itr->count++;
+				moves.push_back({ &c, r });
+			}
+	for (auto& sc : counts)
+		component_allocator::reserve(sc.size, sc.count);
+
+	// The moved component takes over the slot in its update group, the old one is
+	// taken out first so its destructor leaves the group alone
+	for (auto& m : moves)
+	{
+		std::unique_ptr<component>& c = *m.first;
+		component* to = m.second->move(*c);
+		to->m_update_group = c->m_update_group;
+		to->m_update_index = c->m_update_index;
+		if (to->m_update_group != ~0u)
+			m_update_groups[to->m_update_group].components[to->m_update_index] = to;
+		c->m_update_group = ~0u;
+		c.reset(to);
+	}
+}
+
+// Update groups and pools follow the order, components of entities that are not in
+// it keep their order behind them
+inline void entity_container::reorder(const std::vector<entity*>& order)
+{
+	std::vector<std::vector<component*>> ordered(m_update_groups.size());
+	std::vector<uint64_t> ids(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		ids[i] = order[i]->m_id.id;
+		for (auto& c : order[i]->m_components)
+			if (c->m_update_group != ~0u)
+			{
+				ordered[c->m_update_group].push_back(c.get());
+				m_update_groups[c->m_update_group].components[c->m_update_index] = nullptr;
+			}
+	}
+	for (size_t i = 0; i < m_update_groups.size(); i++)
+	{
+		auto& group = m_update_groups[i];
+		for (component* c : group.components)
+			if (c)
+				ordered[i].push_back(c);
+		group.components.swap(ordered[i]);
+		for (size_t j = 0; j < group.components.size(); j++)
+			group.components[j]->m_update_index = static_cast<uint32_t>(j);
+		group.has_holes = false;
+		group.sorted = false;
+	}
+
+	for (auto& pool : m_pools)
+		if (pool)
+			pool->sort(ids);
+
+	// Churn leaves the entity map with far more buckets than it needs
+	m_entities.rehash(0);
+}
+
+inline bool entity_container::merge(entity_container& region)
+{
+	std::vector<uint64_t> ids;
+	ids.reserve(region.m_entities.size());
+	for (auto& e : region.m_entities)
+	{
+		if (!e.second.valid())
+			continue;
+		release_dead(e.first);
+		if (m_entities.count(e.first) || (m_table && !m_table->reclaim(e.first)))
+		{
+			// The claims are undone as dead ids, which only keeps them from being handed out
+			if (m_table)
+				for (uint64_t id : ids)
+					m_table->retire(id);
+			return false;
+		}
+		ids.push_back(e.first);
+	}
+
+	// Joining update groups in id order keeps the update order independent of hashing
+	std::sort(ids.begin(), ids.end());
+	m_entities.reserve(m_entities.size() + ids.size());
+	for (uint64_t id : ids)
+		adopt(region, id);
+	return true;
+}
+
+inline void entity_container::detach(const std::vector<entity_id>& ids, entity_container& region)
+{
+	for (entity_id id : ids)
+	{
+		auto itr = m_entities.find(id.id);
+		if (itr == m_entities.end() || !itr->second.valid())
+			continue;
+		region.release_dead(id.id);
+		if (region.m_entities.count(id.id) || (region.m_table && !region.m_table->reclaim(id.id)))
+			continue;
+
+		m_destroyed.push_back({ id.id, m_version });
+		region.adopt(*this, id.id);
+	}
+}
+
+// Relinks the map node, so the entity and its components stay where they are
+inline void entity_container::adopt(entity_container& from, uint64_t id)
+{
+	auto node = from.m_entities.extract(id);
+	entity& e = node.mapped();
+	if (from.m_table)
+		from.m_table->retire(id);
+
+	// Names and tags are indexed per container
+	const std::string_view name = from.m_names.get(e.m_name);
+	const uint64_t tag = e.m_tag;
+	from.rename(e, 0);
+	from.retag(e, 0);
+	e.m_tag = 0;
+	retag(e, tag);
+	e.m_tag = tag;
+	rename(e, m_names.intern(name));
+
+	for (auto& c : e.m_components)
+	{
+		if (c->m_update_group == ~0u)
+			continue;
+		auto* batch = from.m_update_groups[c->m_update_group].batch;
+		from.leave_update_group(*c);
+		join_update_group(*c, batch);
+	}
+
+	for (size_t i = 0; i < from.m_pools.size(); i++)
+	{
+		if (!from.m_pools[i] || !from.m_pools[i]->get(id))
+			continue;
+		if (i >= m_pools.size())
+			m_pools.resize(i + 1);
+		if (!m_pools[i])
+			m_pools[i] = from.m_pools[i]->create();
+		from.m_pools[i]->transfer(id, *m_pools[i]);
+	}
+
+	e.m_container = this;
+	e.mark_changed();
+	e.each_component([&](component& c) { c.m_version = e.m_version; });
+	raise_next_id(id);
+	m_entities.insert(std::move(node));
+	if (m_table)
+		m_table->set(id, &e);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Concurrent Mode
+////////////////////////////////////////////////////////////////////////////////
+
+inline entity_container::~entity_container()
+{
+	release_staged();
+}
+
+inline void entity_container::set_concurrent(bool enable)
+{
+	assert(!(enable && m_deterministic) && "Concurrent ids depend on thread timing");
+	if (enable == concurrent())
+		return;
+
+	if (!enable)
+	{
+		flush_created();
+		m_retired.clear();
+		m_table.reset();
+		return;
+	}
+
+	// Id blocks taken before may hold ids that entered the container since
+	m_serial = next_serial();
+	m_table = std::make_unique<detail::id_table>();
+	for (auto& e : m_entities)
+		if (e.second.valid())
+			m_table->set(e.first, &e.second);
 		else
-			++it;
+			m_table->retire(e.first);
+}
+
+// The entity is built in a node of a scratch map on this thread, which later moves
+// into m_entities without moving the entity
+template<class F>
+inline entity_id entity_container::create_concurrent(F&& init)
+{
+	assert(m_table && "create_concurrent needs concurrent mode");
+	const uint64_t id = claim_id();
+
+	thread_local std::unordered_map<uint64_t, entity> scratch;
+	scratch.emplace(id, entity({ id }));
+	auto* staged = new staged_entity{ scratch.extract(id), nullptr };
+	entity& e = staged->node.mapped();
+	init(e);
+	m_table->set(id, &e);
+
+	staged->next = m_staged.load(std::memory_order_relaxed);
+	while (!m_staged.compare_exchange_weak(staged->next, staged, std::memory_order_release, std::memory_order_relaxed)) { }
+	return { id };
+}
+
+inline void entity_container::flush_created()
+{
+	std::vector<staged_entity*> staged;
+	for (staged_entity* s = m_staged.exchange(nullptr, std::memory_order_acquire); s; s = s->next)
+		staged.push_back(s);
+	if (staged.empty())
+		return;
+
+	// By id, so the update order does not depend on which thread came first
+	std::sort(staged.begin(), staged.end(), [](auto* a, auto* b) { return a->node.key() < b->node.key(); });
+	detail::layout_lookup layouts;
+	for (staged_entity* s : staged)
+	{
+		const uint64_t id = s->node.key();
+		auto result = m_entities.insert(std::move(s->node));
+		delete s;
+
+		// Claimed ids can't be in the map. Should one be, the staged entity stays
+		// alive until the next clean as other threads may have found it.
+		assert(result.inserted && "A concurrently created id was already taken");
+		if (!result.inserted)
+		{
+			m_table->set(id, result.position->second.valid() ? &result.position->second : nullptr);
+			m_retired.push_back(std::move(result.node));
+			continue;
+		}
+
+		entity& e = result.position->second;
+		const uint64_t tag = e.m_tag;
+		e.m_container = this;
+		e.m_version = m_version;
+		e.m_tag = 0;
+		retag(e, tag);
+		e.m_tag = tag;
+		for (auto& c : e.m_components)
+		{
+			c->m_version = m_version;
+			auto* layout = layouts.find(*c);
+			if (layout && layout->update)
+				join_update_group(*c, layout->update);
+		}
+	}
+}
+
+// Ids come in blocks per thread, so most creations don't touch the shared counter
+inline uint64_t entity_container::reserve_id()
+{
+	struct id_block { uint64_t owner = 0, next = 0, end = 0; };
+	thread_local id_block block;
+	if (block.owner != m_serial || block.next == block.end)
+	{
+		block.next = m_next_id.fetch_add(id_block_size, std::memory_order_relaxed) + 1;
+		block.end = block.next + id_block_size;
+		block.owner = m_serial;
+	}
+	return block.next++;
+}
+
+// Merged regions and deltas bring in ids from outside, which may fall into a block
+// a thread took before, so ids are only used once claimed in the table
+inline uint64_t entity_container::claim_id()
+{
+	uint64_t id = reserve_id();
+	while (!m_table->claim(id))
+		id = reserve_id();
+	return id;
+}
+
+inline void entity_container::raise_next_id(uint64_t id)
+{
+	uint64_t next = m_next_id.load(std::memory_order_relaxed);
+	while (next < id && !m_next_id.compare_exchange_weak(next, id, std::memory_order_relaxed)) { }
+}
+
+inline void entity_container::release_staged()
+{
+	staged_entity* s = m_staged.exchange(nullptr, std::memory_order_acquire);
+	while (s)
+	{
+		staged_entity* next = s->next;
+		delete s;
+		s = next;
+	}
+}
+
+inline uint64_t entity_container::next_serial()
+{
+	static std::atomic<uint64_t> next = 1;
+	return next++;
+}
+
+template<class T, class F>
+inline void entity_container::each(F&& fn)
+{
+	if constexpr (component_storage<T>::value == storage::sparse_set)
+	{
+		auto* pool = find_pool<T>();
+		if (!pool)
+			return;
+
+		T* components = pool->data();
+		const uint64_t* ids = pool->ids();
+		for (size_t i = 0; i < pool->size(); i++)
+			if (ids[i])
+				fn(*components[i].m_parent, components[i]);
+	}
+	else
+	{
+		each_entity([&](entity& e)
+		{
+			if (T* c = e.template try_get_component<T>())
+				fn(e, *c);
+		});
+	}
+}
+
+template<class T>
+inline sparse_pool<T>& entity_container::pool()
+{
+	static_assert(component_storage<T>::value == storage::sparse_set, "Only components in sparse_set storage have a pool");
+	static_assert(std::is_base_of_v<component, T>, "Components must derive from blib::component");
+
+	const size_t index = pool_index<T>();
+	if (index >= m_pools.size())
+		m_pools.resize(index + 1);
+	if (!m_pools[index])
+		m_pools[index] = std::make_unique<sparse_pool<T>>();
+	return static_cast<sparse_pool<T>&>(*m_pools[index]);
+}
+
+template<class T>
+inline sparse_pool<T>* entity_container::find_pool()
+{
+	const size_t index = pool_index<T>();
+	return index < m_pools.size() ? static_cast<sparse_pool<T>*>(m_pools[index].get()) : nullptr;
 }
 
+template<class T>
+inline size_t entity_container::pool_index()
+{
+	static const size_t index = next_pool_index();
+	return index;
+}
+
+inline size_t entity_container::next_pool_index()
+{
+	static std::atomic<size_t> next = 0;
+	return next++;
+}
 
 inline entity* blib::entity_container::try_get(entity_id id)
 {
-	auto itr = m_entities.find(id.id);
+	if (m_table)
+		return m_table->find(id.id);
+	return lookup(id.id);
+}
+
+// Only entities that joined the container, also in concurrent mode
+inline entity* entity_container::lookup(uint64_t id)
+{
+	auto itr = m_entities.find(id);
 	if(itr != m_entities.end())
 		return &itr->second;
 	return nullptr;
@@ -190,8 +2490,684 @@ inline entity* blib::entity_container::try_get(entity_id id)
 inline void entity_container::destroy(entity_id id)
 {
 	auto itr = m_entities.find(id.id);
-	if (itr != m_entities.end())
+	if (itr != m_entities.end() && itr->second.valid())
+	{
+		for (auto& c : itr->second.m_components)
+			if (c->m_update_group != ~0u)
+				leave_update_group(*c);
+		for (auto& pool : m_pools)
+			if (pool)
+				pool->remove(id.id);
+		rename(itr->second, 0);
+		retag(itr->second, 0);
 		itr->second.m_id = {};
+		m_destroyed.push_back({ id.id, m_version });
+		m_dead.push_back(id.id);
+		if (m_table)
+			m_table->retire(id.id);
+	}
+}
+
+// Unnamed entities are not found by the empty name
+inline entity* entity_container::find(std::string_view name)
+{
+	string_table::id i = m_names.find(name);
+	if (i == string_table::invalid || i == 0)
+		return nullptr;
+
+	if (!m_name_index_enabled)
+		return try_get({ lowest_named(i) });
+
+	if (i >= m_name_index.size() || m_name_index[i].empty())
+		return nullptr;
+	return try_get({ *m_name_index[i].begin() });
+}
+
+inline uint64_t entity_container::lowest_named(string_table::id name) const
+{
+	uint64_t lowest = 0;
+	for (auto& e : m_entities)
+		if (e.second.valid() && e.second.m_name == name && (lowest == 0 || e.first < lowest))
+			lowest = e.first;
+	return lowest;
+}
+
+inline void entity_container::enable_name_index(bool enable)
+{
+	m_name_index_enabled = enable;
+	m_name_index.clear();
+	if (!enable)
+		return;
+
+	m_name_index.resize(m_names.size());
+	for (auto& e : m_entities)
+	{
+		const string_table::id name = e.second.m_name;
+		if (e.second.valid() && name != 0)
+			m_name_index[name].insert(e.first);
+	}
+}
+
+inline void entity_container::retag(entity& e, uint64_t tag)
+{
+	for (uint64_t changed = e.m_tag ^ tag; changed; changed &= changed - 1)
+		m_tag_bits[detail::lowest_bit(changed)].set(e.m_id.id, (tag & (changed & ~(changed - 1))) != 0);
+}
+
+template<class F>
+inline void entity_container::each_with_tags(uint64_t mask, uint64_t exclude, F&& fn)
+{
+	if (mask == 0)
+	{
+		each_entity([&](entity& e)
+		{
+			if ((e.m_tag & exclude) == 0)
+				fn(e);
+		});
+		return;
+	}
+
+	// Only blocks present in every required bitset can match, so the bitset with the
+	// fewest blocks picks the candidates
+	using bitset = detail::id_bitset;
+	uint32_t required[64], excluded[64];
+	uint32_t required_count = 0, excluded_count = 0;
+	uint32_t rarest = detail::lowest_bit(mask);
+	for (uint64_t m = mask; m; m &= m - 1)
+	{
+		required[required_count] = detail::lowest_bit(m);
+		if (m_tag_bits[required[required_count]].blocks() < m_tag_bits[rarest].blocks())
+			rarest = required[required_count];
+		required_count++;
+	}
+	for (uint64_t m = exclude & ~mask; m; m &= m - 1)
+		excluded[excluded_count++] = detail::lowest_bit(m);
+
+	std::vector<uint64_t> keys;
+	m_tag_bits[rarest].keys(keys);
+	std::sort(keys.begin(), keys.end());
+	for (uint64_t key : keys)
+	{
+		// The matches of a block are taken before fn runs, fn may free the block
+		uint64_t match[bitset::block_words];
+		bool found = true;
+		for (uint32_t i = 0; i < required_count && found; i++)
+		{
+			const bitset::block* b = m_tag_bits[required[i]].find(key);
+			found = b != nullptr;
+			for (uint32_t w = 0; found && w < bitset::block_words; w++)
+				match[w] = i == 0 ? b->words[w] : match[w] & b->words[w];
+		}
+		if (!found)
+			continue;
+		for (uint32_t i = 0; i < excluded_count; i++)
+			if (const bitset::block* b = m_tag_bits[excluded[i]].find(key))
+				for (uint32_t w = 0; w < bitset::block_words; w++)
+					match[w] &= ~b->words[w];
+
+		for (uint32_t w = 0; w < bitset::block_words; w++)
+			for (uint64_t m = match[w]; m; m &= m - 1)
+				if (entity* e = try_get({ key * bitset::block_bits + w * 64 + detail::lowest_bit(m) }))
+					fn(*e);
+	}
+}
+
+inline void entity_container::rename(entity& e, string_table::id name)
+{
+	if (m_name_index_enabled)
+	{
+		if (e.m_name != 0)
+			m_name_index[e.m_name].erase(e.m_id.id);
+		if (name != 0)
+		{
+			if (name >= m_name_index.size())
+				m_name_index.resize(m_names.size());
+			m_name_index[name].insert(e.m_id.id);
+		}
+	}
+	e.m_name = name;
+}
+
+inline void entity_container::clear()
+{
+	m_pools.clear();
+	m_entities.clear();
+	m_update_groups.clear();
+	m_update_group_lookup.clear();
+	m_pool_order.clear();
+	m_names.clear();
+	m_name_index.clear();
+	for (auto& bits : m_tag_bits)
+		bits.clear();
+	m_destroyed.clear();
+	m_dead.clear();
+	m_dead_nodes.clear();
+	m_removed.clear();
+	m_compact_order.clear();
+	m_compacting = false;
+	m_retired.clear();
+	release_staged();
+	if (m_table)
+		m_table->clear();
+	m_events.clear();
+	m_serial = next_serial();
+	m_next_id = 0;
+}
+
+inline std::vector<const entity*> entity_container::sorted_entities() const
+{
+	// Sort by id so the same world always produces the same bytes
+	std::vector<const entity*> entities;
+	entities.reserve(m_entities.size());
+	for (auto& e : m_entities)
+		if (e.second.valid())
+			entities.push_back(&e.second);
+	std::sort(entities.begin(), entities.end(), [](const entity* a, const entity* b) { return a->m_id.id < b->m_id.id; });
+	return entities;
+}
+
+// Visits all valid entities, in id order in deterministic mode
+template<class F>
+inline void entity_container::each_entity(F&& fn)
+{
+	if (!m_deterministic)
+	{
+		for (auto& e : m_entities)
+			if (e.second.valid())
+				fn(e.second);
+		return;
+	}
+
+	std::vector<entity*> entities;
+	entities.reserve(m_entities.size());
+	for (auto& e : m_entities)
+		if (e.second.valid())
+			entities.push_back(&e.second);
+	std::sort(entities.begin(), entities.end(), [](const entity* a, const entity* b) { return a->m_id.id < b->m_id.id; });
+	for (entity* e : entities)
+		fn(*e);
+}
+
+inline uint64_t entity_container::state_hash() const
+{
+	io::binary_writer writer;
+	write_snapshot(writer);
+	return io::hash64(writer.data().data(), writer.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Snapshots
+////////////////////////////////////////////////////////////////////////////////
+
+// Layout: header, entity table (id, tag, name), then one section per component type.
+// A section holds the type hash, the component count and its byte size, followed by
+// (entity index, payload size, payload) records. Sections of unknown types are skipped.
+inline void entity_container::write_snapshot(io::binary_writer& writer) const
+{
+	auto entities = sorted_entities();
+
+	writer.write(snapshot_magic);
+	writer.write(snapshot_version);
+	writer.write(m_next_id.load(std::memory_order_relaxed));
+	writer.write(static_cast<uint64_t>(entities.size()));
+	for (auto* e : entities)
+	{
+		writer.write(e->m_id.id);
+		writer.write(e->m_tag);
+		writer.write_string(e->name());
+	}
+
+	struct column
+	{
+		uint64_t hash;
+		std::vector<std::pair<uint32_t, const component*>> components;
+	};
+	std::vector<column> columns;
+	std::unordered_map<uint64_t, size_t> column_index;
+	for (uint32_t i = 0; i < entities.size(); i++)
+	{
+		entities[i]->each_component([&](const component& c)
+		{
+			auto* info = component_registry::find(typeid(c));
+			if (!info)
+				return;
+
+			auto itr = column_index.find(info->hash);
+			if (itr == column_index.end())
+			{
+				itr = column_index.emplace(info->hash, columns.size()).first;
+				columns.push_back({ info->hash, {} });
+			}
+			columns[itr->second].components.emplace_back(i, &c);
+		});
+	}
+
+	writer.write(static_cast<uint32_t>(columns.size()));
+	for (auto& col : columns)
+	{
+		writer.write(col.hash);
+		writer.write(static_cast<uint64_t>(col.components.size()));
+		size_t section_offset = writer.size();
+		writer.write(uint64_t(0));
+
+		for (auto& [index, c] : col.components)
+		{
+			writer.write(index);
+			size_t payload_offset = writer.size();
+			writer.write(uint32_t(0));
+			c->serialize(writer);
+			writer.patch(payload_offset, static_cast<uint32_t>(writer.size() - payload_offset - sizeof(uint32_t)));
+		}
+		writer.patch(section_offset, static_cast<uint64_t>(writer.size() - section_offset - sizeof(uint64_t)));
+	}
+}
+
+// Reads into a scratch container, which only replaces the contents of this one once the
+// whole snapshot read fine. The scratch entities move over without copying, see merge.
+inline bool entity_container::read_snapshot(io::binary_reader& reader)
+{
+	entity_container loaded;
+	uint64_t next_id = 0;
+	if (!loaded.parse_snapshot(reader, next_id))
+		return false;
+
+	clear();
+	if (!merge(loaded))
+		return false;
+	// Never below an id that was loaded, whatever the file says
+	raise_next_id(next_id);
+	return true;
+}
+
+inline bool entity_container::parse_snapshot(io::binary_reader& reader, uint64_t& next_id)
+{
+	assert(m_entities.empty());
+	uint32_t magic = 0, version = 0;
+	if (!reader.read(magic) || magic != snapshot_magic || !reader.read(version) || version != snapshot_version)
+		return false;
+
+	uint64_t entity_count = 0;
+	reader.read(next_id);
+	reader.read(entity_count);
+	if (!reader.good() || entity_count > reader.remaining())
+		return false;
+
+	std::string name;
+	std::vector<entity*> entities;
+	entities.reserve(entity_count);
+	m_entities.reserve(entity_count);
+	for (uint64_t i = 0; i < entity_count && reader.good(); i++)
+	{
+		// Ids are unique and never 0, the container relies on both
+		uint64_t id = 0;
+		reader.read(id);
+		entity* created = id ? recreate(id) : nullptr;
+		if (!created)
+			return false;
+		auto& e = *created;
+		uint64_t tag = 0;
+		reader.read(tag);
+		reader.read_string(name);
+		e.set_tag(tag);
+		e.set_name(name);
+		entities.push_back(&e);
+	}
+
+	uint32_t column_count = 0;
+	reader.read(column_count);
+	for (uint32_t i = 0; i < column_count && reader.good(); i++)
+	{
+		uint64_t hash = 0, count = 0, section_size = 0;
+		reader.read(hash);
+		reader.read(count);
+		reader.read(section_size);
+
+		auto* info = component_registry::find(hash);
+		if (!info)
+		{
+			reader.skip(section_size);
+			continue;
+		}
+
+		for (uint64_t j = 0; j < count && reader.good(); j++)
+		{
+			uint32_t index = 0, payload_size = 0;
+			reader.read(index);
+			reader.read(payload_size);
+			if (!reader.good() || index >= entities.size() || payload_size > reader.remaining())
+				return false;
+
+			// Components read straight out of the source memory, for trivially copyable
+			// fields this is a single copy from the mapped file into the component
+			io::binary_reader payload(reader.current(), payload_size);
+			info->add(*entities[index]).deserialize(payload);
+			reader.skip(payload_size);
+		}
+	}
+
+	return reader.good();
+}
+
+inline bool entity_container::save_snapshot(const std::string& filename) const
+{
+	io::binary_writer writer;
+	write_snapshot(writer);
+	return io::write_binary_file(writer.data(), filename);
+}
+
+inline bool entity_container::load_snapshot(const std::string& filename)
+{
+	io::mapped_file file(filename);
+	if (!file.is_open())
+		return false;
+
+	io::binary_reader reader(file.data(), file.size());
+	return read_snapshot(reader);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Deltas
+////////////////////////////////////////////////////////////////////////////////
+
+// Layout: header, destroyed entity ids, changed entities (id, tag, name), removed
+// components (entity id, type hash), then one section per component type with
+// (entity id, payload size, payload) records of the components changed since 'since'.
+inline uint64_t entity_container::write_delta(io::binary_writer& writer, uint64_t since)
+{
+	std::vector<const entity*> entities;
+	for (auto* e : sorted_entities())
+		if (e->m_version > since)
+			entities.push_back(e);
+
+	writer.write(delta_magic);
+	writer.write(snapshot_version);
+	writer.write(since);
+	writer.write(m_version);
+
+	size_t count_offset = writer.size();
+	uint64_t count = 0;
+	writer.write(count);
+	for (auto& d : m_destroyed)
+		if (d.version > since)
+		{
+			writer.write(d.id);
+			count++;
+		}
+	writer.patch(count_offset, count);
+
+	writer.write(static_cast<uint64_t>(entities.size()));
+	for (auto* e : entities)
+	{
+		writer.write(e->m_id.id);
+		writer.write(e->m_tag);
+		writer.write_string(e->name());
+	}
+
+	count_offset = writer.size();
+	count = 0;
+	writer.write(count);
+	for (auto& r : m_removed)
+		if (r.version > since)
+		{
+			writer.write(r.id);
+			writer.write(r.hash);
+			count++;
+		}
+	writer.patch(count_offset, count);
+
+	struct column
+	{
+		uint64_t hash;
+		std::vector<std::pair<uint64_t, const component*>> components;
+	};
+	std::vector<column> columns;
+	std::unordered_map<uint64_t, size_t> column_index;
+	for (auto* e : entities)
+	{
+		e->each_component([&](const component& c)
+		{
+			if (c.m_version <= since)
+				return;
+
+			auto* info = component_registry::find(typeid(c));
+			if (!info)
+				return;
+
+			auto itr = column_index.find(info->hash);
+			if (itr == column_index.end())
+			{
+				itr = column_index.emplace(info->hash, columns.size()).first;
+				columns.push_back({ info->hash, {} });
+			}
+			columns[itr->second].components.emplace_back(e->m_id.id, &c);
+		});
+	}
+
+	writer.write(static_cast<uint32_t>(columns.size()));
+	for (auto& col : columns)
+	{
+		writer.write(col.hash);
+		writer.write(static_cast<uint64_t>(col.components.size()));
+		size_t section_offset = writer.size();
+		writer.write(uint64_t(0));
+
+		for (auto& [id, c] : col.components)
+		{
+			writer.write(id);
+			size_t payload_offset = writer.size();
+			writer.write(uint32_t(0));
+			c->serialize(writer);
+			writer.patch(payload_offset, static_cast<uint32_t>(writer.size() - payload_offset - sizeof(uint32_t)));
+		}
+		writer.patch(section_offset, static_cast<uint64_t>(writer.size() - section_offset - sizeof(uint64_t)));
+	}
+
+	return m_version++;
+}
+
+inline bool entity_container::apply_delta(io::binary_reader& reader)
+{
+	uint32_t magic = 0, version = 0;
+	if (!reader.read(magic) || magic != delta_magic || !reader.read(version) || version != snapshot_version)
+		return false;
+
+	uint64_t since = 0, until = 0, count = 0;
+	std::string name;
+	reader.read(since);
+	reader.read(until);
+
+	reader.read(count);
+	for (uint64_t i = 0; i < count && reader.good(); i++)
+	{
+		uint64_t id = 0;
+		reader.read(id);
+		destroy({ id });
+	}
+
+	reader.read(count);
+	for (uint64_t i = 0; i < count && reader.good(); i++)
+	{
+		uint64_t id = 0;
+		reader.read(id);
+		if (id == 0)
+			return false;
+		auto* e = lookup(id);
+		if ((!e || !e->valid()) && !(e = recreate(id)))
+			return false;
+		uint64_t tag = 0;
+		reader.read(tag);
+		reader.read_string(name);
+		e->set_tag(tag);
+		e->set_name(name);
+		e->mark_changed();
+	}
+
+	reader.read(count);
+	for (uint64_t i = 0; i < count && reader.good(); i++)
+	{
+		uint64_t id = 0, hash = 0;
+		reader.read(id);
+		reader.read(hash);
+		auto* e = lookup(id);
+		if (!e || !e->valid())
+			continue;
+
+		component* c = e->find_component(hash);
+		if (c)
+		{
+			e->remove_component(c);
+			m_removed.push_back({ id, hash, m_version });
+			e->mark_changed();
+		}
+	}
+
+	uint32_t column_count = 0;
+	reader.read(column_count);
+	for (uint32_t i = 0; i < column_count && reader.good(); i++)
+	{
+		uint64_t hash = 0, section_size = 0;
+		reader.read(hash);
+		reader.read(count);
+		reader.read(section_size);
+
+		auto* info = component_registry::find(hash);
+		if (!info)
+		{
+			reader.skip(section_size);
+			continue;
+		}
+
+		for (uint64_t j = 0; j < count && reader.good(); j++)
+		{
+			uint64_t id = 0;
+			uint32_t payload_size = 0;
+			reader.read(id);
+			reader.read(payload_size);
+			if (!reader.good() || payload_size > reader.remaining())
+				return false;
+
+			auto* e = lookup(id);
+			if (e && e->valid())
+			{
+				component* c = e->find_component(hash);
+				if (!c)
+					c = &info->add(*e);
+
+				io::binary_reader payload(reader.current(), payload_size);
+				c->deserialize(payload);
+				c->mark_dirty();
+			}
+			reader.skip(payload_size);
+		}
+	}
+
+	return reader.good();
+}
+
+inline void entity_container::discard_history(uint64_t version)
+{
+	m_destroyed.erase(std::remove_if(m_destroyed.begin(), m_destroyed.end(), [=](auto& d) { return d.version <= version; }), m_destroyed.end());
+	m_removed.erase(std::remove_if(m_removed.begin(), m_removed.end(), [=](auto& r) { return r.version <= version; }), m_removed.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Memory
+////////////////////////////////////////////////////////////////////////////////
+
+inline const memory_stats::component_type* memory_stats::find(const std::type_info& type) const
+{
+	for (auto& c : components)
+		if (*c.type == type)
+			return &c;
+	return nullptr;
+}
+
+inline void memory_budgets::set(const std::string& name, size_t limit, measure fn, callback on_exceeded)
+{
+	remove(name);
+	m_budgets.push_back({ name, limit, std::move(fn), std::move(on_exceeded) });
+}
+
+inline void memory_budgets::remove(const std::string& name)
+{
+	m_budgets.erase(std::remove_if(m_budgets.begin(), m_budgets.end(), [&](auto& b) { return b.name == name; }), m_budgets.end());
+}
+
+inline void memory_budgets::check(const memory_stats& stats)
+{
+	for (auto& b : m_budgets)
+	{
+		const size_t used = b.fn(stats);
+		const bool exceeded = used > b.limit;
+		if (exceeded && !b.exceeded && b.on_exceeded)
+			b.on_exceeded(b.name, used, b.limit);
+		b.exceeded = exceeded;
+	}
+}
+
+inline memory_stats entity_container::memory_usage() const
+{
+	memory_stats stats;
+
+	// Nodes hold the next pointer besides the value
+	stats.entity_count = m_entities.size();
+	stats.entity_bytes = m_entities.size() * (sizeof(void*) + sizeof(decltype(m_entities)::value_type));
+	stats.buckets = m_entities.bucket_count();
+	stats.load_factor = m_entities.load_factor();
+
+	{
+		detail::layout_lookup layouts;
+		for (auto& e : m_entities)
+		{
+			stats.entity_bytes += e.second.m_components.capacity() * sizeof(std::unique_ptr<component>);
+			for (auto& c : e.second.m_components)
+			{
+				const std::type_info& type = typeid(*c);
+				auto itr = std::find_if(stats.components.begin(), stats.components.end(), [&](auto& t) { return *t.type == type; });
+				if (itr == stats.components.end())
+				{
+					itr = stats.components.insert(stats.components.end(), memory_stats::component_type());
+					itr->type = &type;
+				}
+				auto* layout = layouts.find(*c);
+				itr->count++;
+				itr->bytes += layout ? layout->size : 0;
+			}
+		}
+	}
+
+	for (auto& pool : m_pools)
+		if (pool)
+			pool->memory_usage(stats);
+
+	for (auto& c : stats.components)
+	{
+		auto* info = component_registry::find(*c.type);
+		c.name = info ? info->name : c.type->name();
+		stats.component_bytes += c.bytes;
+	}
+
+	stats.index_bytes += m_entities.bucket_count() * sizeof(void*) + m_pools.capacity() * sizeof(m_pools[0]);
+	for (auto& group : m_update_groups)
+		stats.index_bytes += sizeof(group) + group.components.capacity() * sizeof(component*);
+	stats.index_bytes += m_update_group_lookup.bucket_count() * sizeof(void*)
+		+ m_update_group_lookup.size() * (sizeof(void*) + sizeof(decltype(m_update_group_lookup)::value_type));
+	for (auto& bits : m_tag_bits)
+		stats.index_bytes += bits.memory_usage();
+	stats.index_bytes += m_name_index.capacity() * sizeof(m_name_index[0]) + m_compact_order.capacity() * sizeof(uint64_t);
+	for (auto& holders : m_name_index)
+		stats.index_bytes += holders.size() * (sizeof(uint64_t) + 4 * sizeof(void*));
+	if (m_table)
+		stats.index_bytes += m_table->memory_usage();
+	stats.entity_bytes += (m_retired.size() + m_dead_nodes.size()) * (sizeof(void*) + sizeof(decltype(m_entities)::value_type));
+
+	stats.name_bytes = m_names.memory_usage();
+	stats.history_bytes = m_destroyed.capacity() * sizeof(destroyed_entity) + m_removed.capacity() * sizeof(removed_component)
+		+ m_dead.capacity() * sizeof(uint64_t);
+
+	stats.allocator_bytes = component_allocator::reserved_bytes();
+	stats.io = io::memory_usage();
+	return stats;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+namespace blib
+{
+
+// Typed events, queued per type and handled in batches.
+//
+// emit may be called from any thread, every thread writes into a buffer of its own.
+// sync merges those buffers into one contiguous queue per event type and must not run
+// while other threads emit. dispatch(phase) syncs and hands every handler of that phase
+// the events it has not seen yet as a single array. Events emitted by handlers are
+// delivered on the next dispatch.
+// Every entity_container has a bus of its own, see entity_container::events.
+class event_bus
+{
+public:
+	event_bus() = default;
+	event_bus(const event_bus&) = delete;
+	event_bus& operator=(const event_bus&) = delete;
+
+	template<class E>
+	void emit(const E& e);
+
+	template<class E>
+	void subscribe(uint32_t phase, std::function<void(const E* events, size_t count)> handler);
+
+	// Events of type E with the same key replace each other until a handler has seen them,
+	// keeping the position of the first one, e.g. to keep only the last hit per entity
+	template<class E>
+	void coalesce(std::function<uint64_t(const E&)> key);
+
+	void sync();
+
+	// Events of types without a handler are dropped
+	void dispatch(uint32_t phase);
+
+	// Drops all pending events
+	void clear();
+
+	// Merged events not yet seen by every handler of their type
+	template<class E>
+	size_t pending() const;
+
+private:
+	struct queue_base
+	{
+		virtual ~queue_base() = default;
+		virtual std::unique_ptr<queue_base> create() const = 0;
+		virtual void merge(queue_base& channel) = 0;
+		virtual void dispatch(uint32_t phase) = 0;
+		virtual void clear() = 0;
+	};
+
+	template<class E>
+	struct queue : queue_base
+	{
+		struct handler
+		{
+			uint32_t phase;
+			std::function<void(const E*, size_t)> fn;
+			size_t delivered;
+		};
+
+		std::vector<E> events;
+		std::deque<handler> handlers;	// Stays in place when handlers subscribe during dispatch
+		std::function<uint64_t(const E&)> key;
+		std::unordered_map<uint64_t, size_t> keys;
+		size_t consumed = 0;	// Seen by every handler
+		size_t seen = 0;		// Seen by at least one handler
+
+		std::unique_ptr<queue_base> create() const override { return std::make_unique<queue<E>>(); }
+		void merge(queue_base& channel) override;
+		void dispatch(uint32_t phase) override;
+		void clear() override;
+		void push(const E& e);
+	};
+
+	struct thread_buffer
+	{
+		std::vector<std::unique_ptr<queue_base>> queues;
+	};
+
+	template<class E>
+	static size_t type_index();
+	static size_t next_type_index();
+
+	template<class E>
+	queue<E>& channel();
+	thread_buffer& local_buffer();
+
+	std::vector<std::unique_ptr<queue_base>> m_channels;
+	std::vector<std::unique_ptr<thread_buffer>> m_buffers;
+	std::mutex m_mutex;
+	uint64_t m_id = next_bus_id();
+
+	static uint64_t next_bus_id();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+template<class E>
+inline void event_bus::emit(const E& e)
+{
+	thread_buffer& buffer = local_buffer();
+	size_t index = type_index<E>();
+	if (buffer.queues.size() <= index)
+		buffer.queues.resize(index + 1);
+	if (!buffer.queues[index])
+		buffer.queues[index] = std::make_unique<queue<E>>();
+	static_cast<queue<E>&>(*buffer.queues[index]).events.push_back(e);
+}
+
+template<class E>
+inline void event_bus::subscribe(uint32_t phase, std::function<void(const E* events, size_t count)> handler)
+{
+	auto& q = channel<E>();
+	q.handlers.push_back({ phase, std::move(handler), q.events.size() });
+}
+
+template<class E>
+inline void event_bus::coalesce(std::function<uint64_t(const E&)> key)
+{
+	auto& q = channel<E>();
+	q.key = std::move(key);
+	q.keys.clear();
+}
+
+template<class E>
+inline size_t event_bus::pending() const
+{
+	size_t index = type_index<E>();
+	if (index >= m_channels.size() || !m_channels[index])
+		return 0;
+	auto& q = static_cast<const queue<E>&>(*m_channels[index]);
+	return q.events.size() - q.consumed;
+}
+
+inline void event_bus::sync()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& buffer : m_buffers)
+	{
+		if (m_channels.size() < buffer->queues.size())
+			m_channels.resize(buffer->queues.size());
+
+		for (size_t i = 0; i < buffer->queues.size(); i++)
+		{
+			if (!buffer->queues[i])
+				continue;
+			if (!m_channels[i])
+				m_channels[i] = buffer->queues[i]->create();
+			buffer->queues[i]->merge(*m_channels[i]);
+		}
+	}
+}
+
+inline void event_bus::dispatch(uint32_t phase)
+{
+	sync();
+	for (size_t i = 0; i < m_channels.size(); i++)
+		if (m_channels[i])
+			m_channels[i]->dispatch(phase);
+}
+
+inline void event_bus::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& buffer : m_buffers)
+		for (auto& q : buffer->queues)
+			if (q)
+				q->clear();
+	for (auto& q : m_channels)
+		if (q)
+			q->clear();
+}
+
+template<class E>
+inline void event_bus::queue<E>::merge(queue_base& channel)
+{
+	auto& target = static_cast<queue<E>&>(channel);
+	for (const E& e : events)
+		target.push(e);
+	events.clear();
+}
+
+template<class E>
+inline void event_bus::queue<E>::push(const E& e)
+{
+	if (key)
+	{
+		// Only events no handler has seen yet can be replaced
+		auto [itr, inserted] = keys.emplace(key(e), events.size());
+		if (!inserted && itr->second >= seen)
+		{
+			events[itr->second] = e;
+			return;
+		}
+		itr->second = events.size();
+	}
+	events.push_back(e);
+}
+
+template<class E>
+inline void event_bus::queue<E>::dispatch(uint32_t phase)
+{
+	// Handlers subscribed by handlers only get the events emitted after them
+	const size_t count = handlers.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		handler& h = handlers[i];
+		if (h.phase != phase || h.delivered == events.size())
+			continue;
+		h.fn(events.data() + h.delivered, events.size() - h.delivered);
+		h.delivered = events.size();
+	}
+
+	// Once every handler has seen every event the queue starts over
+	consumed = events.size();
+	seen = 0;
+	for (auto& h : handlers)
+	{
+		consumed = std::min(consumed, h.delivered);
+		seen = std::max(seen, h.delivered);
+	}
+	if (consumed == events.size())
+		clear();
+}
+
+template<class E>
+inline void event_bus::queue<E>::clear()
+{
+	events.clear();
+	keys.clear();
+	consumed = 0;
+	seen = 0;
+	for (auto& h : handlers)
+		h.delivered = 0;
+}
+
+template<class E>
+inline size_t event_bus::type_index()
+{
+	static const size_t index = next_type_index();
+	return index;
+}
+
+inline size_t event_bus::next_type_index()
+{
+	static std::atomic<size_t> next = 0;
+	return next++;
+}
+
+inline uint64_t event_bus::next_bus_id()
+{
+	static std::atomic<uint64_t> next = 1;
+	return next++;
+}
+
+template<class E>
+inline event_bus::queue<E>& event_bus::channel()
+{
+	size_t index = type_index<E>();
+	if (m_channels.size() <= index)
+		m_channels.resize(index + 1);
+	if (!m_channels[index])
+		m_channels[index] = std::make_unique<queue<E>>();
+	return static_cast<queue<E>&>(*m_channels[index]);
+}
+
+// Each thread remembers its buffer for every bus it emitted on. Buses are identified by
+// a unique id rather than their address so a new bus at the address of an old one starts clean.
+inline event_bus::thread_buffer& event_bus::local_buffer()
+{
+	thread_local uint64_t last_id = 0;
+	thread_local thread_buffer* last = nullptr;
+	if (last_id == m_id)
+		return *last;
+
+	thread_local std::unordered_map<uint64_t, thread_buffer*> buffers;
+	auto itr = buffers.find(m_id);
+	if (itr == buffers.end())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_buffers.push_back(std::make_unique<thread_buffer>());
+		itr = buffers.emplace(m_id, m_buffers.back().get()).first;
+	}
+	last_id = m_id;
+	last = itr->second;
+	return *last;
+}
+
+}
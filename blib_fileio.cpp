@@ -0,0 +1,429 @@
+#include "blib_fileio.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <iterator>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace blib::io
+{
+
+////////////////////////////////////////////////////////////////////////////////
+////							Files
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<char> read_binary_file(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return {};
+
+	std::vector<char> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(data.data(), data.size());
+	return data;
+}
+
+std::string read_text_file(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+		return {};
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	return buffer.str();
+}
+
+bool write_binary_file(const std::vector<char>& data, const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write(data.data(), data.size());
+	return file.good();
+}
+
+bool write_text_file(const std::string& text, const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file << text;
+	return file.good();
+}
+
+bool exists(const std::string& filename)
+{
+	file_stamp stamp;
+	return stat(filename, stamp);
+}
+
+bool stat(const std::string& filename, file_stamp& stamp)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(filename.c_str(), &info) != 0)
+		return false;
+	stamp.mtime = static_cast<int64_t>(info.st_mtime);
+#else
+	struct ::stat info;
+	if (::stat(filename.c_str(), &info) != 0)
+		return false;
+	stamp.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+	stamp.size = static_cast<uint64_t>(info.st_size);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Mapped File
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	std::atomic<size_t> g_mapped_bytes = 0;
+	std::atomic<size_t> g_mapped_files = 0;
+}
+
+bool mapped_file::open(const std::string& filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+			m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (m_data == nullptr)
+		{
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			m_size = 0;
+			return false;
+		}
+		m_handle = mapping;
+	}
+	CloseHandle(file);
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct ::stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	m_size = static_cast<size_t>(info.st_size);
+	if (m_size > 0)
+	{
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			::close(fd);
+			m_size = 0;
+			return false;
+		}
+		m_data = static_cast<const char*>(data);
+	}
+	::close(fd);
+#endif
+
+	g_mapped_bytes += m_size;
+	g_mapped_files++;
+	m_open = true;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (m_open)
+	{
+		g_mapped_bytes -= m_size;
+		g_mapped_files--;
+	}
+#ifdef _WIN32
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_handle != nullptr)
+		CloseHandle(m_handle);
+#else
+	if (m_data != nullptr)
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_handle = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Hashing
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	constexpr uint64_t prime0 = 0x9E3779B185EBCA87ull;
+	constexpr uint64_t prime1 = 0xC2B2AE3D27D4EB4Full;
+	constexpr uint64_t prime2 = 0x165667B19E3779F9ull;
+	constexpr uint64_t prime3 = 0x85EBCA77C2B2AE63ull;
+	constexpr uint64_t prime4 = 0x27D4EB2F165667C5ull;
+
+	inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+	inline uint64_t read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+	inline uint32_t read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+	inline uint64_t hash_round(uint64_t acc, uint64_t input)
+	{
+		acc += input * prime1;
+		acc = rotl(acc, 31);
+		return acc * prime0;
+	}
+
+	inline uint64_t merge(uint64_t acc, uint64_t value)
+	{
+		acc ^= hash_round(0, value);
+		return acc * prime0 + prime3;
+	}
+}
+
+// Little-endian xxHash64, produces the same values as the reference implementation
+uint64_t hash64(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+	uint64_t h;
+
+	if (size >= 32)
+	{
+		uint64_t v0 = seed + prime0 + prime1;
+		uint64_t v1 = seed + prime1;
+		uint64_t v2 = seed;
+		uint64_t v3 = seed - prime0;
+
+		const uint8_t* limit = end - 32;
+		do
+		{
+			v0 = hash_round(v0, read64(p));
+			v1 = hash_round(v1, read64(p + 8));
+			v2 = hash_round(v2, read64(p + 16));
+			v3 = hash_round(v3, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v0, 1) + rotl(v1, 7) + rotl(v2, 12) + rotl(v3, 18);
+		h = merge(h, v0);
+		h = merge(h, v1);
+		h = merge(h, v2);
+		h = merge(h, v3);
+	}
+	else
+	{
+		h = seed + prime4;
+	}
+
+	h += static_cast<uint64_t>(size);
+
+	for (; p + 8 <= end; p += 8)
+		h = rotl(h ^ hash_round(0, read64(p)), 27) * prime0 + prime3;
+
+	if (p + 4 <= end)
+	{
+		h = rotl(h ^ (static_cast<uint64_t>(read32(p)) * prime0), 23) * prime1 + prime2;
+		p += 4;
+	}
+
+	for (; p < end; ++p)
+		h = rotl(h ^ (*p * prime4), 11) * prime0;
+
+	h ^= h >> 33;
+	h *= prime1;
+	h ^= h >> 29;
+	h *= prime2;
+	h ^= h >> 32;
+	return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							File Cache
+////////////////////////////////////////////////////////////////////////////////
+
+file_cache::file_cache(size_t budget_bytes) : m_budget(budget_bytes) { }
+
+cached_file file_cache::read_binary_file(const std::string& filename)
+{
+	file_stamp stamp;
+	if (!stat(filename, stamp))
+	{
+		invalidate(filename);
+		return {};
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto itr = m_entries.find(filename);
+		if (itr != m_entries.end())
+		{
+			if (itr->second->stamp == stamp)
+			{
+				m_lru.splice(m_lru.begin(), m_lru, itr->second);
+				m_hits++;
+				return itr->second->file;
+			}
+			erase(itr->second);
+		}
+		m_misses++;
+	}
+
+	// Read outside of the lock so a slow disk does not stall other readers
+	auto data = std::make_shared<std::vector<char>>(io::read_binary_file(filename));
+	cached_file file;
+	file.hash = hash64(data->data(), data->size());
+	file.data = std::move(data);
+
+	// The file changed while we were reading it, hand out the data but don't keep it
+	if (file.data->size() != stamp.size)
+		return file;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto itr = m_entries.find(filename);
+	if (itr != m_entries.end())
+		erase(itr->second);
+
+	m_lru.push_front({ filename, stamp, file });
+	m_entries.emplace(filename, m_lru.begin());
+	m_used += file.data->size();
+	trim();
+	return file;
+}
+
+void file_cache::invalidate(const std::string& filename)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto itr = m_entries.find(filename);
+	if (itr != m_entries.end())
+		erase(itr->second);
+}
+
+void file_cache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_lru.clear();
+	m_entries.clear();
+	m_used = 0;
+}
+
+void file_cache::set_budget(size_t budget_bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budget = budget_bytes;
+	trim();
+}
+
+size_t file_cache::budget() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_budget;
+}
+
+size_t file_cache::used() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_used;
+}
+
+size_t file_cache::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_lru.size();
+}
+
+uint64_t file_cache::hits() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_hits;
+}
+
+uint64_t file_cache::misses() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_misses;
+}
+
+uint64_t file_cache::evictions() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_evictions;
+}
+
+void file_cache::erase(std::list<entry>::iterator itr)
+{
+	m_used -= itr->file.data->size();
+	m_entries.erase(itr->filename);
+	m_lru.erase(itr);
+}
+
+void file_cache::trim()
+{
+	// Always keep the most recent entry, even if it alone is over budget
+	while (m_used > m_budget && m_lru.size() > 1)
+	{
+		erase(std::prev(m_lru.end()));
+		m_evictions++;
+	}
+}
+
+file_cache& default_cache()
+{
+	static file_cache cache;
+	return cache;
+}
+
+cached_file read_binary_file_cached(const std::string& filename)
+{
+	return default_cache().read_binary_file(filename);
+}
+
+memory_stats memory_usage()
+{
+	memory_stats stats;
+	stats.cached_bytes = default_cache().used();
+	stats.cached_files = default_cache().size();
+	stats.mapped_bytes = g_mapped_bytes;
+	stats.mapped_files = g_mapped_files;
+	return stats;
+}
+
+}
@@ -2,6 +2,16 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <type_traits>
 
 // We use a namespace to not clash with other code
 namespace blib::io
@@ -11,4 +21,233 @@ namespace blib::io
 	bool write_binary_file(const std::vector<char>& data, const std::string& filename);
 	bool write_text_file(const std::string& text, const std::string& filename);
 	bool exists(const std::string& filename);
+
+	// Fast non-cryptographic 64-bit content hash (xxHash64)
+	uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
+
+	// Modification time and size of a file, gathered with a single stat call
+	struct file_stamp
+	{
+		int64_t mtime = 0;
+		uint64_t size = 0;
+
+		bool operator==(const file_stamp& other) const { return mtime == other.mtime && size == other.size; }
+		bool operator!=(const file_stamp& other) const { return !(*this == other); }
+	};
+
+	bool stat(const std::string& filename, file_stamp& stamp);
+
+	// Immutable file contents shared between all readers of the same file
+	using shared_buffer = std::shared_ptr<const std::vector<char>>;
+
+	struct cached_file
+	{
+		shared_buffer data;
+		uint64_t hash = 0;
+
+		explicit operator bool() const { return data != nullptr; }
+	};
+
+	// In-process cache of file contents keyed by path and stamp (mtime + size).
+	// A hit costs a single stat, a miss reads the whole file. Entries are evicted
+	// least-recently-used first once the memory budget is exceeded. Buffers handed
+	// out stay alive for as long as the caller holds on to them, even if evicted.
+	class file_cache
+	{
+	public:
+		explicit file_cache(size_t budget_bytes = 64 * 1024 * 1024);
+
+		cached_file read_binary_file(const std::string& filename);
+		void invalidate(const std::string& filename);
+		void clear();
+
+		void set_budget(size_t budget_bytes);
+		size_t budget() const;
+		size_t used() const;
+		size_t size() const;
+
+		uint64_t hits() const;
+		uint64_t misses() const;
+		uint64_t evictions() const;
+
+	private:
+		struct entry
+		{
+			std::string filename;
+			file_stamp stamp;
+			cached_file file;
+		};
+
+		void erase(std::list<entry>::iterator itr);
+		void trim();
+
+		std::list<entry> m_lru;
+		std::unordered_map<std::string, std::list<entry>::iterator> m_entries;
+		mutable std::mutex m_mutex;
+		size_t m_budget = 0;
+		size_t m_used = 0;
+		uint64_t m_hits = 0;
+		uint64_t m_misses = 0;
+		uint64_t m_evictions = 0;
+	};
+
+	// Process wide cache used by read_binary_file_cached
+	file_cache& default_cache();
+	cached_file read_binary_file_cached(const std::string& filename);
+
+	// Memory held by blib::io across the process, for telemetry
+	struct memory_stats
+	{
+		size_t cached_bytes = 0;	// Contents in the default cache
+		size_t cached_files = 0;
+		size_t mapped_bytes = 0;	// Views of open mapped files
+		size_t mapped_files = 0;
+	};
+
+	memory_stats memory_usage();
+
+	// Read-only memory mapping of a whole file
+	class mapped_file
+	{
+	public:
+		mapped_file() = default;
+		explicit mapped_file(const std::string& filename) { open(filename); }
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+		~mapped_file() { close(); }
+
+		bool open(const std::string& filename);
+		void close();
+
+		bool is_open() const { return m_open; }
+		const char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+		void* m_handle = nullptr;
+		bool m_open = false;
+	};
+
+	// Appends raw values to a growing byte buffer
+	class binary_writer
+	{
+	public:
+		void write(const void* data, size_t size)
+		{
+			const char* bytes = static_cast<const char*>(data);
+			m_data.insert(m_data.end(), bytes, bytes + size);
+		}
+
+		template<class T>
+		void write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written directly");
+			write(&value, sizeof(T));
+		}
+
+		template<class T>
+		void write_array(const T* values, size_t count)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written directly");
+			write(values, sizeof(T) * count);
+		}
+
+		void write_string(std::string_view text)
+		{
+			write(static_cast<uint32_t>(text.size()));
+			write(text.data(), text.size());
+		}
+
+		// Overwrites a value written earlier, used to back-fill sizes and counts
+		template<class T>
+		void patch(size_t offset, const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written directly");
+			assert(offset + sizeof(T) <= m_data.size());
+			memcpy(m_data.data() + offset, &value, sizeof(T));
+		}
+
+		size_t size() const { return m_data.size(); }
+		const std::vector<char>& data() const { return m_data; }
+		std::vector<char>& data() { return m_data; }
+
+	private:
+		std::vector<char> m_data;
+	};
+
+	// Reads raw values straight out of a block of memory, for example a mapped_file.
+	// Any read past the end fails and leaves the reader in a failed state.
+	class binary_reader
+	{
+	public:
+		binary_reader(const char* data, size_t size) : m_data(data), m_size(size) { }
+
+		bool read(void* data, size_t size)
+		{
+			if (!m_good || size > m_size - m_offset)
+			{
+				m_good = false;
+				return false;
+			}
+			memcpy(data, m_data + m_offset, size);
+			m_offset += size;
+			return true;
+		}
+
+		template<class T>
+		bool read(T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read directly");
+			return read(&value, sizeof(T));
+		}
+
+		template<class T>
+		bool read_array(T* values, size_t count)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read directly");
+			if (count > (m_size - m_offset) / sizeof(T))
+			{
+				m_good = false;
+				return false;
+			}
+			return read(values, sizeof(T) * count);
+		}
+
+		bool read_string(std::string& text)
+		{
+			uint32_t size = 0;
+			if (!read(size) || size > m_size - m_offset)
+			{
+				m_good = false;
+				return false;
+			}
+			text.assign(m_data + m_offset, size);
+			m_offset += size;
+			return true;
+		}
+
+		bool skip(size_t size)
+		{
+			if (!m_good || size > m_size - m_offset)
+			{
+				m_good = false;
+				return false;
+			}
+			m_offset += size;
+			return true;
+		}
+
+		const char* current() const { return m_data + m_offset; }
+		size_t offset() const { return m_offset; }
+		size_t remaining() const { return m_size - m_offset; }
+		bool good() const { return m_good; }
+
+	private:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_offset = 0;
+		bool m_good = true;
+	};
 }
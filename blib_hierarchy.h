@@ -0,0 +1,413 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include "blib_ec.h"
+#include "blib_math.h"
+#include "blib_jobs.h"
+
+namespace blib
+{
+
+// Contiguous storage for a forest of transforms. Nodes are kept in breadth first order,
+// so parents are always computed before their children, each depth level is a
+// contiguous range that is processed in parallel and the children of a node are a
+// contiguous range of the next level.
+// Structural changes don't re-sort right away. New nodes and nodes reparented to an
+// earlier slot wait in a tail after the sorted levels, destroyed leaves leave a hole,
+// and the next propagate re-sorts once if anything else changed or the tail or the
+// holes grew too large.
+// Node handles stay valid while slots are re-sorted.
+class transform_hierarchy
+{
+public:
+	using node = uint32_t;
+	static constexpr node invalid = ~0u;
+
+	transform_hierarchy() : m_levels(1, 0) { }
+
+	node create(node parent = invalid);
+	void destroy(node n);
+	void set_parent(node n, node parent);
+	node parent(node n) const;
+
+	void set_local(node n, const mat4& local);
+	const mat4& local(node n) const;
+	const mat4& world(node n) const;
+	size_t size() const { return m_slot_of.size() - m_free.size() - m_released.size(); }
+
+	// Recomputes the world matrix of every node whose local matrix, or the local
+	// matrix of one of its ancestors, changed since the last call. Only the subtrees
+	// below changed nodes are visited.
+	void propagate();
+
+private:
+	static constexpr size_t batch_size = 256;
+
+	bool alive(node n) const { return n < m_slot_of.size() && m_slot_of[n] != invalid; }
+	void mark_dirty(uint32_t slot);
+	void sort();
+
+	// Indexed by node
+	std::vector<uint32_t> m_slot_of;
+	std::vector<node> m_parent_of;
+	std::vector<uint32_t> m_child_count;
+	std::vector<node> m_free;
+	std::vector<node> m_released; // Destroyed with children, recycled by the next sort
+
+	// Indexed by slot, sorted levels first and then the tail
+	std::vector<node> m_node_of; // Invalid for holes
+	std::vector<uint32_t> m_parent_slot;
+	std::vector<mat4> m_local;
+	std::vector<mat4> m_world;
+	std::vector<uint8_t> m_dirty;
+
+	// Slots of the children of every sorted slot, as of the last sort
+	std::vector<uint32_t> m_children_begin;
+	std::vector<uint32_t> m_children_end;
+
+	// First slot of every depth level, plus one past the last sorted slot
+	std::vector<uint32_t> m_levels;
+	size_t m_holes = 0;
+	bool m_sorted = true;
+
+	// Slots flagged dirty since the last propagate, and those propagate flagged below them
+	std::vector<uint32_t> m_dirty_slots;
+	std::vector<uint32_t> m_propagated;
+	std::vector<uint32_t> m_current;
+};
+
+// Places an entity in a transform_hierarchy, which must outlive the component.
+// A copy gets a node of its own under the same parent and with the same local
+// transform, so prefabs can hold one, a move takes the node along.
+class hierarchy : public component
+{
+public:
+	explicit hierarchy(transform_hierarchy& h) : m_hierarchy(&h), m_node(h.create()) { }
+	hierarchy(const hierarchy& other);
+	hierarchy(hierarchy&& other) noexcept : component(other), m_hierarchy(other.m_hierarchy), m_node(other.m_node) { other.m_node = transform_hierarchy::invalid; }
+	hierarchy& operator=(const hierarchy&) = delete;
+	~hierarchy() override;
+
+	void set_parent(const hierarchy& parent);
+	void clear_parent() { m_hierarchy->set_parent(m_node, transform_hierarchy::invalid); }
+
+	void set_local(const mat4& local) { m_hierarchy->set_local(m_node, local); }
+	const mat4& local() const { return m_hierarchy->local(m_node); }
+	const mat4& world() const { return m_hierarchy->world(m_node); }
+	transform_hierarchy::node node() const { return m_node; }
+
+private:
+	transform_hierarchy* m_hierarchy = nullptr;
+	transform_hierarchy::node m_node = transform_hierarchy::invalid;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+inline transform_hierarchy::node transform_hierarchy::create(node parent)
+{
+	assert(parent == invalid || alive(parent));
+
+	node n;
+	if (!m_free.empty())
+	{
+		n = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		n = static_cast<node>(m_slot_of.size());
+		m_slot_of.push_back(0);
+		m_parent_of.push_back(invalid);
+		m_child_count.push_back(0);
+	}
+
+	// New nodes go to the tail, after their parent, until the next sort
+	const uint32_t slot = static_cast<uint32_t>(m_node_of.size());
+	m_slot_of[n] = slot;
+	m_parent_of[n] = parent;
+	m_node_of.push_back(n);
+	m_parent_slot.push_back(parent == invalid ? invalid : m_slot_of[parent]);
+	m_local.emplace_back();
+	m_world.emplace_back();
+	m_dirty.push_back(0);
+	mark_dirty(slot);
+	if (parent != invalid)
+		m_child_count[parent]++;
+	return n;
+}
+
+inline void transform_hierarchy::destroy(node n)
+{
+	assert(alive(n));
+
+	m_node_of[m_slot_of[n]] = invalid;
+	m_slot_of[n] = invalid;
+	m_holes++;
+	if (m_parent_of[n] != invalid)
+		m_child_count[m_parent_of[n]]--;
+	m_parent_of[n] = invalid;
+
+	// A leaf only leaves a hole. Children turn into roots, which changes the depth of
+	// their subtrees, so the handle is only recycled after the sort that does that.
+	if (m_child_count[n] == 0)
+		m_free.push_back(n);
+	else
+	{
+		m_released.push_back(n);
+		m_sorted = false;
+	}
+}
+
+inline void transform_hierarchy::set_parent(node n, node parent)
+{
+	assert(alive(n) && (parent == invalid || alive(parent)));
+#ifndef NDEBUG
+	for (node p = parent; p != invalid; p = m_parent_of[p])
+		assert(p != n && "set_parent would create a cycle");
+#endif
+
+	if (m_parent_of[n] == parent)
+		return;
+
+	if (m_parent_of[n] != invalid)
+		m_child_count[m_parent_of[n]]--;
+	if (parent != invalid)
+		m_child_count[parent]++;
+	m_parent_of[n] = parent;
+
+	// A node in the tail stays there as long as its parent comes first. Its children
+	// are all in the tail after it, so they stay in order too.
+	const uint32_t slot = m_slot_of[n];
+	const uint32_t parent_slot = parent == invalid ? invalid : m_slot_of[parent];
+	m_parent_slot[slot] = parent_slot;
+	if (slot < m_levels.back() || (parent != invalid && parent_slot > slot))
+		m_sorted = false;
+	mark_dirty(slot);
+}
+
+// Children of a destroyed node only drop the link in the next sort, its handle is not
+// recycled before that
+inline transform_hierarchy::node transform_hierarchy::parent(node n) const
+{
+	assert(alive(n));
+	const node p = m_parent_of[n];
+	return p != invalid && alive(p) ? p : invalid;
+}
+
+inline void transform_hierarchy::set_local(node n, const mat4& local)
+{
+	assert(alive(n));
+	uint32_t slot = m_slot_of[n];
+	m_local[slot] = local;
+	mark_dirty(slot);
+}
+
+inline const mat4& transform_hierarchy::local(node n) const
+{
+	assert(alive(n));
+	return m_local[m_slot_of[n]];
+}
+
+inline const mat4& transform_hierarchy::world(node n) const
+{
+	assert(alive(n));
+	return m_world[m_slot_of[n]];
+}
+
+inline void transform_hierarchy::mark_dirty(uint32_t slot)
+{
+	if (!m_dirty[slot])
+	{
+		m_dirty[slot] = 1;
+		m_dirty_slots.push_back(slot);
+	}
+}
+
+inline void transform_hierarchy::propagate()
+{
+	const uint32_t sorted_end = m_levels.back();
+	const size_t tail = m_node_of.size() - sorted_end;
+	if (!m_sorted || tail > std::max<size_t>(batch_size, sorted_end / 8) || m_holes > m_node_of.size() / 4)
+		sort();
+
+	if (m_dirty_slots.empty())
+		return;
+
+	// Dirty flags double as "world changed" markers for the next level down. The work
+	// of a level is its own dirty slots plus the children of the slots done above it.
+	std::sort(m_dirty_slots.begin(), m_dirty_slots.end());
+	size_t next_dirty = 0;
+	m_current.clear();
+	for (size_t level = 0; level + 1 < m_levels.size(); level++)
+	{
+		const size_t first_child = m_propagated.size();
+		for (uint32_t slot : m_current)
+			for (uint32_t child = m_children_begin[slot]; child < m_children_end[slot]; child++)
+				if (!m_dirty[child])
+				{
+					m_dirty[child] = 1;
+					m_propagated.push_back(child);
+				}
+
+		m_current.assign(m_propagated.begin() + first_child, m_propagated.end());
+		for (; next_dirty < m_dirty_slots.size() && m_dirty_slots[next_dirty] < m_levels[level + 1]; next_dirty++)
+			m_current.push_back(m_dirty_slots[next_dirty]);
+
+		// Each level only reads the level above it, so all of its nodes can run at once.
+		// Holes compute garbage that nothing reads.
+		parallel_for(m_current.size(), batch_size, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t slot = m_current[i];
+				uint32_t parent = m_parent_slot[slot];
+				m_world[slot] = parent == invalid ? m_local[slot] : mul(m_world[parent], m_local[slot]);
+			}
+		});
+	}
+
+	// The tail is in creation order, parents first
+	for (uint32_t slot = m_levels.back(); slot < m_node_of.size(); slot++)
+	{
+		uint32_t parent = m_parent_slot[slot];
+		if (m_node_of[slot] == invalid || !(m_dirty[slot] || (parent != invalid && m_dirty[parent])))
+			continue;
+
+		m_world[slot] = parent == invalid ? m_local[slot] : mul(m_world[parent], m_local[slot]);
+		if (!m_dirty[slot])
+		{
+			m_dirty[slot] = 1;
+			m_propagated.push_back(slot);
+		}
+	}
+
+	for (uint32_t slot : m_dirty_slots)
+		m_dirty[slot] = 0;
+	for (uint32_t slot : m_propagated)
+		m_dirty[slot] = 0;
+	m_dirty_slots.clear();
+	m_propagated.clear();
+}
+
+inline void transform_hierarchy::sort()
+{
+	const uint32_t node_count = static_cast<uint32_t>(m_slot_of.size());
+
+	// Children of destroyed nodes become roots
+	for (node n = 0; n < node_count; n++)
+	{
+		node p = m_parent_of[n];
+		if (m_slot_of[n] != invalid && p != invalid && m_slot_of[p] == invalid)
+		{
+			m_parent_of[n] = invalid;
+			mark_dirty(m_slot_of[n]);
+		}
+	}
+	for (node n : m_released)
+		m_child_count[n] = 0;
+	m_free.insert(m_free.end(), m_released.begin(), m_released.end());
+	m_released.clear();
+
+	// Children of every node, grouped by parent
+	std::vector<uint32_t> child_offset(node_count + 1, 0);
+	std::vector<node> roots;
+	for (node n = 0; n < node_count; n++)
+	{
+		if (m_slot_of[n] == invalid)
+			continue;
+		if (m_parent_of[n] == invalid)
+			roots.push_back(n);
+		else
+			child_offset[m_parent_of[n] + 1]++;
+	}
+	for (node n = 0; n < node_count; n++)
+		child_offset[n + 1] += child_offset[n];
+	std::vector<node> children(child_offset.back());
+	std::vector<uint32_t> cursor(child_offset.begin(), child_offset.end() - 1);
+	for (node n = 0; n < node_count; n++)
+		if (m_slot_of[n] != invalid && m_parent_of[n] != invalid)
+			children[cursor[m_parent_of[n]]++] = n;
+
+	// Breadth first from all roots at once, which keeps levels and siblings contiguous
+	std::vector<node> node_of = std::move(roots);
+	node_of.reserve(m_node_of.size() - m_holes);
+	std::vector<uint32_t> parent_slot(node_of.size(), invalid);
+	std::vector<uint32_t> children_begin, children_end;
+	children_begin.reserve(node_of.capacity());
+	children_end.reserve(node_of.capacity());
+	std::vector<uint32_t> levels(1, 0);
+	size_t level_end = node_of.size();
+	for (uint32_t slot = 0; slot < node_of.size(); slot++)
+	{
+		if (slot == level_end)
+		{
+			levels.push_back(slot);
+			level_end = node_of.size();
+		}
+
+		node n = node_of[slot];
+		children_begin.push_back(static_cast<uint32_t>(node_of.size()));
+		for (uint32_t i = child_offset[n]; i < child_offset[n + 1]; i++)
+		{
+			node_of.push_back(children[i]);
+			parent_slot.push_back(slot);
+		}
+		children_end.push_back(static_cast<uint32_t>(node_of.size()));
+	}
+	if (!node_of.empty())
+		levels.push_back(static_cast<uint32_t>(node_of.size()));
+
+	const uint32_t slot_count = static_cast<uint32_t>(node_of.size());
+	std::vector<mat4> local(slot_count);
+	std::vector<mat4> world(slot_count);
+	std::vector<uint8_t> dirty(slot_count);
+	m_dirty_slots.clear();
+	for (uint32_t slot = 0; slot < slot_count; slot++)
+	{
+		uint32_t old_slot = m_slot_of[node_of[slot]];
+		local[slot] = m_local[old_slot];
+		world[slot] = m_world[old_slot];
+		dirty[slot] = m_dirty[old_slot];
+		if (dirty[slot])
+			m_dirty_slots.push_back(slot);
+	}
+	for (uint32_t slot = 0; slot < slot_count; slot++)
+		m_slot_of[node_of[slot]] = slot;
+
+	m_node_of = std::move(node_of);
+	m_parent_slot = std::move(parent_slot);
+	m_local = std::move(local);
+	m_world = std::move(world);
+	m_dirty = std::move(dirty);
+	m_children_begin = std::move(children_begin);
+	m_children_end = std::move(children_end);
+	m_levels = std::move(levels);
+	m_holes = 0;
+	m_sorted = true;
+}
+
+inline hierarchy::hierarchy(const hierarchy& other) : component(other), m_hierarchy(other.m_hierarchy)
+{
+	m_node = m_hierarchy->create(m_hierarchy->parent(other.m_node));
+	m_hierarchy->set_local(m_node, other.local());
+}
+
+inline hierarchy::~hierarchy()
+{
+	if (m_node != transform_hierarchy::invalid)
+		m_hierarchy->destroy(m_node);
+}
+
+inline void hierarchy::set_parent(const hierarchy& parent)
+{
+	assert(parent.m_hierarchy == m_hierarchy);
+	m_hierarchy->set_parent(m_node, parent.m_node);
+}
+
+}
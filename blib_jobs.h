@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+namespace blib
+{
+
+// Minimal persistent worker pool for data parallel loops.
+// The calling thread always takes part, so a pool with zero workers runs everything inline.
+// Nested parallel_for calls from inside a job run serially on the calling worker.
+class job_pool
+{
+public:
+	explicit job_pool(uint32_t worker_count = default_worker_count());
+	job_pool(const job_pool&) = delete;
+	job_pool& operator=(const job_pool&) = delete;
+	~job_pool();
+
+	// Calls fn(begin, end) over [0, count) in batches of at most batch_size items
+	template<class F>
+	void parallel_for(size_t count, size_t batch_size, F&& fn);
+
+	uint32_t worker_count() const { return static_cast<uint32_t>(m_workers.size()); }
+
+	static job_pool& instance();
+	static uint32_t default_worker_count();
+
+private:
+	void run(size_t count, size_t batch_size, const std::function<void(size_t, size_t)>& fn);
+	void work();
+	void execute();
+	static bool& inside_job();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_run_mutex;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const std::function<void(size_t, size_t)>* m_fn = nullptr;
+	size_t m_count = 0;
+	size_t m_batch_size = 1;
+	std::atomic<size_t> m_next = 0;
+	uint32_t m_active = 0;
+	uint64_t m_generation = 0;
+	bool m_quit = false;
+};
+
+template<class F>
+void parallel_for(size_t count, size_t batch_size, F&& fn)
+{
+	job_pool::instance().parallel_for(count, batch_size, std::forward<F>(fn));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+inline job_pool::job_pool(uint32_t worker_count)
+{
+	for (uint32_t i = 0; i < worker_count; i++)
+		m_workers.emplace_back([this]() { work(); });
+}
+
+inline job_pool::~job_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (auto& t : m_workers)
+		t.join();
+}
+
+template<class F>
+inline void job_pool::parallel_for(size_t count, size_t batch_size, F&& fn)
+{
+	batch_size = std::max<size_t>(batch_size, 1);
+	if (count <= batch_size || m_workers.empty() || inside_job())
+	{
+		for (size_t begin = 0; begin < count; begin += batch_size)
+			fn(begin, std::min(begin + batch_size, count));
+		return;
+	}
+
+	std::function<void(size_t, size_t)> job = std::forward<F>(fn);
+	run(count, batch_size, job);
+}
+
+inline void job_pool::run(size_t count, size_t batch_size, const std::function<void(size_t, size_t)>& fn)
+{
+	std::lock_guard<std::mutex> run_lock(m_run_mutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_fn = &fn;
+		m_count = count;
+		m_batch_size = batch_size;
+		m_next = 0;
+		m_active = static_cast<uint32_t>(m_workers.size());
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	inside_job() = true;
+	execute();
+	inside_job() = false;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_active == 0; });
+	m_fn = nullptr;
+}
+
+inline void job_pool::work()
+{
+	inside_job() = true;
+	uint64_t generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_quit || m_generation != generation; });
+			if (m_quit)
+				return;
+			generation = m_generation;
+		}
+
+		execute();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_active == 0)
+			m_done.notify_one();
+	}
+}
+
+inline void job_pool::execute()
+{
+	while (true)
+	{
+		size_t begin = m_next.fetch_add(m_batch_size);
+		if (begin >= m_count)
+			return;
+		(*m_fn)(begin, std::min(begin + m_batch_size, m_count));
+	}
+}
+
+inline bool& job_pool::inside_job()
+{
+	thread_local bool inside = false;
+	return inside;
+}
+
+inline job_pool& job_pool::instance()
+{
+	static job_pool pool;
+	return pool;
+}
+
+inline uint32_t job_pool::default_worker_count()
+{
+	uint32_t cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 0;
+}
+
+}
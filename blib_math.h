@@ -2,13 +2,22 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <type_traits>
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+
+// SSE2 paths are used for float kernels unless BLIB_NO_SIMD is defined
+#if !defined(BLIB_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BLIB_SSE2 1
+#include <emmintrin.h>
+#endif
 
 /*
 
 	---------------------------------------------------------------------------------
 											Todo
 	Quat, translate, rotate, scale
-	Ortho, view (lookAt), Unit testing
+	Unit testing
 	
 	---------------------------------------------------------------------------------
 											Done
@@ -20,8 +29,13 @@
 	Quat: -
 
 	Vector func: Dot product / Cross product / Length / Normalize
-	Matrix func: Transpose / Perspective left-handed and right-handed, 0..1 and -1..1
+	Matrix func: Transpose / Product (mul) / Perspective, Ortho and LookAt left-handed and right-handed, 0..1 and -1..1
+	View-projection batches: cameras / cube map faces / shadow cascade splits and fitting
 	Func: Radians / Degrees
+	Fast approximate: rsqrt / sin / cos / atan2 / exp / normalize, scalar and array versions
+	Packing: half / unorm / snorm / octahedral normals / smallest-three quaternions, scalar and array versions
+	Large world: double to camera relative float positions and transforms, scalar and array versions
+	Integer grid: bit operators / floor division to cells / 2D and 3D Morton codes, scalar and array versions
 	Default types for float/double/uint/int vectors and matrices
 	---------------------------------------------------------------------------------
 
@@ -56,7 +70,7 @@ struct vec2_t
 	/*
 		Arithmetic operators
 	*/
-	constexpr vec2_t operator+(const vec2_t& other)
+	constexpr vec2_t operator+(const vec2_t& other) const
 	{
 		return { x + other.x, y + other.y };
 	}
@@ -67,7 +81,7 @@ struct vec2_t
 		return *this;
 	}
 
-	constexpr vec2_t operator-(const vec2_t& other)
+	constexpr vec2_t operator-(const vec2_t& other) const
 	{
 		return { x - other.x, y - other.y };
 	}
@@ -78,7 +92,7 @@ struct vec2_t
 		return *this;
 	}
 
-	constexpr vec2_t operator*(const vec2_t& other)
+	constexpr vec2_t operator*(const vec2_t& other) const
 	{
 		return { x * other.x, y * other.y };
 	}
@@ -89,7 +103,7 @@ struct vec2_t
 		return *this;
 	}
 
-	constexpr vec2_t operator/(const vec2_t& other)
+	constexpr vec2_t operator/(const vec2_t& other) const
 	{
 		return { x / other.x, y / other.y };
 	}
@@ -132,11 +146,11 @@ constexpr vec2_t<T> operator+(const vec2_t<T>& v0, T scalar)
 	return { v0.x + scalar, v0.y + scalar };
 }
 template<typename T>
-constexpr vec2_t<T>& operator+=(const vec2_t<T>& v0, T scalar)
+constexpr vec2_t<T>& operator+=(vec2_t<T>& v0, T scalar)
 {
 	v0.x += scalar;
 	v0.y += scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -145,11 +159,11 @@ constexpr vec2_t<T> operator-(const vec2_t<T>& v0, T scalar)
 	return { v0.x - scalar, v0.y - scalar };
 }
 template<typename T>
-constexpr vec2_t<T>& operator-=(const vec2_t<T>& v0, T scalar)
+constexpr vec2_t<T>& operator-=(vec2_t<T>& v0, T scalar)
 {
 	v0.x -= scalar;
 	v0.y -= scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -158,11 +172,11 @@ constexpr vec2_t<T> operator*(const vec2_t<T>& v0, T scalar)
 	return { v0.x * scalar, v0.y * scalar };
 }
 template<typename T>
-constexpr vec2_t<T>& operator*=(const vec2_t<T>& v0, T scalar)
+constexpr vec2_t<T>& operator*=(vec2_t<T>& v0, T scalar)
 {
 	v0.x *= scalar;
 	v0.y *= scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -171,11 +185,11 @@ constexpr vec2_t<T> operator/(const vec2_t<T>& v0, T scalar)
 	return { v0.x / scalar, v0.y / scalar };
 }
 template<typename T>
-constexpr vec2_t<T>& operator/=(const vec2_t<T>& v0, T scalar)
+constexpr vec2_t<T>& operator/=(vec2_t<T>& v0, T scalar)
 {
 	v0.x /= scalar;
 	v0.y /= scalar;
-	return *this;
+	return v0;
 }
 
 /*
@@ -206,7 +220,7 @@ struct vec3_t
 	/*
 		Unary arithmetic operators
 	*/
-	constexpr vec3_t operator+(const vec3_t& other)
+	constexpr vec3_t operator+(const vec3_t& other) const
 	{
 		return { x + other.x, y + other.y, z + other.z };
 	}
@@ -218,7 +232,7 @@ struct vec3_t
 		return *this;
 	}
 
-	constexpr vec3_t operator-(const vec3_t& other)
+	constexpr vec3_t operator-(const vec3_t& other) const
 	{
 		return { x - other.x, y - other.y, z - other.z };
 	}
@@ -230,7 +244,7 @@ struct vec3_t
 		return *this;
 	}
 
-	constexpr vec3_t operator*(const vec3_t& other)
+	constexpr vec3_t operator*(const vec3_t& other) const
 	{
 		return { x * other.x, y * other.y, z * other.z };
 	}
@@ -242,7 +256,7 @@ struct vec3_t
 		return *this;
 	}
 
-	constexpr vec3_t operator/(const vec3_t& other)
+	constexpr vec3_t operator/(const vec3_t& other) const
 	{
 		return { x / other.x, y / other.y, z / other.z };
 	}
@@ -288,12 +302,12 @@ constexpr vec3_t<T> operator+(const vec3_t<T>& v0, T scalar)
 	return { v0.x + scalar, v0.y + scalar, v0.z + scalar };
 }
 template<typename T>
-constexpr vec3_t<T>& operator+=(const vec3_t<T>& v0, T scalar)
+constexpr vec3_t<T>& operator+=(vec3_t<T>& v0, T scalar)
 {
 	v0.x += scalar;
 	v0.y += scalar;
 	v0.z += scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -302,12 +316,12 @@ constexpr vec3_t<T> operator-(const vec3_t<T>& v0, T scalar)
 	return { v0.x - scalar, v0.y - scalar, v0.z - scalar };
 }
 template<typename T>
-constexpr vec3_t<T>& operator-=(const vec3_t<T>& v0, T scalar)
+constexpr vec3_t<T>& operator-=(vec3_t<T>& v0, T scalar)
 {
 	v0.x -= scalar;
 	v0.y -= scalar;
 	v0.z -= scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -316,12 +330,12 @@ constexpr vec3_t<T> operator*(const vec3_t<T>& v0, T scalar)
 	return { v0.x * scalar, v0.y * scalar, v0.z * scalar };
 }
 template<typename T>
-constexpr vec3_t<T>& operator*=(const vec3_t<T>& v0, T scalar)
+constexpr vec3_t<T>& operator*=(vec3_t<T>& v0, T scalar)
 {
 	v0.x *= scalar;
 	v0.y *= scalar;
 	v0.z *= scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -330,12 +344,12 @@ constexpr vec3_t<T> operator/(const vec3_t<T>& v0, T scalar)
 	return { v0.x / scalar, v0.y / scalar, v0.z / scalar };
 }
 template<typename T>
-constexpr vec3_t<T>& operator/=(const vec3_t<T>& v0, T scalar)
+constexpr vec3_t<T>& operator/=(vec3_t<T>& v0, T scalar)
 {
 	v0.x /= scalar;
 	v0.y /= scalar;
 	v0.z /= scalar;
-	return *this;
+	return v0;
 }
 
 /*
@@ -367,7 +381,7 @@ struct vec4_t
 	/*
 		Arithmetic operators
 	*/
-	constexpr vec4_t operator+(const vec4_t& other)
+	constexpr vec4_t operator+(const vec4_t& other) const
 	{
 		return { x + other.x, y + other.y, z + other.z, w + other.w };
 	}
@@ -380,7 +394,7 @@ struct vec4_t
 		return *this;
 	}
 
-	constexpr vec4_t operator-(const vec4_t& other)
+	constexpr vec4_t operator-(const vec4_t& other) const
 	{
 		return { x - other.x, y - other.y, z - other.z, w - other.w };
 	}
@@ -393,7 +407,7 @@ struct vec4_t
 		return *this;
 	}
 
-	constexpr vec4_t operator*(const vec4_t& other)
+	constexpr vec4_t operator*(const vec4_t& other) const
 	{
 		return { x * other.x, y * other.y, z * other.z, w * other.w };
 	}
@@ -406,7 +420,7 @@ struct vec4_t
 		return *this;
 	}
 
-	constexpr vec4_t operator/(const vec4_t& other)
+	constexpr vec4_t operator/(const vec4_t& other) const
 	{
 		return { x / other.x, y / other.y, z / other.z, w / other.w };
 	}
@@ -455,13 +469,13 @@ constexpr vec4_t<T> operator+(const vec4_t<T>& v0, T scalar)
 	return { v0.x + scalar, v0.y + scalar, v0.z + scalar, v0.w + scalar };
 }
 template<typename T>
-constexpr vec4_t<T>& operator+=(const vec4_t<T>& v0, T scalar)
+constexpr vec4_t<T>& operator+=(vec4_t<T>& v0, T scalar)
 {
 	v0.x += scalar;
 	v0.y += scalar;
 	v0.z += scalar;
 	v0.w += scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -470,13 +484,13 @@ constexpr vec4_t<T> operator-(const vec4_t<T>& v0, T scalar)
 	return { v0.x - scalar, v0.y - scalar, v0.z - scalar, v0.w - scalar };
 }
 template<typename T>
-constexpr vec4_t<T>& operator-=(const vec4_t<T>& v0, T scalar)
+constexpr vec4_t<T>& operator-=(vec4_t<T>& v0, T scalar)
 {
 	v0.x -= scalar;
 	v0.y -= scalar;
 	v0.z -= scalar;
 	v0.w -= scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -485,13 +499,13 @@ constexpr vec4_t<T> operator*(const vec4_t<T>& v0, T scalar)
 	return { v0.x * scalar, v0.y * scalar, v0.z * scalar, v0.w * scalar };
 }
 template<typename T>
-constexpr vec4_t<T>& operator*=(const vec4_t<T>& v0, T scalar)
+constexpr vec4_t<T>& operator*=(vec4_t<T>& v0, T scalar)
 {
 	v0.x *= scalar;
 	v0.y *= scalar;
 	v0.z *= scalar;
 	v0.w *= scalar;
-	return *this;
+	return v0;
 }
 
 template<typename T>
@@ -500,13 +514,13 @@ constexpr vec4_t<T> operator/(const vec4_t<T>& v0, T scalar)
 	return { v0.x / scalar, v0.y / scalar, v0.z / scalar, v0.w / scalar };
 }
 template<typename T>
-constexpr vec4_t<T>& operator/=(const vec4_t<T>& v0, T scalar)
+constexpr vec4_t<T>& operator/=(vec4_t<T>& v0, T scalar)
 {
 	v0.x /= scalar;
 	v0.y /= scalar;
 	v0.z /= scalar;
 	v0.w /= scalar;
-	return *this;
+	return v0;
 }
 
 /*
@@ -525,8 +539,8 @@ struct mat3_t
 	mat3_t()
 	{
 		value[0] = { 1, 0, 0 };
-		value[0] = { 0, 1, 0 };
-		value[0] = { 0, 0, 1 };
+		value[1] = { 0, 1, 0 };
+		value[2] = { 0, 0, 1 };
 	}
 	mat3_t(T scalar)
 	{
@@ -803,187 +817,1945 @@ inline constexpr T radians(T deg)
 
 /*
 
-	Matrix functions
+	Fast approximate functions
+
+	Opt-in replacements for when precision is not critical, like particles and animation.
+	The error bounds are measured against double precision results, over the stated range.
+	The array versions process four floats at a time with SSE2 and give the same results
+	as the scalar versions. in and out may be the same array.
 
 */
 
-template<typename T>
-inline constexpr mat3_t<T> transpose(const mat3_t<T>& mat3)
+namespace detail
 {
-	mat3_t<T> newMat3 = mat3;
-	newMat3[0][1] = mat3[1][0];
-	newMat3[0][2] = mat3[2][0];
-	newMat3[1][0] = mat3[0][1];
-	newMat3[1][2] = mat3[2][1];
-	newMat3[2][0] = mat3[0][2];
-	newMat3[2][1] = mat3[1][2];
+	constexpr float two_over_pi = 0.636619772367581f;
+	// pi / 2 split in three parts, so reducing by multiples of it stays exact
+	constexpr float half_pi_hi = 1.5703125f;
+	constexpr float half_pi_mid = 4.83751296997070e-4f;
+	constexpr float half_pi_lo = 7.54978995489188e-8f;
+	constexpr float log2e = 1.44269504088896f;
+	constexpr float ln2_hi = 0.693359375f;
+	constexpr float ln2_lo = -2.12194440e-4f;
+	constexpr float exp_min = -87.0f;
+	constexpr float exp_max = 88.0f;
+
+	// Minimax polynomials on [-pi/4, pi/4]
+	inline float sin_poly(float r)
+	{
+		float r2 = r * r;
+		return r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+	}
+
+	inline float cos_poly(float r)
+	{
+		float r2 = r * r;
+		return 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+	}
+
+	// atan on [0, 1], Abramowitz and Stegun 4.4.49
+	inline float atan_poly(float a)
+	{
+		float s = a * a;
+		float p = -0.0161657367f + s * 0.0028662257f;
+		p = 0.0429096138f + s * p;
+		p = -0.0752896400f + s * p;
+		p = 0.1065626393f + s * p;
+		p = -0.1420889944f + s * p;
+		p = 0.1999355085f + s * p;
+		p = -0.3333314528f + s * p;
+		return a + (a * s) * p;
+	}
+
+	inline float exp_poly(float r)
+	{
+		return 1.0f + r + r * r * (5.0000001201e-1f + r * (1.6666665459e-1f + r * (4.1665795894e-2f + r * (8.3334519073e-3f + r * (1.3981999507e-3f + r * 1.9875691500e-4f)))));
+	}
+
+	inline float round_nearest(float x)
+	{
+		return static_cast<float>(static_cast<int32_t>(x + (x < 0.0f ? -0.5f : 0.5f)));
+	}
+
+	// Returns the reduced angle, quadrant receives the multiple of pi / 2 taken off
+	inline float reduce_half_pi(float x, int32_t& quadrant)
+	{
+		float j = round_nearest(x * two_over_pi);
+		quadrant = static_cast<int32_t>(j);
+		return ((x - j * half_pi_hi) - j * half_pi_mid) - j * half_pi_lo;
+	}
+
+#ifdef BLIB_SSE2
+	inline __m128 select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
 
-	return mat3;
+	// Rounds half away from zero like round_nearest, so both paths agree
+	inline __m128i round_nearest(__m128 x)
+	{
+		__m128 half = _mm_or_ps(_mm_set1_ps(0.5f), _mm_and_ps(x, _mm_set1_ps(-0.0f)));
+		return _mm_cvttps_epi32(_mm_add_ps(x, half));
+	}
+
+	inline __m128 rsqrt4(__m128 x)
+	{
+		__m128 y = _mm_rsqrt_ps(x);
+		__m128 xyy = _mm_mul_ps(_mm_mul_ps(x, y), y);
+		return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), xyy));
+	}
+
+	inline void sincos4(__m128 x, __m128& s, __m128& c)
+	{
+		__m128i q = round_nearest(_mm_mul_ps(x, _mm_set1_ps(two_over_pi)));
+		__m128 j = _mm_cvtepi32_ps(q);
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(half_pi_hi)));
+		r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(half_pi_mid)));
+		r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(half_pi_lo)));
+
+		__m128 r2 = _mm_mul_ps(r, r);
+		__m128 ps = _mm_add_ps(_mm_set1_ps(8.3321608736e-3f), _mm_mul_ps(r2, _mm_set1_ps(-1.9515295891e-4f)));
+		ps = _mm_add_ps(_mm_set1_ps(-1.6666654611e-1f), _mm_mul_ps(r2, ps));
+		ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+
+		__m128 pc = _mm_add_ps(_mm_set1_ps(-1.388731625493765e-3f), _mm_mul_ps(r2, _mm_set1_ps(2.443315711809948e-5f)));
+		pc = _mm_add_ps(_mm_set1_ps(4.166664568298827e-2f), _mm_mul_ps(r2, pc));
+		pc = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), pc));
+
+		// Odd quadrants swap sin and cos, quadrants 2 and 3 negate sin, 1 and 2 negate cos
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+		__m128 sign_s = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+		__m128 sign_c = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+		s = _mm_xor_ps(select(swap, pc, ps), sign_s);
+		c = _mm_xor_ps(select(swap, ps, pc), sign_c);
+	}
+
+	inline __m128 atan2_4(__m128 y, __m128 x)
+	{
+		__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 ax = _mm_and_ps(x, abs_mask);
+		__m128 ay = _mm_and_ps(y, abs_mask);
+		__m128 hi = _mm_max_ps(ax, ay);
+		__m128 lo = _mm_min_ps(ax, ay);
+		__m128 zero = _mm_cmpeq_ps(hi, _mm_setzero_ps());
+		__m128 a = _mm_div_ps(lo, select(zero, _mm_set1_ps(1.0f), hi));
+
+		__m128 sq = _mm_mul_ps(a, a);
+		__m128 p = _mm_add_ps(_mm_set1_ps(-0.0161657367f), _mm_mul_ps(sq, _mm_set1_ps(0.0028662257f)));
+		p = _mm_add_ps(_mm_set1_ps(0.0429096138f), _mm_mul_ps(sq, p));
+		p = _mm_add_ps(_mm_set1_ps(-0.0752896400f), _mm_mul_ps(sq, p));
+		p = _mm_add_ps(_mm_set1_ps(0.1065626393f), _mm_mul_ps(sq, p));
+		p = _mm_add_ps(_mm_set1_ps(-0.1420889944f), _mm_mul_ps(sq, p));
+		p = _mm_add_ps(_mm_set1_ps(0.1999355085f), _mm_mul_ps(sq, p));
+		p = _mm_add_ps(_mm_set1_ps(-0.3333314528f), _mm_mul_ps(sq, p));
+		__m128 r = _mm_add_ps(a, _mm_mul_ps(_mm_mul_ps(a, sq), p));
+
+		r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(1.57079632679f), r), r);
+		r = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159265359f), r), r);
+		return _mm_or_ps(r, _mm_and_ps(y, _mm_set1_ps(-0.0f)));
+	}
+
+	inline __m128 exp4(__m128 x)
+	{
+		x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(exp_min)), _mm_set1_ps(exp_max));
+		__m128i n = round_nearest(_mm_mul_ps(x, _mm_set1_ps(log2e)));
+		__m128 fn = _mm_cvtepi32_ps(n);
+		__m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(ln2_hi))), _mm_mul_ps(fn, _mm_set1_ps(ln2_lo)));
+
+		__m128 p = _mm_add_ps(_mm_set1_ps(1.3981999507e-3f), _mm_mul_ps(r, _mm_set1_ps(1.9875691500e-4f)));
+		p = _mm_add_ps(_mm_set1_ps(8.3334519073e-3f), _mm_mul_ps(r, p));
+		p = _mm_add_ps(_mm_set1_ps(4.1665795894e-2f), _mm_mul_ps(r, p));
+		p = _mm_add_ps(_mm_set1_ps(1.6666665459e-1f), _mm_mul_ps(r, p));
+		p = _mm_add_ps(_mm_set1_ps(5.0000001201e-1f), _mm_mul_ps(r, p));
+		p = _mm_add_ps(_mm_add_ps(_mm_set1_ps(1.0f), r), _mm_mul_ps(_mm_mul_ps(r, r), p));
+
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+		return _mm_mul_ps(p, scale);
+	}
+#endif
 }
 
-template<typename T>
-inline constexpr mat4_t<T> transpose(const mat4_t<T>& mat4)
+// Relative error below 3e-7 with SSE2 (hardware estimate and one Newton step), below 5e-6 without
+inline float fast_rsqrt(float x)
 {
-	mat4_t<T> newMat4 = mat4;
-	mat4[0][1] = mat4[1][0];
-	mat4[0][2] = mat4[2][0];
-	mat4[0][3] = mat4[3][0];
-	mat4[1][0] = mat4[0][1];
-	mat4[1][2] = mat4[2][1];
-	mat4[1][3] = mat4[3][1];
-	mat4[2][0] = mat4[0][2];
-	mat4[2][1] = mat4[1][2];
-	mat4[2][3] = mat4[3][2];
+#ifdef BLIB_SSE2
+	return _mm_cvtss_f32(detail::rsqrt4(_mm_set_ss(x)));
+#else
+	int32_t i;
+	memcpy(&i, &x, sizeof(i));
+	i = 0x5f375a86 - (i >> 1);
+	float y;
+	memcpy(&y, &i, sizeof(y));
+	y = y * (1.5f - 0.5f * x * y * y);
+	return y * (1.5f - 0.5f * x * y * y);
+#endif
+}
 
-	return newMat4;
+// Absolute error below 1e-7 for |x| <= 8192, reduced to [-pi/4, pi/4] by quadrant
+inline void fast_sincos(float x, float& s, float& c)
+{
+	int32_t q;
+	float r = detail::reduce_half_pi(x, q);
+	float ps = detail::sin_poly(r);
+	float pc = detail::cos_poly(r);
+	s = (q & 1) ? pc : ps;
+	c = (q & 1) ? ps : pc;
+	if (q & 2)
+		s = -s;
+	if ((q + 1) & 2)
+		c = -c;
 }
 
-// Todo: Add translate, rotate, scale here
+inline float fast_sin(float x)
+{
+	float s, c;
+	fast_sincos(x, s, c);
+	return s;
+}
 
-/*
+inline float fast_cos(float x)
+{
+	float s, c;
+	fast_sincos(x, s, c);
+	return c;
+}
 
-	Perspective projection matrix functions
+// Absolute error below 3e-7 radians, atan2(0, 0) is 0
+inline float fast_atan2(float y, float x)
+{
+	float ax = fabsf(x), ay = fabsf(y);
+	float hi = ax > ay ? ax : ay;
+	float lo = ax > ay ? ay : ax;
+	float r = detail::atan_poly(hi == 0.0f ? 0.0f : lo / hi);
+	if (ay > ax)
+		r = 1.57079632679f - r;
+	if (x < 0.0f)
+		r = 3.14159265359f - r;
+	return copysignf(r, y);
+}
 
-*/
+// Relative error below 2e-7 for x in [-87, 88], clamped to that range outside of it
+inline float fast_exp(float x)
+{
+	x = x < detail::exp_min ? detail::exp_min : (x > detail::exp_max ? detail::exp_max : x);
+	float n = detail::round_nearest(x * detail::log2e);
+	float r = (x - n * detail::ln2_hi) - n * detail::ln2_lo;
+	int32_t bits = (static_cast<int32_t>(n) + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return detail::exp_poly(r) * scale;
+}
 
-// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveRH_ZO(T fov, T aspectRatio, T near, T far)
+inline void fast_rsqrt(const float* in, float* out, size_t count)
 {
-	mat4_t<T> mat;
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+		_mm_storeu_ps(out + i, detail::rsqrt4(_mm_loadu_ps(in + i)));
+#endif
+	for (; i < count; i++)
+		out[i] = fast_rsqrt(in[i]);
+}
 
-	T g = tan(fov / 2);
-	T k = far / (far - near);
+inline void fast_sincos(const float* in, float* s, float* c, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		__m128 vs, vc;
+		detail::sincos4(_mm_loadu_ps(in + i), vs, vc);
+		_mm_storeu_ps(s + i, vs);
+		_mm_storeu_ps(c + i, vc);
+	}
+#endif
+	for (; i < count; i++)
+		fast_sincos(in[i], s[i], c[i]);
+}
 
-	mat[0][0] = g / aspectRatio;
-	mat[1][1] = g;
-	mat[2][2] = k;
-	mat[2][3] = -near * k;
-	mat[3][2] = 1;
-	mat[3][3] = 0;
+inline void fast_sin(const float* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		__m128 vs, vc;
+		detail::sincos4(_mm_loadu_ps(in + i), vs, vc);
+		_mm_storeu_ps(out + i, vs);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = fast_sin(in[i]);
+}
 
-	return mat;
+inline void fast_cos(const float* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		__m128 vs, vc;
+		detail::sincos4(_mm_loadu_ps(in + i), vs, vc);
+		_mm_storeu_ps(out + i, vc);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = fast_cos(in[i]);
 }
 
-// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveRH_ZO(T fov, T width, T height, T near, T far)
+inline void fast_atan2(const float* y, const float* x, float* out, size_t count)
 {
-	return perspectiveRH_ZO<T>(fov, width / height, near, far);
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+		_mm_storeu_ps(out + i, detail::atan2_4(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; i++)
+		out[i] = fast_atan2(y[i], x[i]);
+}
+
+inline void fast_exp(const float* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+		_mm_storeu_ps(out + i, detail::exp4(_mm_loadu_ps(in + i)));
+#endif
+	for (; i < count; i++)
+		out[i] = fast_exp(in[i]);
 }
 
-// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
-// FOV must be in radians
 template<typename T>
-constexpr mat4_t<T> perspectiveRH_NO(T fov, T aspectRatio, T near, T far)
+inline vec3_t<T> fast_normalize(const vec3_t<T>& v0)
 {
-	mat4_t<T> mat;
+	return v0 * static_cast<T>(fast_rsqrt(static_cast<float>(dot(v0, v0))));
+}
 
-	T g = tan(fov / 2);
+inline void fast_normalize(const vec3_t<float>* in, vec3_t<float>* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		alignas(16) float scale[4];
+		for (size_t k = 0; k < 4; k++)
+			scale[k] = dot(in[i + k], in[i + k]);
+		_mm_store_ps(scale, detail::rsqrt4(_mm_load_ps(scale)));
+		for (size_t k = 0; k < 4; k++)
+			out[i + k] = in[i + k] * scale[k];
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = fast_normalize(in[i]);
+}
 
-	mat[0][0] = g / aspectRatio;
-	mat[1][1] = g;
-	mat[2][2] = (far + near) / (near - far);
-	mat[2][3] = (2 * far * near) / (near - far);
-	mat[3][2] = -1;
-	mat[3][3] = 0;
+/*
 
-	return mat;
+	Packing functions
+
+	Compact encodings for storage and network: half floats, normalized integers, octahedral
+	normals and smallest-three quaternions, with quaternions stored as vec4 (x, y, z, w).
+	The array versions process four values at a time with SSE2 and give the same results
+	as the scalar versions. Rounding is to nearest, halfway cases away from zero, except for
+	half floats which round halfway cases to even like hardware conversions do.
+
+*/
+
+namespace detail
+{
+	inline uint32_t float_bits(float f)
+	{
+		uint32_t u;
+		memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	inline float bits_float(uint32_t u)
+	{
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	// Same as a > b ? a : b and a < b ? a : b, which is what maxps and minps do with NaN
+	inline float max_ps(float a, float b) { return a > b ? a : b; }
+	inline float min_ps(float a, float b) { return a < b ? a : b; }
+
+	inline int32_t quantize(float f, float lo, float scale)
+	{
+		return static_cast<int32_t>(round_nearest(min_ps(max_ps(f, lo), 1.0f) * scale));
+	}
+
+	constexpr float quat_range = 0.707106781186548f;	// Largest possible value of the three smaller components
+	constexpr float quat_scale = 1022.0f;				// Even, so zero is exact
+
+	// Sign of f with zero counting as positive
+	inline float sign_not_zero(float f)
+	{
+		return f >= 0.0f ? 1.0f : -1.0f;
+	}
+
+#ifdef BLIB_SSE2
+	inline __m128 clamp4(__m128 f, float lo)
+	{
+		return _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(lo)), _mm_set1_ps(1.0f));
+	}
+
+	// Packs 32 bit lanes holding 16 bit values, without the signed saturation of packs_epi32
+	inline __m128i pack_low16(__m128i a, __m128i b)
+	{
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		return _mm_packs_epi32(a, b);
+	}
+
+	// Algorithms from Fabian Giesen's half conversion functions
+	inline __m128i float_to_half4(__m128 f)
+	{
+		const __m128i f16max = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i min_normal = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i subnorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+
+		__m128 sign = _mm_and_ps(f, _mm_set1_ps(-0.0f));
+		__m128 absf = _mm_xor_ps(f, sign);
+		__m128i absi = _mm_castps_si128(absf);
+
+		__m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+		__m128i is_regular = _mm_cmpgt_epi32(f16max, absi);
+		__m128i is_subnormal = _mm_cmpgt_epi32(min_normal, absi);
+		__m128i inf_or_nan = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(subnorm_magic))), subnorm_magic);
+		__m128i odd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+		__m128i normal = _mm_add_epi32(absi, _mm_set1_epi32(0xfff - ((127 - 15) << 23)));
+		normal = _mm_srli_epi32(_mm_sub_epi32(normal, odd), 13);
+
+		__m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+		__m128i result = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, inf_or_nan));
+		return _mm_or_si128(result, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+	}
+
+	inline __m128 half_to_float4(__m128i h)
+	{
+		__m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+		__m128i was_inf_nan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+		__m128i extra = _mm_or_si128(sign, _mm_and_si128(was_inf_nan, _mm_set1_epi32(255 << 23)));
+		return _mm_or_ps(scaled, _mm_castsi128_ps(extra));
+	}
+
+	inline __m128 sign_not_zero4(__m128 f)
+	{
+		return select(_mm_cmpge_ps(f, _mm_setzero_ps()), _mm_set1_ps(1.0f), _mm_set1_ps(-1.0f));
+	}
+
+	inline __m128 abs4(__m128 f)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), f);
+	}
+
+	// Octahedral encoding of four normals given as x, y, z lanes, to snorm16 pairs
+	inline __m128i pack_normal4(__m128 x, __m128 y, __m128 z)
+	{
+		__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(abs4(x), abs4(y)), abs4(z)));
+		__m128 px = _mm_mul_ps(x, inv);
+		__m128 py = _mm_mul_ps(y, inv);
+		__m128 fx = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), abs4(py)), sign_not_zero4(px));
+		__m128 fy = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), abs4(px)), sign_not_zero4(py));
+		__m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+		px = select(lower, fx, px);
+		py = select(lower, fy, py);
+
+		__m128i ix = round_nearest(_mm_mul_ps(clamp4(px, -1.0f), _mm_set1_ps(32767.0f)));
+		__m128i iy = round_nearest(_mm_mul_ps(clamp4(py, -1.0f), _mm_set1_ps(32767.0f)));
+		return _mm_or_si128(_mm_and_si128(ix, _mm_set1_epi32(0xffff)), _mm_slli_epi32(iy, 16));
+	}
+
+	inline void unpack_normal4(__m128i v, __m128& x, __m128& y, __m128& z)
+	{
+		const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+		x = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(v, 16), 16)), scale), _mm_set1_ps(-1.0f));
+		y = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(v, 16)), scale), _mm_set1_ps(-1.0f));
+		z = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), abs4(x)), abs4(y));
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		__m128 t = _mm_max_ps(_mm_xor_ps(z, sign), _mm_setzero_ps());
+		x = _mm_add_ps(x, select(_mm_cmpge_ps(x, _mm_setzero_ps()), _mm_xor_ps(t, sign), t));
+		y = _mm_add_ps(y, select(_mm_cmpge_ps(y, _mm_setzero_ps()), _mm_xor_ps(t, sign), t));
+		__m128 len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len));
+		x = _mm_mul_ps(x, inv);
+		y = _mm_mul_ps(y, inv);
+		z = _mm_mul_ps(z, inv);
+	}
+
+	// Four quaternions given as x, y, z, w lanes
+	inline __m128i pack_quat4(__m128 x, __m128 y, __m128 z, __m128 w)
+	{
+		// The first largest component wins ties, like the scalar version
+		__m128 largest = abs4(x);
+		__m128i index = _mm_setzero_si128();
+		__m128 value = x;
+		__m128 m = _mm_cmpgt_ps(abs4(y), largest);
+		largest = select(m, abs4(y), largest);
+		index = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(m), index), _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(1)));
+		value = select(m, y, value);
+		m = _mm_cmpgt_ps(abs4(z), largest);
+		largest = select(m, abs4(z), largest);
+		index = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(m), index), _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(2)));
+		value = select(m, z, value);
+		m = _mm_cmpgt_ps(abs4(w), largest);
+		index = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(m), index), _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(3)));
+		value = select(m, w, value);
+
+		__m128 is0 = _mm_castsi128_ps(_mm_cmpeq_epi32(index, _mm_setzero_si128()));
+		__m128 le1 = _mm_castsi128_ps(_mm_cmplt_epi32(index, _mm_set1_epi32(2)));
+		__m128 le2 = _mm_castsi128_ps(_mm_cmplt_epi32(index, _mm_set1_epi32(3)));
+		__m128 a = select(is0, y, x);
+		__m128 b = select(le1, z, y);
+		__m128 c = select(le2, w, z);
+
+		__m128 flip = _mm_and_ps(_mm_cmplt_ps(value, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+		const __m128 scale = _mm_set1_ps(quat_scale * 0.5f / quat_range);
+		const __m128 bias = _mm_set1_ps(quat_scale * 0.5f);
+		const __m128 hi = _mm_set1_ps(quat_scale);
+		__m128i qa = round_nearest(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_xor_ps(a, flip), scale), bias), _mm_setzero_ps()), hi));
+		__m128i qb = round_nearest(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_xor_ps(b, flip), scale), bias), _mm_setzero_ps()), hi));
+		__m128i qc = round_nearest(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_xor_ps(c, flip), scale), bias), _mm_setzero_ps()), hi));
+		return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(index, 30), _mm_slli_epi32(qa, 20)), _mm_or_si128(_mm_slli_epi32(qb, 10), qc));
+	}
+
+	inline void unpack_quat4(__m128i v, __m128& x, __m128& y, __m128& z, __m128& w)
+	{
+		const __m128i mask = _mm_set1_epi32(0x3ff);
+		const __m128 scale = _mm_set1_ps(quat_range * 2.0f / quat_scale);
+		const __m128 bias = _mm_set1_ps(-quat_range);
+		__m128 a = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 20), mask)), scale), bias);
+		__m128 b = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 10), mask)), scale), bias);
+		__m128 c = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(v, mask)), scale), bias);
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+		__m128 l = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), sum), _mm_setzero_ps()));
+
+		__m128i index = _mm_srli_epi32(v, 30);
+		__m128 is0 = _mm_castsi128_ps(_mm_cmpeq_epi32(index, _mm_setzero_si128()));
+		__m128 is1 = _mm_castsi128_ps(_mm_cmpeq_epi32(index, _mm_set1_epi32(1)));
+		__m128 is2 = _mm_castsi128_ps(_mm_cmpeq_epi32(index, _mm_set1_epi32(2)));
+		__m128 is3 = _mm_castsi128_ps(_mm_cmpeq_epi32(index, _mm_set1_epi32(3)));
+		x = select(is0, l, a);
+		y = select(is0, a, select(is1, l, b));
+		z = select(is2, l, select(is3, c, b));
+		w = select(is3, l, c);
+	}
+#endif
 }
 
-// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveRH_NO(T fov, T width, T height, T near, T far)
+// IEEE half precision, overflow becomes infinity and NaN stays NaN
+inline uint16_t float_to_half(float f)
 {
-	return perspectiveRH_NO<T>(fov, width / height, near, far);
+	uint32_t u = detail::float_bits(f);
+	uint32_t sign = u & 0x80000000u;
+	u ^= sign;
+
+	uint32_t h;
+	if (u >= (127u + 16) << 23)
+		h = u > (255u << 23) ? 0x7e00 : 0x7c00;
+	else if (u < (127u - 14) << 23)
+	{
+		const uint32_t magic = ((127 - 15) + (23 - 10) + 1) << 23;
+		h = detail::float_bits(detail::bits_float(u) + detail::bits_float(magic)) - magic;
+	}
+	else
+	{
+		uint32_t odd = (u >> 13) & 1;
+		h = (u + 0xfff - ((127u - 15) << 23) + odd) >> 13;
+	}
+	return static_cast<uint16_t>(h | (sign >> 16));
 }
 
-// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1 (DirectX)
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveLH_ZO(T fov, T aspectRatio, T near, T far)
+inline float half_to_float(uint16_t h)
 {
-	mat4_t<T> mat;
+	uint32_t expmant = h & 0x7fffu;
+	float f = detail::bits_float(expmant << 13) * detail::bits_float((254u - 15) << 23);
+	uint32_t u = detail::float_bits(f);
+	if (expmant > 0x7bff)
+		u |= 255u << 23;
+	return detail::bits_float(u | (static_cast<uint32_t>(h & 0x8000u) << 16));
+}
 
-	T g = tan(fov / 2);
-	T k = far / (far - near);
+// unorm maps [0, 1] and snorm maps [-1, 1] to the full integer range, values outside are clamped
+inline uint8_t pack_unorm8(float f)
+{
+	return static_cast<uint8_t>(detail::quantize(f, 0.0f, 255.0f));
+}
 
-	mat[0][0] = -g / aspectRatio;
-	mat[1][1] = -g;
-	mat[2][2] = k;
-	mat[2][3] = -near * k;
-	mat[3][2] = 1;
-	mat[3][3] = 0;
+inline uint16_t pack_unorm16(float f)
+{
+	return static_cast<uint16_t>(detail::quantize(f, 0.0f, 65535.0f));
+}
 
-	return mat;
+inline int8_t pack_snorm8(float f)
+{
+	return static_cast<int8_t>(detail::quantize(f, -1.0f, 127.0f));
 }
 
-// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1 (DirectX)
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveLH_ZO(T fov, T width, T height, T near, T far)
+inline int16_t pack_snorm16(float f)
 {
-	return perspectiveLH_ZO<T>(fov, width / height, near, far);
+	return static_cast<int16_t>(detail::quantize(f, -1.0f, 32767.0f));
 }
 
-// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveLH_NO(T fov, T aspectRatio, T near, T far)
+inline float unpack_unorm8(uint8_t v)
 {
-	mat4_t<T> mat;
+	return v * (1.0f / 255.0f);
+}
 
-	T g = tan(fov / 2);
+inline float unpack_unorm16(uint16_t v)
+{
+	return v * (1.0f / 65535.0f);
+}
 
-	mat[0][0] = -g / aspectRatio;
-	mat[1][1] = -g;
-	mat[2][2] = (far + near) / (near - far);
-	mat[2][3] = (2 * far * near) / (near - far);
-	mat[3][2] = -1;
-	mat[3][3] = 0;
+// The most negative value maps to -1 too, so zero stays exact
+inline float unpack_snorm8(int8_t v)
+{
+	return detail::max_ps(v * (1.0f / 127.0f), -1.0f);
+}
 
-	return mat;
+inline float unpack_snorm16(int16_t v)
+{
+	return detail::max_ps(v * (1.0f / 32767.0f), -1.0f);
 }
 
-// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspectiveLH_NO(T fov, T width, T height, T near, T far)
+// Unit vector to a point in [-1, 1]^2 on the unfolded octahedron
+inline vec2_t<float> octahedral_encode(const vec3_t<float>& n)
 {
-	return perspectiveLH_NO<T>(fov, width / height, near, far);
+	float inv = 1.0f / ((fabsf(n.x) + fabsf(n.y)) + fabsf(n.z));
+	vec2_t<float> p(n.x * inv, n.y * inv);
+	if (n.z < 0.0f)
+		return { (1.0f - fabsf(p.y)) * detail::sign_not_zero(p.x), (1.0f - fabsf(p.x)) * detail::sign_not_zero(p.y) };
+	return p;
 }
 
-// By default this constructs a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspective(T fov, T aspectRatio, T near, T far)
+inline vec3_t<float> octahedral_decode(const vec2_t<float>& e)
 {
-	return perspectiveRH_NO<T>(fov, aspectRatio, near, far);
+	vec3_t<float> n(e.x, e.y, (1.0f - fabsf(e.x)) - fabsf(e.y));
+	float t = detail::max_ps(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	float inv = 1.0f / sqrtf((n.x * n.x + n.y * n.y) + n.z * n.z);
+	return { n.x * inv, n.y * inv, n.z * inv };
 }
 
-// By default this constructs a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
-// FOV must be in radians
-template<typename T>
-constexpr mat4_t<T> perspective(T fov, T width, T height, T near, T far)
+// Unit normal as two snorm16 octahedral coordinates, x in the low half.
+// The angular error is below 0.05 degrees.
+inline uint32_t pack_normal(const vec3_t<float>& n)
 {
-	return perspective<T>(fov, width / height, near, far);
+	vec2_t<float> e = octahedral_encode(n);
+	return static_cast<uint16_t>(pack_snorm16(e.x)) | (static_cast<uint32_t>(static_cast<uint16_t>(pack_snorm16(e.y))) << 16);
 }
 
-/*
+inline vec3_t<float> unpack_normal(uint32_t v)
+{
+	return octahedral_decode({ unpack_snorm16(static_cast<int16_t>(v & 0xffff)), unpack_snorm16(static_cast<int16_t>(v >> 16)) });
+}
 
-	Orthographic projection matrix functions
+// Unit quaternion as the index of its largest component in the top two bits and the
+// other three in 10 bits each, the largest is rebuilt from unit length. Stored with the
+// largest component positive, which is the same rotation. The error per component is
+// below 2e-3.
+inline uint32_t pack_quat(const vec4_t<float>& q)
+{
+	uint32_t index = 0;
+	for (uint32_t i = 1; i < 4; i++)
+		if (fabsf(q[i]) > fabsf(q[index]))
+			index = i;
+
+	const float flip = q[index] < 0.0f ? -1.0f : 1.0f;
+	const float scale = detail::quat_scale * 0.5f / detail::quat_range;
+	const float bias = detail::quat_scale * 0.5f;
+	uint32_t result = index << 30;
+	uint32_t shift = 20;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == index)
+			continue;
+		float f = detail::min_ps(detail::max_ps((q[i] * flip) * scale + bias, 0.0f), detail::quat_scale);
+		result |= static_cast<uint32_t>(detail::round_nearest(f)) << shift;
+		shift -= 10;
+	}
+	return result;
+}
 
-*/
+inline vec4_t<float> unpack_quat(uint32_t v)
+{
+	const float scale = detail::quat_range * 2.0f / detail::quat_scale;
+	float small[3];
+	for (uint32_t i = 0; i < 3; i++)
+		small[i] = static_cast<float>((v >> (20 - i * 10)) & 0x3ff) * scale + -detail::quat_range;
+	float sum = (small[0] * small[0] + small[1] * small[1]) + small[2] * small[2];
+
+	const uint32_t index = v >> 30;
+	vec4_t<float> q;
+	for (uint32_t i = 0, j = 0; i < 4; i++)
+		q[i] = i == index ? sqrtf(detail::max_ps(1.0f - sum, 0.0f)) : small[j++];
+	return q;
+}
 
+inline void float_to_half(const float* in, uint16_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i lo = detail::float_to_half4(_mm_loadu_ps(in + i));
+		__m128i hi = detail::float_to_half4(_mm_loadu_ps(in + i + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), detail::pack_low16(lo, hi));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = float_to_half(in[i]);
+}
 
-/*
+inline void half_to_float(const uint16_t* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm_storeu_ps(out + i, detail::half_to_float4(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+		_mm_storeu_ps(out + i + 4, detail::half_to_float4(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = half_to_float(in[i]);
+}
 
-	View matrix functions
+inline void pack_unorm8(const float* in, uint8_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i lo = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i), 0.0f), scale));
+		__m128i hi = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i + 4), 0.0f), scale));
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), packed);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pack_unorm8(in[i]);
+}
 
-*/
+inline void pack_unorm16(const float* in, uint16_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(65535.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i lo = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i), 0.0f), scale));
+		__m128i hi = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i + 4), 0.0f), scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), detail::pack_low16(lo, hi));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pack_unorm16(in[i]);
+}
+
+inline void pack_snorm8(const float* in, int8_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(127.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i lo = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i), -1.0f), scale));
+		__m128i hi = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i + 4), -1.0f), scale));
+		__m128i packed = _mm_packs_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), packed);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pack_snorm8(in[i]);
+}
+
+inline void pack_snorm16(const float* in, int16_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(32767.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i lo = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i), -1.0f), scale));
+		__m128i hi = detail::round_nearest(_mm_mul_ps(detail::clamp4(_mm_loadu_ps(in + i + 4), -1.0f), scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pack_snorm16(in[i]);
+}
+
+inline void unpack_unorm8(const uint8_t* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)), _mm_setzero_si128());
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128())), scale));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = unpack_unorm8(in[i]);
+}
+
+inline void unpack_unorm16(const uint16_t* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128())), scale));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = unpack_unorm16(in[i]);
+}
+
+inline void unpack_snorm8(const int8_t* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(1.0f / 127.0f);
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		// Sign extends by placing the bytes in the top of each lane and shifting back down
+		__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i));
+		v = _mm_unpacklo_epi8(v, v);
+		__m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24);
+		__m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 24);
+		_mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), lo));
+		_mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), lo));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = unpack_snorm8(in[i]);
+}
+
+inline void unpack_snorm16(const int16_t* in, float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	for (; i < (count & ~size_t(7)); i += 8)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		__m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), lo));
+		_mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), lo));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = unpack_snorm16(in[i]);
+}
+
+inline void pack_normal(const vec3_t<float>* in, uint32_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		const vec3_t<float>* n = in + i;
+		__m128 x = _mm_setr_ps(n[0].x, n[1].x, n[2].x, n[3].x);
+		__m128 y = _mm_setr_ps(n[0].y, n[1].y, n[2].y, n[3].y);
+		__m128 z = _mm_setr_ps(n[0].z, n[1].z, n[2].z, n[3].z);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), detail::pack_normal4(x, y, z));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pack_normal(in[i]);
+}
+
+inline void unpack_normal(const uint32_t* in, vec3_t<float>* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	alignas(16) float x[4], y[4], z[4];
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		__m128 vx, vy, vz;
+		detail::unpack_normal4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), vx, vy, vz);
+		_mm_store_ps(x, vx);
+		_mm_store_ps(y, vy);
+		_mm_store_ps(z, vz);
+		for (size_t k = 0; k < 4; k++)
+			out[i + k] = { x[k], y[k], z[k] };
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = unpack_normal(in[i]);
+}
+
+inline void pack_quat(const vec4_t<float>* in, uint32_t* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	static_assert(sizeof(vec4_t<float>) == 4 * sizeof(float), "vec4 is loaded as four floats");
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		const float* q = &in[i].x;
+		__m128 x = _mm_loadu_ps(q);
+		__m128 y = _mm_loadu_ps(q + 4);
+		__m128 z = _mm_loadu_ps(q + 8);
+		__m128 w = _mm_loadu_ps(q + 12);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), detail::pack_quat4(x, y, z, w));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pack_quat(in[i]);
+}
+
+inline void unpack_quat(const uint32_t* in, vec4_t<float>* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		__m128 x, y, z, w;
+		detail::unpack_quat4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), x, y, z, w);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		float* q = &out[i].x;
+		_mm_storeu_ps(q, x);
+		_mm_storeu_ps(q + 4, y);
+		_mm_storeu_ps(q + 8, z);
+		_mm_storeu_ps(q + 12, w);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = unpack_quat(in[i]);
+}
+
+/*
+
+	Large world coordinates
+
+	Positions far from the origin are kept in double precision and converted each frame to
+	float, relative to an origin near the camera, before they enter float math. The
+	difference is taken in double and rounded once, so precision depends on the distance
+	to the origin rather than to the world center. With the camera position as origin the
+	view matrix has no translation. The array versions use SSE2 and give the same results
+	as the scalar versions.
+
+*/
+
+inline vec3_t<float> to_relative(const vec3_t<double>& p, const vec3_t<double>& origin)
+{
+	return { static_cast<float>(p.x - origin.x), static_cast<float>(p.y - origin.y), static_cast<float>(p.z - origin.z) };
+}
+
+inline vec3_t<double> from_relative(const vec3_t<float>& p, const vec3_t<double>& origin)
+{
+	return { origin.x + p.x, origin.y + p.y, origin.z + p.z };
+}
+
+// Transform whose translation is in the last column, with the translation made relative to origin
+inline mat4_t<float> to_relative(const mat4_t<double>& m, const vec3_t<double>& origin)
+{
+	mat4_t<float> result;
+	for (uint32_t row = 0; row < 4; row++)
+	{
+		const vec4_t<double>& r = m.value[row];
+		double translation = row < 3 ? r.w - origin[row] : r.w;
+		result.value[row] = { static_cast<float>(r.x), static_cast<float>(r.y), static_cast<float>(r.z), static_cast<float>(translation) };
+	}
+	return result;
+}
+
+inline void to_relative(const vec3_t<double>* in, const vec3_t<double>& origin, vec3_t<float>* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	static_assert(sizeof(vec3_t<double>) == 3 * sizeof(double) && sizeof(vec3_t<float>) == 3 * sizeof(float), "vec3 is accessed as packed components");
+
+	// Four points are twelve components, the origin repeats every three pairs of them
+	const __m128d oxy = _mm_setr_pd(origin.x, origin.y);
+	const __m128d ozx = _mm_setr_pd(origin.z, origin.x);
+	const __m128d oyz = _mm_setr_pd(origin.y, origin.z);
+	for (; i < (count & ~size_t(3)); i += 4)
+	{
+		const double* p = &in[i].x;
+		float* o = &out[i].x;
+		__m128 a = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p), oxy));
+		__m128 b = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p + 2), ozx));
+		__m128 c = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p + 4), oyz));
+		__m128 d = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p + 6), oxy));
+		__m128 e = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p + 8), ozx));
+		__m128 f = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p + 10), oyz));
+		_mm_storeu_ps(o, _mm_movelh_ps(a, b));
+		_mm_storeu_ps(o + 4, _mm_movelh_ps(c, d));
+		_mm_storeu_ps(o + 8, _mm_movelh_ps(e, f));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = to_relative(in[i], origin);
+}
+
+inline void to_relative(const mat4_t<double>* in, const vec3_t<double>& origin, mat4_t<float>* out, size_t count)
+{
+	size_t i = 0;
+#ifdef BLIB_SSE2
+	static_assert(sizeof(mat4_t<double>) == 16 * sizeof(double) && sizeof(mat4_t<float>) == 16 * sizeof(float), "mat4 is accessed as packed components");
+
+	// Only the last column of the first three rows moves
+	const __m128d shift[4] = { _mm_setr_pd(0.0, origin.x), _mm_setr_pd(0.0, origin.y), _mm_setr_pd(0.0, origin.z), _mm_setzero_pd() };
+	for (; i < count; i++)
+	{
+		const double* m = &in[i].value[0].x;
+		float* o = &out[i].value[0].x;
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			__m128 xy = _mm_cvtpd_ps(_mm_loadu_pd(m + row * 4));
+			__m128 zw = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(m + row * 4 + 2), shift[row]));
+			_mm_storeu_ps(o + row * 4, _mm_movelh_ps(xy, zw));
+		}
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = to_relative(in[i], origin);
+}
+
+/*
+
+	Integer grid functions
+
+	Cell and voxel coordinate math on integer vectors: per-lane bit operators, floor
+	division to cells and Morton (Z-order) codes for spatial indexing and chunk streaming.
+	Signed coordinates are offset by half the range before encoding, so codes of nearby
+	cells stay close on both sides of zero. 2D codes hold 32 bits per axis, 3D codes 21.
+	The array versions use SSE2 and give the same results as the scalar versions.
+
+*/
+
+namespace detail
+{
+	template<typename T>
+	using integral_only = std::enable_if_t<std::is_integral_v<T>, int>;
+
+	// Keeps T deduced from the vector alone, so uvec3 & 15 compiles
+	template<typename T>
+	using non_deduced_t = std::enable_if_t<true, T>;
+}
+
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec2_t<T> operator&(const vec2_t<T>& v0, const vec2_t<T>& v1) { return { T(v0.x & v1.x), T(v0.y & v1.y) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec2_t<T> operator|(const vec2_t<T>& v0, const vec2_t<T>& v1) { return { T(v0.x | v1.x), T(v0.y | v1.y) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec2_t<T> operator^(const vec2_t<T>& v0, const vec2_t<T>& v1) { return { T(v0.x ^ v1.x), T(v0.y ^ v1.y) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec2_t<T> operator&(const vec2_t<T>& v0, detail::non_deduced_t<T> mask) { return { T(v0.x & mask), T(v0.y & mask) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec2_t<T> operator<<(const vec2_t<T>& v0, uint32_t shift) { return { T(v0.x << shift), T(v0.y << shift) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec2_t<T> operator>>(const vec2_t<T>& v0, uint32_t shift) { return { T(v0.x >> shift), T(v0.y >> shift) }; }
+
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec3_t<T> operator&(const vec3_t<T>& v0, const vec3_t<T>& v1) { return { T(v0.x & v1.x), T(v0.y & v1.y), T(v0.z & v1.z) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec3_t<T> operator|(const vec3_t<T>& v0, const vec3_t<T>& v1) { return { T(v0.x | v1.x), T(v0.y | v1.y), T(v0.z | v1.z) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec3_t<T> operator^(const vec3_t<T>& v0, const vec3_t<T>& v1) { return { T(v0.x ^ v1.x), T(v0.y ^ v1.y), T(v0.z ^ v1.z) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec3_t<T> operator&(const vec3_t<T>& v0, detail::non_deduced_t<T> mask) { return { T(v0.x & mask), T(v0.y & mask), T(v0.z & mask) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec3_t<T> operator<<(const vec3_t<T>& v0, uint32_t shift) { return { T(v0.x << shift), T(v0.y << shift), T(v0.z << shift) }; }
+template<typename T, detail::integral_only<T> = 0>
+constexpr vec3_t<T> operator>>(const vec3_t<T>& v0, uint32_t shift) { return { T(v0.x >> shift), T(v0.y >> shift), T(v0.z >> shift) }; }
+
+// Rounds toward negative infinity, so cells of negative coordinates do not fold onto cell 0.
+// divisor must be positive.
+inline int32_t floor_div(int32_t x, int32_t divisor)
+{
+	assert(divisor > 0);
+	return x / divisor - (x % divisor < 0);
+}
+
+// Position within the cell, in [0, divisor)
+inline int32_t floor_mod(int32_t x, int32_t divisor)
+{
+	assert(divisor > 0);
+	int32_t r = x % divisor;
+	return r < 0 ? r + divisor : r;
+}
+
+inline vec2_t<int32_t> floor_div(const vec2_t<int32_t>& p, int32_t divisor)
+{
+	return { floor_div(p.x, divisor), floor_div(p.y, divisor) };
+}
+
+inline vec3_t<int32_t> floor_div(const vec3_t<int32_t>& p, int32_t divisor)
+{
+	return { floor_div(p.x, divisor), floor_div(p.y, divisor), floor_div(p.z, divisor) };
+}
+
+inline vec2_t<int32_t> floor_mod(const vec2_t<int32_t>& p, int32_t divisor)
+{
+	return { floor_mod(p.x, divisor), floor_mod(p.y, divisor) };
+}
+
+inline vec3_t<int32_t> floor_mod(const vec3_t<int32_t>& p, int32_t divisor)
+{
+	return { floor_mod(p.x, divisor), floor_mod(p.y, divisor), floor_mod(p.z, divisor) };
+}
+
+namespace detail
+{
+	constexpr uint32_t morton3_bias = 1u << 20;
+
+	// Moves the low 32 bits of v to the even bits
+	inline uint64_t spread2(uint64_t v)
+	{
+		v &= 0xffffffff;
+		v = (v | v << 16) & 0x0000ffff0000ffff;
+		v = (v | v << 8) & 0x00ff00ff00ff00ff;
+		v = (v | v << 4) & 0x0f0f0f0f0f0f0f0f;
+		v = (v | v << 2) & 0x3333333333333333;
+		return (v | v << 1) & 0x5555555555555555;
+	}
+
+	inline uint32_t compact2(uint64_t v)
+	{
+		v &= 0x5555555555555555;
+		v = (v | v >> 1) & 0x3333333333333333;
+		v = (v | v >> 2) & 0x0f0f0f0f0f0f0f0f;
+		v = (v | v >> 4) & 0x00ff00ff00ff00ff;
+		v = (v | v >> 8) & 0x0000ffff0000ffff;
+		return static_cast<uint32_t>(v | v >> 16);
+	}
+
+	// Moves the low 21 bits of v to every third bit
+	inline uint64_t spread3(uint64_t v)
+	{
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x001f00000000ffff;
+		v = (v | v << 16) & 0x001f0000ff0000ff;
+		v = (v | v << 8) & 0x100f00f00f00f00f;
+		v = (v | v << 4) & 0x10c30c30c30c30c3;
+		return (v | v << 2) & 0x1249249249249249;
+	}
+
+	inline uint32_t compact3(uint64_t v)
+	{
+		v &= 0x1249249249249249;
+		v = (v | v >> 2) & 0x10c30c30c30c30c3;
+		v = (v | v >> 4) & 0x100f00f00f00f00f;
+		v = (v | v >> 8) & 0x001f0000ff0000ff;
+		v = (v | v >> 16) & 0x001f00000000ffff;
+		return static_cast<uint32_t>((v | v >> 32) & 0x1fffff);
+	}
+
+#ifdef BLIB_SSE2
+	// The same steps on two 64 bit lanes
+	inline __m128i spread2(__m128i v)
+	{
+		v = _mm_and_si128(v, _mm_set1_epi64x(0xffffffff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 16)), _mm_set1_epi64x(0x0000ffff0000ffff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 8)), _mm_set1_epi64x(0x00ff00ff00ff00ff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 4)), _mm_set1_epi64x(0x0f0f0f0f0f0f0f0f));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 2)), _mm_set1_epi64x(0x3333333333333333));
+		return _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 1)), _mm_set1_epi64x(0x5555555555555555));
+	}
+
+	// Leaves each result in the low half of its lane with the high half cleared
+	inline __m128i compact2(__m128i v)
+	{
+		v = _mm_and_si128(v, _mm_set1_epi64x(0x5555555555555555));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 1)), _mm_set1_epi64x(0x3333333333333333));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 2)), _mm_set1_epi64x(0x0f0f0f0f0f0f0f0f));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 4)), _mm_set1_epi64x(0x00ff00ff00ff00ff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 8)), _mm_set1_epi64x(0x0000ffff0000ffff));
+		return _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 16)), _mm_set1_epi64x(0xffffffff));
+	}
+
+	inline __m128i spread3(__m128i v)
+	{
+		v = _mm_and_si128(v, _mm_set1_epi64x(0x1fffff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 32)), _mm_set1_epi64x(0x001f00000000ffff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 16)), _mm_set1_epi64x(0x001f0000ff0000ff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 8)), _mm_set1_epi64x(0x100f00f00f00f00f));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 4)), _mm_set1_epi64x(0x10c30c30c30c30c3));
+		return _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 2)), _mm_set1_epi64x(0x1249249249249249));
+	}
+
+	inline __m128i compact3(__m128i v)
+	{
+		v = _mm_and_si128(v, _mm_set1_epi64x(0x1249249249249249));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 2)), _mm_set1_epi64x(0x10c30c30c30c30c3));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 4)), _mm_set1_epi64x(0x100f00f00f00f00f));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 8)), _mm_set1_epi64x(0x001f0000ff0000ff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 16)), _mm_set1_epi64x(0x001f00000000ffff));
+		return _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 32)), _mm_set1_epi64x(0x1fffff));
+	}
+
+	// Codes of two points, x and y in the low and high half of each lane
+	inline __m128i morton2(__m128i xy)
+	{
+		return _mm_or_si128(spread2(xy), _mm_slli_epi64(spread2(_mm_srli_epi64(xy, 32)), 1));
+	}
+
+	inline __m128i unmorton2(__m128i code)
+	{
+		return _mm_or_si128(compact2(code), _mm_slli_epi64(compact2(_mm_srli_epi64(code, 1)), 32));
+	}
+
+	// Codes of the two points in the low or high half of x, y and z
+	inline __m128i morton3(__m128i x, __m128i y, __m128i z)
+	{
+		return _mm_or_si128(_mm_or_si128(spread3(x), _mm_slli_epi64(spread3(y), 1)), _mm_slli_epi64(spread3(z), 2));
+	}
+
+	// Four points of three 32 bit components to one register per axis and back
+	inline void deinterleave3(const void* p, __m128i& x, __m128i& y, __m128i& z)
+	{
+		const float* f = static_cast<const float*>(p);
+		__m128 a = _mm_loadu_ps(f), b = _mm_loadu_ps(f + 4), c = _mm_loadu_ps(f + 8);
+		x = _mm_castps_si128(_mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0)));
+		y = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+		z = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0)));
+	}
+
+	inline void interleave3(__m128i xi, __m128i yi, __m128i zi, void* p)
+	{
+		__m128 x = _mm_castsi128_ps(xi), y = _mm_castsi128_ps(yi), z = _mm_castsi128_ps(zi);
+		float* f = static_cast<float*>(p);
+		_mm_storeu_ps(f, _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(f + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 2, 0)));
+		_mm_storeu_ps(f + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+
+	// Low 32 bits of the 64 bit lanes of lo and hi, in order
+	inline __m128i pack_low32(__m128i lo, __m128i hi)
+	{
+		return _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+
+	// Quotient of the two low lanes rounded down, and the remainder that goes with it.
+	// Division in double is exact enough for any int32 pair that the quotient never
+	// rounds onto the next integer.
+	inline void floor_divmod2(__m128i v, __m128d divisor, __m128i& q, __m128i& r)
+	{
+		__m128d x = _mm_cvtepi32_pd(v);
+		__m128d exact = _mm_div_pd(x, divisor);
+		__m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(exact));
+		t = _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, exact), _mm_set1_pd(1.0)));
+		q = _mm_cvttpd_epi32(t);
+		r = _mm_cvttpd_epi32(_mm_sub_pd(x, _mm_mul_pd(t, divisor)));
+	}
+#endif
+
+	// Cells of count packed components. remainder may be null.
+	inline void floor_divmod(const int32_t* in, int32_t divisor, int32_t* quotient, int32_t* remainder, size_t count)
+	{
+		assert(divisor > 0);
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		if ((divisor & (divisor - 1)) == 0)
+		{
+			// Power of two cells are a shift and a mask
+			int32_t bits = 0;
+			while ((1 << bits) != divisor)
+				bits++;
+			const __m128i shift = _mm_cvtsi32_si128(bits);
+			const __m128i mask = _mm_set1_epi32(divisor - 1);
+			for (; i < (count & ~size_t(3)); i += 4)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(quotient + i), _mm_sra_epi32(v, shift));
+				if (remainder)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(remainder + i), _mm_and_si128(v, mask));
+			}
+		}
+		else
+		{
+			const __m128d d = _mm_set1_pd(divisor);
+			for (; i < (count & ~size_t(3)); i += 4)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				__m128i q_lo, r_lo, q_hi, r_hi;
+				floor_divmod2(v, d, q_lo, r_lo);
+				floor_divmod2(_mm_unpackhi_epi64(v, v), d, q_hi, r_hi);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(quotient + i), _mm_unpacklo_epi64(q_lo, q_hi));
+				if (remainder)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(remainder + i), _mm_unpacklo_epi64(r_lo, r_hi));
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			int32_t x = in[i];
+			quotient[i] = floor_div(x, divisor);
+			if (remainder)
+				remainder[i] = floor_mod(x, divisor);
+		}
+	}
+}
+
+inline uint64_t morton_encode(const vec2_t<uint32_t>& p)
+{
+	return detail::spread2(p.x) | detail::spread2(p.y) << 1;
+}
+
+inline uint64_t morton_encode(const vec2_t<int32_t>& p)
+{
+	return morton_encode(vec2_t<uint32_t>(static_cast<uint32_t>(p.x) ^ 0x80000000u, static_cast<uint32_t>(p.y) ^ 0x80000000u));
+}
+
+// Only the low 21 bits of each component are kept
+inline uint64_t morton_encode(const vec3_t<uint32_t>& p)
+{
+	return detail::spread3(p.x) | detail::spread3(p.y) << 1 | detail::spread3(p.z) << 2;
+}
+
+// Components must be in [-2^20, 2^20)
+inline uint64_t morton_encode(const vec3_t<int32_t>& p)
+{
+	const uint32_t bias = detail::morton3_bias;
+	return morton_encode(vec3_t<uint32_t>(static_cast<uint32_t>(p.x) + bias, static_cast<uint32_t>(p.y) + bias, static_cast<uint32_t>(p.z) + bias));
+}
+
+inline void morton_decode(uint64_t code, vec2_t<uint32_t>& p)
+{
+	p = { detail::compact2(code), detail::compact2(code >> 1) };
+}
+
+inline void morton_decode(uint64_t code, vec2_t<int32_t>& p)
+{
+	p = { static_cast<int32_t>(detail::compact2(code) ^ 0x80000000u), static_cast<int32_t>(detail::compact2(code >> 1) ^ 0x80000000u) };
+}
+
+inline void morton_decode(uint64_t code, vec3_t<uint32_t>& p)
+{
+	p = { detail::compact3(code), detail::compact3(code >> 1), detail::compact3(code >> 2) };
+}
+
+inline void morton_decode(uint64_t code, vec3_t<int32_t>& p)
+{
+	const uint32_t bias = detail::morton3_bias;
+	p = { static_cast<int32_t>(detail::compact3(code) - bias), static_cast<int32_t>(detail::compact3(code >> 1) - bias), static_cast<int32_t>(detail::compact3(code >> 2) - bias) };
+}
+
+// Cell and position within the cell of each point, local may be null
+inline void floor_divmod(const vec2_t<int32_t>* in, int32_t divisor, vec2_t<int32_t>* cell, vec2_t<int32_t>* local, size_t count)
+{
+	static_assert(sizeof(vec2_t<int32_t>) == 2 * sizeof(int32_t), "vec2 is accessed as packed components");
+	detail::floor_divmod(&in->x, divisor, &cell->x, local ? &local->x : nullptr, count * 2);
+}
+
+inline void floor_divmod(const vec3_t<int32_t>* in, int32_t divisor, vec3_t<int32_t>* cell, vec3_t<int32_t>* local, size_t count)
+{
+	static_assert(sizeof(vec3_t<int32_t>) == 3 * sizeof(int32_t), "vec3 is accessed as packed components");
+	detail::floor_divmod(&in->x, divisor, &cell->x, local ? &local->x : nullptr, count * 3);
+}
+
+namespace detail
+{
+	template<typename T>
+	inline void morton_encode(const vec2_t<T>* in, uint64_t* out, size_t count)
+	{
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		static_assert(sizeof(vec2_t<T>) == 2 * sizeof(uint32_t), "vec2 is accessed as packed components");
+		const __m128i flip = _mm_set1_epi32(std::is_signed_v<T> ? int32_t(0x80000000) : 0);
+		for (; i < (count & ~size_t(3)); i += 4)
+		{
+			__m128i lo = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), flip);
+			__m128i hi = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 2)), flip);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), morton2(lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), morton2(hi));
+		}
+#endif
+		for (; i < count; i++)
+			out[i] = blib::morton_encode(in[i]);
+	}
+
+	template<typename T>
+	inline void morton_decode(const uint64_t* in, vec2_t<T>* out, size_t count)
+	{
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		const __m128i flip = _mm_set1_epi32(std::is_signed_v<T> ? int32_t(0x80000000) : 0);
+		for (; i < (count & ~size_t(3)); i += 4)
+		{
+			__m128i lo = unmorton2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+			__m128i hi = unmorton2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 2)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(lo, flip));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), _mm_xor_si128(hi, flip));
+		}
+#endif
+		for (; i < count; i++)
+			blib::morton_decode(in[i], out[i]);
+	}
+
+	template<typename T>
+	inline void morton_encode(const vec3_t<T>* in, uint64_t* out, size_t count)
+	{
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		static_assert(sizeof(vec3_t<T>) == 3 * sizeof(uint32_t), "vec3 is accessed as packed components");
+		const __m128i bias = _mm_set1_epi32(std::is_signed_v<T> ? int32_t(morton3_bias) : 0);
+		const __m128i zero = _mm_setzero_si128();
+		for (; i < (count & ~size_t(3)); i += 4)
+		{
+			__m128i x, y, z;
+			deinterleave3(in + i, x, y, z);
+			x = _mm_add_epi32(x, bias);
+			y = _mm_add_epi32(y, bias);
+			z = _mm_add_epi32(z, bias);
+			__m128i lo = morton3(_mm_unpacklo_epi32(x, zero), _mm_unpacklo_epi32(y, zero), _mm_unpacklo_epi32(z, zero));
+			__m128i hi = morton3(_mm_unpackhi_epi32(x, zero), _mm_unpackhi_epi32(y, zero), _mm_unpackhi_epi32(z, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), hi);
+		}
+#endif
+		for (; i < count; i++)
+			out[i] = blib::morton_encode(in[i]);
+	}
+
+	template<typename T>
+	inline void morton_decode(const uint64_t* in, vec3_t<T>* out, size_t count)
+	{
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		const __m128i bias = _mm_set1_epi32(std::is_signed_v<T> ? int32_t(morton3_bias) : 0);
+		for (; i < (count & ~size_t(3)); i += 4)
+		{
+			__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 2));
+			__m128i x = pack_low32(compact3(lo), compact3(hi));
+			__m128i y = pack_low32(compact3(_mm_srli_epi64(lo, 1)), compact3(_mm_srli_epi64(hi, 1)));
+			__m128i z = pack_low32(compact3(_mm_srli_epi64(lo, 2)), compact3(_mm_srli_epi64(hi, 2)));
+			interleave3(_mm_sub_epi32(x, bias), _mm_sub_epi32(y, bias), _mm_sub_epi32(z, bias), out + i);
+		}
+#endif
+		for (; i < count; i++)
+			blib::morton_decode(in[i], out[i]);
+	}
+}
+
+inline void morton_encode(const vec2_t<uint32_t>* in, uint64_t* out, size_t count) { detail::morton_encode(in, out, count); }
+inline void morton_encode(const vec2_t<int32_t>* in, uint64_t* out, size_t count) { detail::morton_encode(in, out, count); }
+inline void morton_encode(const vec3_t<uint32_t>* in, uint64_t* out, size_t count) { detail::morton_encode(in, out, count); }
+inline void morton_encode(const vec3_t<int32_t>* in, uint64_t* out, size_t count) { detail::morton_encode(in, out, count); }
+inline void morton_decode(const uint64_t* in, vec2_t<uint32_t>* out, size_t count) { detail::morton_decode(in, out, count); }
+inline void morton_decode(const uint64_t* in, vec2_t<int32_t>* out, size_t count) { detail::morton_decode(in, out, count); }
+inline void morton_decode(const uint64_t* in, vec3_t<uint32_t>* out, size_t count) { detail::morton_decode(in, out, count); }
+inline void morton_decode(const uint64_t* in, vec3_t<int32_t>* out, size_t count) { detail::morton_decode(in, out, count); }
+
+/*
+
+	Matrix functions
+
+*/
+
+template<typename T>
+inline constexpr mat3_t<T> transpose(const mat3_t<T>& mat3)
+{
+	mat3_t<T> newMat3 = mat3;
+	newMat3[0][1] = mat3[1][0];
+	newMat3[0][2] = mat3[2][0];
+	newMat3[1][0] = mat3[0][1];
+	newMat3[1][2] = mat3[2][1];
+	newMat3[2][0] = mat3[0][2];
+	newMat3[2][1] = mat3[1][2];
+
+	return newMat3;
+}
+
+template<typename T>
+inline constexpr mat4_t<T> transpose(const mat4_t<T>& mat4)
+{
+	mat4_t<T> newMat4 = mat4;
+	newMat4[0][1] = mat4[1][0];
+	newMat4[0][2] = mat4[2][0];
+	newMat4[0][3] = mat4[3][0];
+	newMat4[1][0] = mat4[0][1];
+	newMat4[1][2] = mat4[2][1];
+	newMat4[1][3] = mat4[3][1];
+	newMat4[2][0] = mat4[0][2];
+	newMat4[2][1] = mat4[1][2];
+	newMat4[2][3] = mat4[3][2];
+	newMat4[3][0] = mat4[0][3];
+	newMat4[3][1] = mat4[1][3];
+	newMat4[3][2] = mat4[2][3];
+
+	return newMat4;
+}
+
+// Matrix product m0 * m1, unlike operator* which multiplies component-wise
+template<typename T>
+inline constexpr mat4_t<T> mul(const mat4_t<T>& m0, const mat4_t<T>& m1)
+{
+	mat4_t<T> result(0);
+	for (uint32_t row = 0; row < 4; row++)
+		for (uint32_t k = 0; k < 4; k++)
+		{
+			T s = m0.value[row][k];
+			result.value[row].x += s * m1.value[k].x;
+			result.value[row].y += s * m1.value[k].y;
+			result.value[row].z += s * m1.value[k].z;
+			result.value[row].w += s * m1.value[k].w;
+		}
+	return result;
+}
+
+#ifdef BLIB_SSE2
+// Row i of the product is the sum of the rows of m1 weighted by row i of m0
+inline mat4_t<float> mul(const mat4_t<float>& m0, const mat4_t<float>& m1)
+{
+	__m128 r0 = _mm_loadu_ps(&m1.value[0].x);
+	__m128 r1 = _mm_loadu_ps(&m1.value[1].x);
+	__m128 r2 = _mm_loadu_ps(&m1.value[2].x);
+	__m128 r3 = _mm_loadu_ps(&m1.value[3].x);
+
+	mat4_t<float> result;
+	for (uint32_t row = 0; row < 4; row++)
+	{
+		const vec4_t<float>& a = m0.value[row];
+		__m128 v = _mm_mul_ps(_mm_set1_ps(a.x), r0);
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(a.y), r1));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(a.z), r2));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(a.w), r3));
+		_mm_storeu_ps(&result.value[row].x, v);
+	}
+	return result;
+}
+#endif
+
+// Transforms a column vector, m * v
+template<typename T>
+inline constexpr vec4_t<T> mul(const mat4_t<T>& m, const vec4_t<T>& v)
+{
+	return { dot(m.value[0], v), dot(m.value[1], v), dot(m.value[2], v), dot(m.value[3], v) };
+}
+
+// Todo: Add translate, rotate, scale here
+
+/*
+
+	Perspective projection matrix functions
+
+*/
+
+// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveRH_ZO(T fov, T aspectRatio, T near, T far)
+{
+	mat4_t<T> mat;
+
+	T g = 1 / tan(fov / 2);
+	T k = far / (near - far);
+
+	mat[0][0] = g / aspectRatio;
+	mat[1][1] = g;
+	mat[2][2] = k;
+	mat[2][3] = near * k;
+	mat[3][2] = -1;
+	mat[3][3] = 0;
+
+	return mat;
+}
+
+// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveRH_ZO(T fov, T width, T height, T near, T far)
+{
+	return perspectiveRH_ZO<T>(fov, width / height, near, far);
+}
+
+// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveRH_NO(T fov, T aspectRatio, T near, T far)
+{
+	mat4_t<T> mat;
+
+	T g = 1 / tan(fov / 2);
+
+	mat[0][0] = g / aspectRatio;
+	mat[1][1] = g;
+	mat[2][2] = (far + near) / (near - far);
+	mat[2][3] = (2 * far * near) / (near - far);
+	mat[3][2] = -1;
+	mat[3][3] = 0;
+
+	return mat;
+}
+
+// Creates a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveRH_NO(T fov, T width, T height, T near, T far)
+{
+	return perspectiveRH_NO<T>(fov, width / height, near, far);
+}
+
+// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1 (DirectX)
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveLH_ZO(T fov, T aspectRatio, T near, T far)
+{
+	mat4_t<T> mat;
+
+	T g = 1 / tan(fov / 2);
+	T k = far / (far - near);
+
+	mat[0][0] = g / aspectRatio;
+	mat[1][1] = g;
+	mat[2][2] = k;
+	mat[2][3] = -near * k;
+	mat[3][2] = 1;
+	mat[3][3] = 0;
+
+	return mat;
+}
+
+// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between 0 and 1 (DirectX)
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveLH_ZO(T fov, T width, T height, T near, T far)
+{
+	return perspectiveLH_ZO<T>(fov, width / height, near, far);
+}
+
+// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveLH_NO(T fov, T aspectRatio, T near, T far)
+{
+	mat4_t<T> mat;
+
+	T g = 1 / tan(fov / 2);
+
+	mat[0][0] = g / aspectRatio;
+	mat[1][1] = g;
+	mat[2][2] = (far + near) / (far - near);
+	mat[2][3] = (2 * far * near) / (near - far);
+	mat[3][2] = 1;
+	mat[3][3] = 0;
+
+	return mat;
+}
+
+// Creates a left-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspectiveLH_NO(T fov, T width, T height, T near, T far)
+{
+	return perspectiveLH_NO<T>(fov, width / height, near, far);
+}
+
+// By default this constructs a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspective(T fov, T aspectRatio, T near, T far)
+{
+	return perspectiveRH_NO<T>(fov, aspectRatio, near, far);
+}
+
+// By default this constructs a right-handed perspective projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
+// FOV must be in radians
+template<typename T>
+constexpr mat4_t<T> perspective(T fov, T width, T height, T near, T far)
+{
+	return perspective<T>(fov, width / height, near, far);
+}
+
+/*
+
+	Orthographic projection matrix functions
+
+*/
+
+// Creates a right-handed orthographic projection, with the normalized device z coordinate mapped between 0 and 1
+template<typename T>
+constexpr mat4_t<T> orthoRH_ZO(T left, T right, T bottom, T top, T near, T far)
+{
+	mat4_t<T> mat;
+
+	mat[0][0] = 2 / (right - left);
+	mat[1][1] = 2 / (top - bottom);
+	mat[2][2] = -1 / (far - near);
+	mat[0][3] = -(right + left) / (right - left);
+	mat[1][3] = -(top + bottom) / (top - bottom);
+	mat[2][3] = -near / (far - near);
+
+	return mat;
+}
+
+// Creates a right-handed orthographic projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
+template<typename T>
+constexpr mat4_t<T> orthoRH_NO(T left, T right, T bottom, T top, T near, T far)
+{
+	mat4_t<T> mat;
+
+	mat[0][0] = 2 / (right - left);
+	mat[1][1] = 2 / (top - bottom);
+	mat[2][2] = -2 / (far - near);
+	mat[0][3] = -(right + left) / (right - left);
+	mat[1][3] = -(top + bottom) / (top - bottom);
+	mat[2][3] = -(far + near) / (far - near);
+
+	return mat;
+}
+
+// Creates a left-handed orthographic projection, with the normalized device z coordinate mapped between 0 and 1 (DirectX)
+template<typename T>
+constexpr mat4_t<T> orthoLH_ZO(T left, T right, T bottom, T top, T near, T far)
+{
+	mat4_t<T> mat;
+
+	mat[0][0] = 2 / (right - left);
+	mat[1][1] = 2 / (top - bottom);
+	mat[2][2] = 1 / (far - near);
+	mat[0][3] = -(right + left) / (right - left);
+	mat[1][3] = -(top + bottom) / (top - bottom);
+	mat[2][3] = -near / (far - near);
+
+	return mat;
+}
+
+// Creates a left-handed orthographic projection, with the normalized device z coordinate mapped between -1 and 1
+template<typename T>
+constexpr mat4_t<T> orthoLH_NO(T left, T right, T bottom, T top, T near, T far)
+{
+	mat4_t<T> mat;
+
+	mat[0][0] = 2 / (right - left);
+	mat[1][1] = 2 / (top - bottom);
+	mat[2][2] = 2 / (far - near);
+	mat[0][3] = -(right + left) / (right - left);
+	mat[1][3] = -(top + bottom) / (top - bottom);
+	mat[2][3] = -(far + near) / (far - near);
+
+	return mat;
+}
+
+// By default this constructs a right-handed orthographic projection, with the normalized device z coordinate mapped between -1 and 1 (OpenGL)
+template<typename T>
+constexpr mat4_t<T> ortho(T left, T right, T bottom, T top, T near, T far)
+{
+	return orthoRH_NO<T>(left, right, bottom, top, near, far);
+}
+
+/*
+
+	View matrix functions
+
+*/
+
+// Creates a right-handed view matrix, looking down -z in view space
+template<typename T>
+inline mat4_t<T> lookAtRH(const vec3_t<T>& eye, const vec3_t<T>& center, const vec3_t<T>& up)
+{
+	vec3_t<T> f = normalize(center - eye);
+	vec3_t<T> s = normalize(cross(f, up));
+	vec3_t<T> u = cross(s, f);
+
+	mat4_t<T> mat;
+	mat[0] = vec4_t<T>(s.x, s.y, s.z, -dot(s, eye));
+	mat[1] = vec4_t<T>(u.x, u.y, u.z, -dot(u, eye));
+	mat[2] = vec4_t<T>(-f.x, -f.y, -f.z, dot(f, eye));
+	return mat;
+}
+
+// Creates a left-handed view matrix, looking down +z in view space
+template<typename T>
+inline mat4_t<T> lookAtLH(const vec3_t<T>& eye, const vec3_t<T>& center, const vec3_t<T>& up)
+{
+	vec3_t<T> f = normalize(center - eye);
+	vec3_t<T> s = normalize(cross(up, f));
+	vec3_t<T> u = cross(f, s);
+
+	mat4_t<T> mat;
+	mat[0] = vec4_t<T>(s.x, s.y, s.z, -dot(s, eye));
+	mat[1] = vec4_t<T>(u.x, u.y, u.z, -dot(u, eye));
+	mat[2] = vec4_t<T>(f.x, f.y, f.z, -dot(f, eye));
+	return mat;
+}
+
+// By default this constructs a right-handed view matrix, like perspective and ortho
+template<typename T>
+inline mat4_t<T> lookAt(const vec3_t<T>& eye, const vec3_t<T>& center, const vec3_t<T>& up)
+{
+	return lookAtRH<T>(eye, center, up);
+}
+
+/*
+
+	View-projection batches
+
+	Builders for the many views of a frame, like split-screen cameras, cube map faces
+	and shadow cascades. They take the handedness and depth range as a clip_space value
+	and produce projection * view matrices.
+
+*/
+
+enum class clip_space { rh_zo, rh_no, lh_zo, lh_no };
+
+template<typename T>
+constexpr mat4_t<T> perspective(clip_space space, T fov, T aspectRatio, T near, T far)
+{
+	switch (space)
+	{
+	case clip_space::rh_zo: return perspectiveRH_ZO<T>(fov, aspectRatio, near, far);
+	case clip_space::lh_zo: return perspectiveLH_ZO<T>(fov, aspectRatio, near, far);
+	case clip_space::lh_no: return perspectiveLH_NO<T>(fov, aspectRatio, near, far);
+	default: return perspectiveRH_NO<T>(fov, aspectRatio, near, far);
+	}
+}
+
+template<typename T>
+constexpr mat4_t<T> ortho(clip_space space, T left, T right, T bottom, T top, T near, T far)
+{
+	switch (space)
+	{
+	case clip_space::rh_zo: return orthoRH_ZO<T>(left, right, bottom, top, near, far);
+	case clip_space::lh_zo: return orthoLH_ZO<T>(left, right, bottom, top, near, far);
+	case clip_space::lh_no: return orthoLH_NO<T>(left, right, bottom, top, near, far);
+	default: return orthoRH_NO<T>(left, right, bottom, top, near, far);
+	}
+}
+
+template<typename T>
+inline mat4_t<T> lookAt(clip_space space, const vec3_t<T>& eye, const vec3_t<T>& center, const vec3_t<T>& up)
+{
+	return space == clip_space::rh_zo || space == clip_space::rh_no ? lookAtRH<T>(eye, center, up) : lookAtLH<T>(eye, center, up);
+}
+
+// A perspective camera, forward and up need not be normalized or orthogonal
+struct camera_desc
+{
+	vec3_t<float> position;
+	vec3_t<float> forward = vec3_t<float>(0.0f, 0.0f, -1.0f);
+	vec3_t<float> up = vec3_t<float>(0.0f, 1.0f, 0.0f);
+	float fov = 1.0f;		// Vertical, in radians
+	float aspectRatio = 1.0f;
+	float near = 0.1f;
+	float far = 1000.0f;
+};
+
+// out[i] = projections[i] * views[i]
+inline void view_projections(const mat4_t<float>* views, const mat4_t<float>* projections, mat4_t<float>* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = mul(projections[i], views[i]);
+}
+
+// Perspective projections only touch four entries, so the product with the view is
+// built from the scaled view rows directly
+inline void view_projections(const camera_desc* cameras, mat4_t<float>* out, size_t count, clip_space space = clip_space::rh_no)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const camera_desc& c = cameras[i];
+		mat4_t<float> view = lookAt(space, c.position, c.position + c.forward, c.up);
+		mat4_t<float> proj = perspective(space, c.fov, c.aspectRatio, c.near, c.far);
+		out[i][0] = view[0] * proj[0][0];
+		out[i][1] = view[1] * proj[1][1];
+		out[i][2] = view[2] * proj[2][2] + vec4_t<float>(0.0f, 0.0f, 0.0f, proj[2][3]);
+		out[i][3] = view[2] * proj[3][2];
+	}
+}
+
+// The six faces of a cube map at position, in the order +x, -x, +y, -y, +z, -z, with the
+// up vectors of OpenGL for right-handed spaces and of DirectX for left-handed ones
+inline void cube_view_projections(const vec3_t<float>& position, float near, float far, mat4_t<float>* out, clip_space space = clip_space::rh_no)
+{
+	const bool rh = space == clip_space::rh_zo || space == clip_space::rh_no;
+	const float s = rh ? -1.0f : 1.0f;
+	const vec3_t<float> forward[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const vec3_t<float> up[6] = { { 0, s, 0 }, { 0, s, 0 }, { 0, 0, -s }, { 0, 0, s }, { 0, s, 0 }, { 0, s, 0 } };
+
+	camera_desc faces[6];
+	for (uint32_t face = 0; face < 6; face++)
+	{
+		faces[face].position = position;
+		faces[face].forward = forward[face];
+		faces[face].up = up[face];
+		faces[face].fov = static_cast<float>(M_PI / 2);
+		faces[face].near = near;
+		faces[face].far = far;
+	}
+	view_projections(faces, out, 6, space);
+}
+
+// Split distances between near and far for count cascades, from uniform (lambda 0) to
+// logarithmic (lambda 1). splits receives count + 1 values, starting with near and ending with far.
+inline void cascade_splits(float near, float far, uint32_t count, float lambda, float* splits)
+{
+	for (uint32_t i = 0; i <= count; i++)
+	{
+		float t = static_cast<float>(i) / count;
+		float uniform = near + (far - near) * t;
+		float logarithmic = near * powf(far / near, t);
+		splits[i] = uniform + (logarithmic - uniform) * lambda;
+	}
+	splits[0] = near;
+	splits[count] = far;
+}
+
+// Fits an orthographic light view-projection around each slice [splits[i], splits[i + 1]]
+// of the camera frustum, for a directional light shining along light_direction.
+// The slices are bounded by spheres, so a cascade keeps its size as the camera turns, and
+// moved in whole shadow map texels, so shadow edges do not shimmer as the camera moves.
+// Casters up to caster_distance in front of a sphere still land in the shadow map.
+inline void fit_cascades(const camera_desc& camera, const vec3_t<float>& light_direction, const float* splits, uint32_t count,
+	uint32_t resolution, float caster_distance, mat4_t<float>* out, clip_space space = clip_space::rh_no)
+{
+	const vec3_t<float> forward = normalize(camera.forward);
+	const vec3_t<float> light = normalize(light_direction);
+	const vec3_t<float> light_up = fabsf(light.y) < 0.99f ? vec3_t<float>(0.0f, 1.0f, 0.0f) : vec3_t<float>(0.0f, 0.0f, 1.0f);
+	const float tan_y = tanf(camera.fov * 0.5f);
+	const float tan_x = tan_y * camera.aspectRatio;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		// The sphere center lies on the view axis, at the point equally far from the
+		// corners of both ends of the slice
+		const float d0 = splits[i];
+		const float d1 = splits[i + 1];
+		const float k = tan_x * tan_x + tan_y * tan_y;
+		const float d = detail::min_ps(((d0 + d1) * 0.5f) * (1.0f + k), d1);
+		const vec3_t<float> center = camera.position + forward * d;
+		const float r0 = (d - d0) * (d - d0) + d0 * d0 * k;
+		const float r1 = (d1 - d) * (d1 - d) + d1 * d1 * k;
+		// Rounded up, so the size does not flicker with float noise
+		const float radius = ceilf(sqrtf(detail::max_ps(r0, r1)) * 16.0f) / 16.0f;
+
+		const vec3_t<float> eye = center - light * (radius + caster_distance);
+		mat4_t<float> view = lookAt(space, eye, center, light_up);
+		mat4_t<float> proj = ortho(space, -radius, radius, -radius, radius, 0.0f, 2.0f * radius + caster_distance);
+		mat4_t<float> view_proj = mul(proj, view);
+
+		// Moves the projection so the world origin falls on a texel corner
+		const float texels = resolution * 0.5f;
+		const float ox = view_proj[0][3] * texels;
+		const float oy = view_proj[1][3] * texels;
+		view_proj[0][3] += (roundf(ox) - ox) / texels;
+		view_proj[1][3] += (roundf(oy) - oy) / texels;
+		out[i] = view_proj;
+	}
+}
 
 // Float vectors and matrices
 using vec2 = vec2_t<float>;
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <cstdint>
+
+// Instrumentation is compiled in only when BLIB_PROFILE is defined, otherwise the
+// macros expand to nothing and the profiler functions are empty stubs.
+#ifdef BLIB_PROFILE
+#define BLIB_PROFILE_CONCAT_(a, b) a##b
+#define BLIB_PROFILE_CONCAT(a, b) BLIB_PROFILE_CONCAT_(a, b)
+#define BLIB_PROFILE_SCOPE(name) blib::profiler::scope BLIB_PROFILE_CONCAT(blib_profile_scope_, __LINE__)(name)
+#define BLIB_PROFILE_FRAME() blib::profiler::end_frame()
+#else
+#define BLIB_PROFILE_SCOPE(name)
+#define BLIB_PROFILE_FRAME()
+#endif
+
+namespace blib::profiler
+{
+	// Time and calls of one scope or component type during a frame. For component types
+	// calls counts the components updated, as a batch is timed by a single scope.
+	struct scope_stats
+	{
+		std::string name;
+		uint64_t calls = 0;
+		double ms = 0.0;
+	};
+
+	struct frame_stats
+	{
+		uint64_t index = 0;
+		double ms = 0.0;
+		std::vector<scope_stats> scopes; // Sorted by time, most expensive first
+	};
+
+	// Aggregates the counters of all threads into the stats of the frame that just ended
+	void end_frame();
+	const frame_stats& last_frame();
+
+	// Records every scope as an individual event until end_capture, which writes them
+	// as Chrome trace JSON (chrome://tracing, Perfetto)
+	void begin_capture();
+	bool end_capture(const std::string& filename);
+}
+
+#ifdef BLIB_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "blib_fileio.h"
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+namespace blib::profiler
+{
+	// Times the enclosing block. Scopes are keyed by the address of their name, so the
+	// name must be a string literal, or by component type.
+	class scope
+	{
+	public:
+		explicit scope(const char* name);
+		explicit scope(const std::type_info& type);
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+		~scope();
+
+		// Counts the scope as this many calls, e.g. one per component a batch updated
+		void set_calls(uint64_t calls) { m_calls = calls; }
+
+	private:
+		const void* m_key;
+		bool m_is_type;
+		int64_t m_start;
+		uint64_t m_calls = 1;
+	};
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+	constexpr uint32_t max_counters = 1024;
+	constexpr uint32_t events_per_chunk = 4096;
+
+	// Counters and events are only ever written by the thread that owns them. They are
+	// published with release stores so end_frame and end_capture can read them without
+	// taking a lock on the hot path.
+	struct counter
+	{
+		const void* key = nullptr;
+		bool is_type = false;
+		std::atomic<uint64_t> ns = 0;
+		std::atomic<uint64_t> calls = 0;
+		uint64_t last_ns = 0;		// Only touched by end_frame
+		uint64_t last_calls = 0;	// Only touched by end_frame
+	};
+
+	struct event
+	{
+		const void* key;
+		bool is_type;
+		int64_t start;
+		int64_t duration;
+	};
+
+	struct event_chunk
+	{
+		event events[events_per_chunk];
+		std::atomic<uint32_t> count = 0;
+		std::atomic<event_chunk*> next = nullptr;
+	};
+
+	struct thread_data
+	{
+		uint32_t id = 0;
+		counter counters[max_counters];
+		std::atomic<uint32_t> counter_count = 0;
+		std::unordered_map<const void*, uint32_t> lookup;
+		std::unique_ptr<event_chunk> events = std::make_unique<event_chunk>();
+		event_chunk* tail = nullptr;
+		std::atomic<uint64_t> capture = 0;
+		thread_data* next = nullptr;
+	};
+
+	struct state
+	{
+		std::mutex mutex;
+		std::atomic<thread_data*> threads = nullptr;
+		std::atomic<uint32_t> thread_count = 0;
+		std::atomic<bool> capturing = false;
+		std::atomic<uint64_t> capture = 0;
+		int64_t capture_start = 0;
+		int64_t frame_start = 0;
+		frame_stats last;
+	};
+
+	inline state& get_state()
+	{
+		static state s;
+		return s;
+	}
+
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Registration is the only place that locks, once per thread
+	inline thread_data& this_thread()
+	{
+		thread_local thread_data* data = nullptr;
+		if (!data)
+		{
+			auto& s = get_state();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			data = new thread_data();
+			data->id = s.thread_count++;
+			data->tail = data->events.get();
+			data->next = s.threads.load(std::memory_order_relaxed);
+			s.threads.store(data, std::memory_order_release);
+		}
+		return *data;
+	}
+
+	inline std::string name_of(const void* key, bool is_type)
+	{
+		if (!is_type)
+			return static_cast<const char*>(key);
+
+		const char* name = static_cast<const std::type_info*>(key)->name();
+#if defined(__GNUG__)
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+		if (status == 0 && demangled)
+		{
+			std::string result = demangled;
+			free(demangled);
+			return result;
+		}
+#endif
+		return name;
+	}
+
+	// Names go into JSON strings, templates can have quotes and backslashes in them and
+	// scope names any byte
+	inline std::string escape_json(const std::string& text)
+	{
+		static const char hex[] = "0123456789abcdef";
+		std::string result;
+		result.reserve(text.size());
+		for (char c : text)
+		{
+			const unsigned char byte = static_cast<unsigned char>(c);
+			if (byte < 0x20)
+			{
+				result += "\\u00";
+				result += hex[byte >> 4];
+				result += hex[byte & 0xf];
+				continue;
+			}
+			if (c == '"' || c == '\\')
+				result += '\\';
+			result += c;
+		}
+		return result;
+	}
+
+	inline void record(const void* key, bool is_type, int64_t start, int64_t end, uint64_t calls)
+	{
+		thread_data& t = this_thread();
+
+		uint32_t index;
+		auto itr = t.lookup.find(key);
+		if (itr != t.lookup.end())
+		{
+			index = itr->second;
+		}
+		else
+		{
+			index = t.counter_count.load(std::memory_order_relaxed);
+			if (index == max_counters)
+				return;
+			t.counters[index].key = key;
+			t.counters[index].is_type = is_type;
+			t.lookup.emplace(key, index);
+			t.counter_count.store(index + 1, std::memory_order_release);
+		}
+
+		// Single writer, so a plain load and store is enough and avoids a locked add
+		auto& c = t.counters[index];
+		c.ns.store(c.ns.load(std::memory_order_relaxed) + (end - start), std::memory_order_relaxed);
+		c.calls.store(c.calls.load(std::memory_order_relaxed) + calls, std::memory_order_relaxed);
+
+		auto& s = get_state();
+		if (!s.capturing.load(std::memory_order_relaxed))
+			return;
+
+		// A new capture reuses the chunks of the previous one
+		uint64_t capture = s.capture.load(std::memory_order_acquire);
+		if (t.capture.load(std::memory_order_relaxed) != capture)
+		{
+			for (event_chunk* chunk = t.events.get(); chunk; chunk = chunk->next.load(std::memory_order_relaxed))
+				chunk->count.store(0, std::memory_order_relaxed);
+			t.tail = t.events.get();
+			t.capture.store(capture, std::memory_order_release);
+		}
+
+		uint32_t count = t.tail->count.load(std::memory_order_relaxed);
+		if (count == events_per_chunk)
+		{
+			event_chunk* next = t.tail->next.load(std::memory_order_relaxed);
+			if (!next)
+			{
+				next = new event_chunk();
+				t.tail->next.store(next, std::memory_order_release);
+			}
+			t.tail = next;
+			count = 0;
+		}
+		t.tail->events[count] = { key, is_type, start, end - start };
+		t.tail->count.store(count + 1, std::memory_order_release);
+	}
+}
+
+inline scope::scope(const char* name) : m_key(name), m_is_type(false), m_start(detail::now()) { }
+
+inline scope::scope(const std::type_info& type) : m_key(&type), m_is_type(true), m_start(detail::now()) { }
+
+inline scope::~scope()
+{
+	detail::record(m_key, m_is_type, m_start, detail::now(), m_calls);
+}
+
+inline void end_frame()
+{
+	auto& s = detail::get_state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+
+	int64_t now = detail::now();
+	frame_stats frame;
+	frame.index = s.last.index + 1;
+	frame.ms = s.frame_start ? (now - s.frame_start) / 1e6 : 0.0;
+	s.frame_start = now;
+
+	// The same scope on several threads is merged into one entry
+	std::unordered_map<const void*, size_t> merged;
+	for (auto* t = s.threads.load(std::memory_order_acquire); t; t = t->next)
+	{
+		uint32_t count = t->counter_count.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			auto& c = t->counters[i];
+			uint64_t ns = c.ns.load(std::memory_order_relaxed);
+			uint64_t calls = c.calls.load(std::memory_order_relaxed);
+			if (calls == c.last_calls)
+				continue;
+
+			auto itr = merged.find(c.key);
+			if (itr == merged.end())
+			{
+				itr = merged.emplace(c.key, frame.scopes.size()).first;
+				frame.scopes.push_back({ detail::name_of(c.key, c.is_type), 0, 0.0 });
+			}
+			frame.scopes[itr->second].calls += calls - c.last_calls;
+			frame.scopes[itr->second].ms += (ns - c.last_ns) / 1e6;
+			c.last_ns = ns;
+			c.last_calls = calls;
+		}
+	}
+
+	std::sort(frame.scopes.begin(), frame.scopes.end(), [](const scope_stats& a, const scope_stats& b) { return a.ms > b.ms; });
+	s.last = std::move(frame);
+}
+
+inline const frame_stats& last_frame()
+{
+	return detail::get_state().last;
+}
+
+inline void begin_capture()
+{
+	auto& s = detail::get_state();
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.capture_start = detail::now();
+	}
+	s.capture.fetch_add(1, std::memory_order_release);
+	s.capturing.store(true, std::memory_order_release);
+}
+
+inline bool end_capture(const std::string& filename)
+{
+	auto& s = detail::get_state();
+	s.capturing.store(false, std::memory_order_release);
+	uint64_t capture = s.capture.load(std::memory_order_acquire);
+
+	std::lock_guard<std::mutex> lock(s.mutex);
+	std::unordered_map<const void*, std::string> names;
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+	bool first = true;
+	for (auto* t = s.threads.load(std::memory_order_acquire); t; t = t->next)
+	{
+		// Threads that recorded nothing during this capture still hold the previous one
+		if (t->capture.load(std::memory_order_acquire) != capture)
+			continue;
+
+		for (auto* chunk = t->events.get(); chunk; chunk = chunk->next.load(std::memory_order_acquire))
+		{
+			uint32_t count = chunk->count.load(std::memory_order_acquire);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const auto& e = chunk->events[i];
+				auto itr = names.find(e.key);
+				if (itr == names.end())
+					itr = names.emplace(e.key, detail::escape_json(detail::name_of(e.key, e.is_type))).first;
+
+				json << (first ? "" : ",") << "\n{\"name\":\"" << itr->second
+					<< "\",\"cat\":\"" << (e.is_type ? "component" : "scope")
+					<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->id
+					<< ",\"ts\":" << (e.start - s.capture_start) / 1000.0 << ",\"dur\":" << e.duration / 1000.0 << "}";
+				first = false;
+			}
+			if (count < detail::events_per_chunk)
+				break;
+		}
+	}
+	json << "\n]}\n";
+	return io::write_text_file(json.str(), filename);
+}
+}
+
+#else
+
+namespace blib::profiler
+{
+	inline void end_frame() { }
+	inline const frame_stats& last_frame() { static frame_stats empty; return empty; }
+	inline void begin_capture() { }
+	inline bool end_capture(const std::string&) { return false; }
+}
+
+#endif
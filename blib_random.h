@@ -0,0 +1,507 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "blib_math.h"
+
+namespace blib
+{
+
+// xoshiro128** random number generator, running four independent lanes side by side
+// so bulk fills produce four values per step with SSE2. The sequence is the same with
+// or without SIMD and no matter how next and fill calls are mixed.
+//
+// Every (seed, stream) pair is its own sequence. Give each thread or job its own stream,
+// e.g. the batch index of a parallel_for, and results do not depend on scheduling.
+class rng
+{
+public:
+	explicit rng(uint64_t seed = 0, uint64_t stream = 0);
+
+	uint32_t next();
+	// Uniform in [0, 1)
+	float next_float();
+	// Uniform in [lo, hi)
+	float range(float lo, float hi);
+	// Uniform in [0, bound)
+	uint32_t below(uint32_t bound);
+
+	void fill(uint32_t* out, size_t count);
+	// Uniform in [0, 1)
+	void fill(float* out, size_t count);
+	// Uniform in [lo, hi)
+	void fill(float* out, size_t count, float lo, float hi);
+
+private:
+	void step(uint32_t* out);
+
+	alignas(16) uint32_t m_state[4][4]; // [word][lane]
+	alignas(16) uint32_t m_buffer[4];
+	uint32_t m_next = 4;
+};
+
+// Lattice noise over arrays of points, roughly in [-1, 1] with a period of 2^32 per axis.
+// Value noise blends random values at the lattice points, gradient noise (Perlin) blends
+// random gradients. Points are processed four at a time with SSE2 and every point gets
+// the same result no matter how an array is split between threads.
+float value_noise(const vec2& p, uint32_t seed = 0);
+float value_noise(const vec3& p, uint32_t seed = 0);
+float gradient_noise(const vec2& p, uint32_t seed = 0);
+float gradient_noise(const vec3& p, uint32_t seed = 0);
+
+void value_noise(const vec2* p, float* out, size_t count, uint32_t seed = 0);
+void value_noise(const vec3* p, float* out, size_t count, uint32_t seed = 0);
+void gradient_noise(const vec2* p, float* out, size_t count, uint32_t seed = 0);
+void gradient_noise(const vec3* p, float* out, size_t count, uint32_t seed = 0);
+
+// Vector valued gradient noise, every component comes from its own seed
+void gradient_noise(const vec2* p, vec2* out, size_t count, uint32_t seed = 0);
+void gradient_noise(const vec3* p, vec3* out, size_t count, uint32_t seed = 0);
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+	inline uint64_t splitmix64(uint64_t& x)
+	{
+		uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	inline uint32_t rotl(uint32_t x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+}
+
+inline rng::rng(uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed ^ (stream * 0xd1b54a32d192ed03ull);
+	for (uint32_t lane = 0; lane < 4; lane++)
+	{
+		uint64_t a = detail::splitmix64(x);
+		uint64_t b = detail::splitmix64(x);
+		m_state[0][lane] = static_cast<uint32_t>(a);
+		m_state[1][lane] = static_cast<uint32_t>(a >> 32);
+		m_state[2][lane] = static_cast<uint32_t>(b);
+		m_state[3][lane] = static_cast<uint32_t>(b >> 32);
+	}
+}
+
+inline uint32_t rng::next()
+{
+	if (m_next == 4)
+	{
+		step(m_buffer);
+		m_next = 0;
+	}
+	return m_buffer[m_next++];
+}
+
+inline float rng::next_float()
+{
+	return (next() >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float rng::range(float lo, float hi)
+{
+	return lo + (hi - lo) * next_float();
+}
+
+// Lemire's multiply and shift, the bias is below bound / 2^32
+inline uint32_t rng::below(uint32_t bound)
+{
+	return static_cast<uint32_t>((static_cast<uint64_t>(next()) * bound) >> 32);
+}
+
+inline void rng::fill(uint32_t* out, size_t count)
+{
+	size_t i = 0;
+	for (; i < count && m_next < 4; i++)
+		out[i] = m_buffer[m_next++];
+	for (; i + 4 <= count; i += 4)
+		step(out + i);
+	for (; i < count; i++)
+		out[i] = next();
+}
+
+inline void rng::fill(float* out, size_t count)
+{
+	fill(out, count, 0.0f, 1.0f);
+}
+
+inline void rng::fill(float* out, size_t count, float lo, float hi)
+{
+	// Draws into a small buffer that stays in L1, writing the floats through integer
+	// pointers would break strict aliasing
+	constexpr size_t chunk = 256;
+	alignas(16) uint32_t bits[chunk];
+
+	const float scale = (hi - lo) * (1.0f / 16777216.0f);
+	for (size_t done = 0; done < count; done += chunk)
+	{
+		const size_t n = std::min(count - done, chunk);
+		fill(bits, n);
+
+		float* target = out + done;
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		for (; i < (n & ~size_t(3)); i += 4)
+		{
+			__m128i v = _mm_srli_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(bits + i)), 8);
+			__m128 f = _mm_add_ps(_mm_set1_ps(lo), _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(scale)));
+			_mm_storeu_ps(target + i, f);
+		}
+#endif
+		for (; i < n; i++)
+		{
+			uint32_t v = bits[i] >> 8;
+			target[i] = lo + static_cast<float>(static_cast<int32_t>(v)) * scale;
+		}
+	}
+}
+
+// One xoshiro128** step of all four lanes
+inline void rng::step(uint32_t* out)
+{
+#ifdef BLIB_SSE2
+	__m128i s0 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_state[0]));
+	__m128i s1 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_state[1]));
+	__m128i s2 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_state[2]));
+	__m128i s3 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_state[3]));
+
+	// rotl(s1 * 5, 7) * 9, the multiplications as shifts and adds
+	__m128i x = _mm_add_epi32(s1, _mm_slli_epi32(s1, 2));
+	x = _mm_or_si128(_mm_slli_epi32(x, 7), _mm_srli_epi32(x, 25));
+	x = _mm_add_epi32(x, _mm_slli_epi32(x, 3));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), x);
+
+	__m128i t = _mm_slli_epi32(s1, 9);
+	s2 = _mm_xor_si128(s2, s0);
+	s3 = _mm_xor_si128(s3, s1);
+	s1 = _mm_xor_si128(s1, s2);
+	s0 = _mm_xor_si128(s0, s3);
+	s2 = _mm_xor_si128(s2, t);
+	s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+	_mm_store_si128(reinterpret_cast<__m128i*>(m_state[0]), s0);
+	_mm_store_si128(reinterpret_cast<__m128i*>(m_state[1]), s1);
+	_mm_store_si128(reinterpret_cast<__m128i*>(m_state[2]), s2);
+	_mm_store_si128(reinterpret_cast<__m128i*>(m_state[3]), s3);
+#else
+	for (uint32_t lane = 0; lane < 4; lane++)
+	{
+		uint32_t* s[4] = { &m_state[0][lane], &m_state[1][lane], &m_state[2][lane], &m_state[3][lane] };
+		out[lane] = detail::rotl(*s[1] * 5, 7) * 9;
+		uint32_t t = *s[1] << 9;
+		*s[2] ^= *s[0];
+		*s[3] ^= *s[1];
+		*s[1] ^= *s[2];
+		*s[0] ^= *s[3];
+		*s[2] ^= t;
+		*s[3] = detail::rotl(*s[3], 11);
+	}
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Noise
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+	// The noise kernels are written once against these operations, for single floats
+	// and, with SSE2, for four lanes at a time. Both evaluate the same float operations
+	// in the same order, so they agree bit for bit.
+	struct scalar_ops
+	{
+		using f = float;
+		using u = uint32_t;
+		using mask = bool;
+
+		static u mul(u a, u b) { return a * b; }
+		static u add(u a, uint32_t b) { return a + b; }
+		static u xor_(u a, u b) { return a ^ b; }
+		static u shr(u a, int n) { return a >> n; }
+		static u splat(uint32_t v) { return v; }
+		static mask bits_equal(u h, uint32_t bits, uint32_t value) { return (h & bits) == value; }
+		static f select(mask m, f a, f b) { return m ? a : b; }
+		static f neg_if(mask m, f a) { return m ? -a : a; }
+		static f fadd(f a, f b) { return a + b; }
+		static f fsub(f a, f b) { return a - b; }
+		static f fmul(f a, f b) { return a * b; }
+		static f fsplat(float v) { return v; }
+
+		// Lattice cell and position in it, floor without calling floorf
+		static void split(f x, u& cell, f& frac)
+		{
+			int32_t i = static_cast<int32_t>(x);
+			if (static_cast<float>(i) > x)
+				i--;
+			cell = static_cast<uint32_t>(i);
+			frac = x - static_cast<float>(i);
+		}
+
+		// Top 24 bits to [-1, 1)
+		static f unit(u h)
+		{
+			return static_cast<float>(static_cast<int32_t>(h >> 8)) * (2.0f / 16777216.0f) - 1.0f;
+		}
+	};
+
+#ifdef BLIB_SSE2
+	struct sse2_ops
+	{
+		using f = __m128;
+		using u = __m128i;
+		using mask = __m128;
+
+		// 32 bit low multiply from the two 32x32 -> 64 bit multiplies of SSE2
+		static u mul(u a, u b)
+		{
+			__m128i even = _mm_mul_epu32(a, b);
+			__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+			return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+		}
+		static u add(u a, uint32_t b) { return _mm_add_epi32(a, _mm_set1_epi32(static_cast<int32_t>(b))); }
+		static u xor_(u a, u b) { return _mm_xor_si128(a, b); }
+		static u shr(u a, int n) { return _mm_srli_epi32(a, n); }
+		static u splat(uint32_t v) { return _mm_set1_epi32(static_cast<int32_t>(v)); }
+		static mask bits_equal(u h, uint32_t bits, uint32_t value)
+		{
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(h, splat(bits)), splat(value)));
+		}
+		static f select(mask m, f a, f b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+		static f neg_if(mask m, f a) { return _mm_xor_ps(a, _mm_and_ps(m, _mm_set1_ps(-0.0f))); }
+		static f fadd(f a, f b) { return _mm_add_ps(a, b); }
+		static f fsub(f a, f b) { return _mm_sub_ps(a, b); }
+		static f fmul(f a, f b) { return _mm_mul_ps(a, b); }
+		static f fsplat(float v) { return _mm_set1_ps(v); }
+
+		static void split(f x, u& cell, f& frac)
+		{
+			__m128i i = _mm_cvttps_epi32(x);
+			__m128 fi = _mm_cvtepi32_ps(i);
+			i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(fi, x)));
+			cell = i;
+			frac = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+		}
+
+		static f unit(u h)
+		{
+			__m128 v = _mm_cvtepi32_ps(_mm_srli_epi32(h, 8));
+			return _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(2.0f / 16777216.0f)), _mm_set1_ps(1.0f));
+		}
+	};
+#endif
+
+	template<class O>
+	inline typename O::u lattice_hash(typename O::u x, typename O::u y, typename O::u z, typename O::u seed)
+	{
+		typename O::u h = O::xor_(O::xor_(O::mul(x, O::splat(0x8da6b343u)), O::mul(y, O::splat(0xd8163841u))), O::mul(z, O::splat(0xcb1ab31fu)));
+		h = O::xor_(h, seed);
+		h = O::xor_(h, O::shr(h, 15));
+		h = O::mul(h, O::splat(0x2c1b3c6du));
+		h = O::xor_(h, O::shr(h, 12));
+		h = O::mul(h, O::splat(0x297a2d39u));
+		return O::xor_(h, O::shr(h, 15));
+	}
+
+	// Quintic fade, 6t^5 - 15t^4 + 10t^3
+	template<class O>
+	inline typename O::f fade(typename O::f t)
+	{
+		typename O::f p = O::fadd(O::fmul(t, O::fsub(O::fmul(t, O::fsplat(6.0f)), O::fsplat(15.0f))), O::fsplat(10.0f));
+		return O::fmul(O::fmul(O::fmul(t, t), t), p);
+	}
+
+	template<class O>
+	inline typename O::f lerp(typename O::f a, typename O::f b, typename O::f t)
+	{
+		return O::fadd(a, O::fmul(t, O::fsub(b, a)));
+	}
+
+	// Dot product of one of the eight directions (+-1, +-1), (+-1, 0), (0, +-1) with (x, y)
+	template<class O>
+	inline typename O::f grad2(typename O::u h, typename O::f x, typename O::f y)
+	{
+		typename O::f gx = O::select(O::bits_equal(h, 6, 6), O::fsplat(0.0f), x);
+		typename O::f gy = O::select(O::bits_equal(h, 6, 4), O::fsplat(0.0f), y);
+		return O::fadd(O::neg_if(O::bits_equal(h, 1, 1), gx), O::neg_if(O::bits_equal(h, 8, 8), gy));
+	}
+
+	// Perlin's twelve cube edge directions, picked from the low four bits
+	template<class O>
+	inline typename O::f grad3(typename O::u h, typename O::f x, typename O::f y, typename O::f z)
+	{
+		typename O::f u = O::select(O::bits_equal(h, 8, 0), x, y);
+		typename O::f v = O::select(O::bits_equal(h, 12, 0), y, O::select(O::bits_equal(h, 13, 12), x, z));
+		return O::fadd(O::neg_if(O::bits_equal(h, 1, 1), u), O::neg_if(O::bits_equal(h, 2, 2), v));
+	}
+
+	template<class O>
+	inline typename O::f value_noise2(typename O::f x, typename O::f y, typename O::u seed)
+	{
+		typename O::u ix, iy;
+		typename O::f fx, fy;
+		O::split(x, ix, fx);
+		O::split(y, iy, fy);
+		const typename O::u z = O::splat(0);
+		const typename O::u ix1 = O::add(ix, 1), iy1 = O::add(iy, 1);
+
+		typename O::f u = fade<O>(fx), v = fade<O>(fy);
+		typename O::f a = lerp<O>(O::unit(lattice_hash<O>(ix, iy, z, seed)), O::unit(lattice_hash<O>(ix1, iy, z, seed)), u);
+		typename O::f b = lerp<O>(O::unit(lattice_hash<O>(ix, iy1, z, seed)), O::unit(lattice_hash<O>(ix1, iy1, z, seed)), u);
+		return lerp<O>(a, b, v);
+	}
+
+	template<class O>
+	inline typename O::f value_noise3(typename O::f x, typename O::f y, typename O::f z, typename O::u seed)
+	{
+		typename O::u ix, iy, iz;
+		typename O::f fx, fy, fz;
+		O::split(x, ix, fx);
+		O::split(y, iy, fy);
+		O::split(z, iz, fz);
+		const typename O::u ix1 = O::add(ix, 1), iy1 = O::add(iy, 1), iz1 = O::add(iz, 1);
+
+		typename O::f u = fade<O>(fx), v = fade<O>(fy), w = fade<O>(fz);
+		typename O::f a = lerp<O>(O::unit(lattice_hash<O>(ix, iy, iz, seed)), O::unit(lattice_hash<O>(ix1, iy, iz, seed)), u);
+		typename O::f b = lerp<O>(O::unit(lattice_hash<O>(ix, iy1, iz, seed)), O::unit(lattice_hash<O>(ix1, iy1, iz, seed)), u);
+		typename O::f c = lerp<O>(O::unit(lattice_hash<O>(ix, iy, iz1, seed)), O::unit(lattice_hash<O>(ix1, iy, iz1, seed)), u);
+		typename O::f d = lerp<O>(O::unit(lattice_hash<O>(ix, iy1, iz1, seed)), O::unit(lattice_hash<O>(ix1, iy1, iz1, seed)), u);
+		return lerp<O>(lerp<O>(a, b, v), lerp<O>(c, d, v), w);
+	}
+
+	template<class O>
+	inline typename O::f gradient_noise2(typename O::f x, typename O::f y, typename O::u seed)
+	{
+		typename O::u ix, iy;
+		typename O::f fx, fy;
+		O::split(x, ix, fx);
+		O::split(y, iy, fy);
+		const typename O::u z = O::splat(0);
+		const typename O::u ix1 = O::add(ix, 1), iy1 = O::add(iy, 1);
+		const typename O::f one = O::fsplat(1.0f);
+		const typename O::f fx1 = O::fsub(fx, one), fy1 = O::fsub(fy, one);
+
+		typename O::f u = fade<O>(fx), v = fade<O>(fy);
+		typename O::f a = lerp<O>(grad2<O>(lattice_hash<O>(ix, iy, z, seed), fx, fy), grad2<O>(lattice_hash<O>(ix1, iy, z, seed), fx1, fy), u);
+		typename O::f b = lerp<O>(grad2<O>(lattice_hash<O>(ix, iy1, z, seed), fx, fy1), grad2<O>(lattice_hash<O>(ix1, iy1, z, seed), fx1, fy1), u);
+		return lerp<O>(a, b, v);
+	}
+
+	template<class O>
+	inline typename O::f gradient_noise3(typename O::f x, typename O::f y, typename O::f z, typename O::u seed)
+	{
+		typename O::u ix, iy, iz;
+		typename O::f fx, fy, fz;
+		O::split(x, ix, fx);
+		O::split(y, iy, fy);
+		O::split(z, iz, fz);
+		const typename O::u ix1 = O::add(ix, 1), iy1 = O::add(iy, 1), iz1 = O::add(iz, 1);
+		const typename O::f one = O::fsplat(1.0f);
+		const typename O::f fx1 = O::fsub(fx, one), fy1 = O::fsub(fy, one), fz1 = O::fsub(fz, one);
+
+		typename O::f u = fade<O>(fx), v = fade<O>(fy), w = fade<O>(fz);
+		typename O::f a = lerp<O>(grad3<O>(lattice_hash<O>(ix, iy, iz, seed), fx, fy, fz), grad3<O>(lattice_hash<O>(ix1, iy, iz, seed), fx1, fy, fz), u);
+		typename O::f b = lerp<O>(grad3<O>(lattice_hash<O>(ix, iy1, iz, seed), fx, fy1, fz), grad3<O>(lattice_hash<O>(ix1, iy1, iz, seed), fx1, fy1, fz), u);
+		typename O::f c = lerp<O>(grad3<O>(lattice_hash<O>(ix, iy, iz1, seed), fx, fy, fz1), grad3<O>(lattice_hash<O>(ix1, iy, iz1, seed), fx1, fy, fz1), u);
+		typename O::f d = lerp<O>(grad3<O>(lattice_hash<O>(ix, iy1, iz1, seed), fx, fy1, fz1), grad3<O>(lattice_hash<O>(ix1, iy1, iz1, seed), fx1, fy1, fz1), u);
+		return lerp<O>(lerp<O>(a, b, v), lerp<O>(c, d, v), w);
+	}
+
+	// Runs a kernel over an array of points with stride floats between them, four at a
+	// time where possible. store(i, value) writes the result of point i.
+	template<uint32_t Dims, class Kernel, class Store>
+	inline void noise_batch(const float* points, size_t stride, size_t count, uint32_t seed, Kernel kernel, Store store)
+	{
+		size_t i = 0;
+#ifdef BLIB_SSE2
+		alignas(16) float result[4];
+		for (; i < (count & ~size_t(3)); i += 4)
+		{
+			const float* p = points + i * stride;
+			__m128 x = _mm_setr_ps(p[0], p[stride], p[2 * stride], p[3 * stride]);
+			__m128 y = _mm_setr_ps(p[1], p[stride + 1], p[2 * stride + 1], p[3 * stride + 1]);
+			__m128 z = Dims == 3 ? _mm_setr_ps(p[2], p[stride + 2], p[2 * stride + 2], p[3 * stride + 2]) : _mm_setzero_ps();
+			_mm_store_ps(result, kernel(sse2_ops(), x, y, z, sse2_ops::splat(seed)));
+			for (size_t k = 0; k < 4; k++)
+				store(i + k, result[k]);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			const float* p = points + i * stride;
+			store(i, kernel(scalar_ops(), p[0], p[1], Dims == 3 ? p[2] : 0.0f, seed));
+		}
+	}
+
+	// Seeds of the components of vector valued noise
+	constexpr uint32_t component_seed[3] = { 0x00000000u, 0x68e31da4u, 0xb5297a4du };
+}
+
+#define BLIB_NOISE_KERNEL(name, ...) [](auto ops, auto x, auto y, auto z, auto seed) { using O = decltype(ops); (void)z; return detail::name<O>(__VA_ARGS__, seed); }
+
+inline float value_noise(const vec2& p, uint32_t seed)
+{
+	return detail::value_noise2<detail::scalar_ops>(p.x, p.y, seed);
+}
+
+inline float value_noise(const vec3& p, uint32_t seed)
+{
+	return detail::value_noise3<detail::scalar_ops>(p.x, p.y, p.z, seed);
+}
+
+inline float gradient_noise(const vec2& p, uint32_t seed)
+{
+	return detail::gradient_noise2<detail::scalar_ops>(p.x, p.y, seed);
+}
+
+inline float gradient_noise(const vec3& p, uint32_t seed)
+{
+	return detail::gradient_noise3<detail::scalar_ops>(p.x, p.y, p.z, seed);
+}
+
+inline void value_noise(const vec2* p, float* out, size_t count, uint32_t seed)
+{
+	detail::noise_batch<2>(&p->x, 2, count, seed, BLIB_NOISE_KERNEL(value_noise2, x, y), [=](size_t i, float v) { out[i] = v; });
+}
+
+inline void value_noise(const vec3* p, float* out, size_t count, uint32_t seed)
+{
+	detail::noise_batch<3>(&p->x, 3, count, seed, BLIB_NOISE_KERNEL(value_noise3, x, y, z), [=](size_t i, float v) { out[i] = v; });
+}
+
+inline void gradient_noise(const vec2* p, float* out, size_t count, uint32_t seed)
+{
+	detail::noise_batch<2>(&p->x, 2, count, seed, BLIB_NOISE_KERNEL(gradient_noise2, x, y), [=](size_t i, float v) { out[i] = v; });
+}
+
+inline void gradient_noise(const vec3* p, float* out, size_t count, uint32_t seed)
+{
+	detail::noise_batch<3>(&p->x, 3, count, seed, BLIB_NOISE_KERNEL(gradient_noise3, x, y, z), [=](size_t i, float v) { out[i] = v; });
+}
+
+inline void gradient_noise(const vec2* p, vec2* out, size_t count, uint32_t seed)
+{
+	for (uint32_t c = 0; c < 2; c++)
+		detail::noise_batch<2>(&p->x, 2, count, seed ^ detail::component_seed[c], BLIB_NOISE_KERNEL(gradient_noise2, x, y), [=](size_t i, float v) { out[i][c] = v; });
+}
+
+inline void gradient_noise(const vec3* p, vec3* out, size_t count, uint32_t seed)
+{
+	for (uint32_t c = 0; c < 3; c++)
+		detail::noise_batch<3>(&p->x, 3, count, seed ^ detail::component_seed[c], BLIB_NOISE_KERNEL(gradient_noise3, x, y, z), [=](size_t i, float v) { out[i][c] = v; });
+}
+
+#undef BLIB_NOISE_KERNEL
+
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include "blib_ec.h"
+
+namespace blib
+{
+
+// Records a session of an entity_container into a compact binary log that replays
+// bit identically, for reproducing desyncs.
+//
+// The log starts with a snapshot of the world and then holds, in order, the structural
+// commands and application inputs of every frame, followed by its dt and state hash.
+// Only registered components are captured (see register_component), so all state that
+// matters must live in registered components or be rebuilt from inputs. Replays must run
+// the same build, floating point results are not portable between compilers or targets.
+class replay_recorder
+{
+public:
+	// Turns on deterministic mode and records the current state of world as the start
+	explicit replay_recorder(entity_container& world);
+
+	// Structural changes go through the recorder, which applies and logs them
+	entity& create();
+	void destroy(entity_id id);
+	template<class T, typename... Args>
+	T& create_component(entity_id id, Args&&... args);
+	template<class T>
+	void destroy_component(entity_id id);
+
+	// Application defined input, handed to the input handler of replay as is.
+	// The application applies it to the world itself.
+	void input(const void* data, size_t size);
+	template<class T>
+	void input(const T& value);
+
+	// Updates the world and closes the frame with its state hash
+	void update(float dt);
+
+	uint64_t frames() const { return m_frames; }
+	const std::vector<char>& data() const { return m_log.data(); }
+	bool save(const std::string& filename) const;
+
+private:
+	entity_container& m_world;
+	io::binary_writer m_log;
+	uint64_t m_frames = 0;
+};
+
+struct replay_result
+{
+	bool complete = false;				// The whole log was read and replayed
+	uint64_t frames = 0;				// Frames replayed
+	uint64_t first_mismatch = ~0ull;	// First frame whose state differs from the recording
+	bool ok() const { return complete && first_mismatch == ~0ull; }
+};
+
+using replay_input_handler = std::function<void(entity_container& world, io::binary_reader& input)>;
+
+// Re-runs a log on world, replacing its contents, as fast as possible and without any
+// waits. Stops at the first frame whose state hash or created ids differ.
+replay_result replay(io::binary_reader& log, entity_container& world, const replay_input_handler& on_input = {});
+replay_result replay(const std::string& filename, entity_container& world, const replay_input_handler& on_input = {});
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+	constexpr uint32_t replay_magic = 0x50524c42; // "BLRP"
+	constexpr uint32_t replay_version = 1;
+
+	enum class replay_record : uint8_t
+	{
+		create,				// id
+		destroy,			// id
+		add_component,		// id, type hash, payload size, payload
+		remove_component,	// id, type hash
+		input,				// size, bytes
+		update				// dt, state hash
+	};
+}
+
+inline replay_recorder::replay_recorder(entity_container& world) : m_world(world)
+{
+	m_world.set_deterministic(true);
+
+	io::binary_writer snapshot;
+	m_world.write_snapshot(snapshot);
+	m_log.write(detail::replay_magic);
+	m_log.write(detail::replay_version);
+	m_log.write(static_cast<uint64_t>(snapshot.size()));
+	m_log.write(snapshot.data().data(), snapshot.size());
+}
+
+inline entity& replay_recorder::create()
+{
+	entity& e = m_world.create();
+	m_log.write(detail::replay_record::create);
+	m_log.write(e.id().id);
+	return e;
+}
+
+inline void replay_recorder::destroy(entity_id id)
+{
+	m_world.destroy(id);
+	m_log.write(detail::replay_record::destroy);
+	m_log.write(id.id);
+}
+
+// The component is logged with its state right after construction
+template<class T, typename... Args>
+inline T& replay_recorder::create_component(entity_id id, Args&&... args)
+{
+	auto* info = component_registry::find(typeid(T));
+	assert(info != nullptr && "Recorded components must be registered");
+
+	T& c = m_world.get(id).create_component<T>(std::forward<Args>(args)...);
+	m_log.write(detail::replay_record::add_component);
+	m_log.write(id.id);
+	m_log.write(info ? info->hash : 0);
+	size_t size_offset = m_log.size();
+	m_log.write(uint32_t(0));
+	c.serialize(m_log);
+	m_log.patch(size_offset, static_cast<uint32_t>(m_log.size() - size_offset - sizeof(uint32_t)));
+	return c;
+}
+
+template<class T>
+inline void replay_recorder::destroy_component(entity_id id)
+{
+	auto* info = component_registry::find(typeid(T));
+	assert(info != nullptr && "Recorded components must be registered");
+
+	m_world.get(id).destroy_component<T>();
+	m_log.write(detail::replay_record::remove_component);
+	m_log.write(id.id);
+	m_log.write(info ? info->hash : 0);
+}
+
+inline void replay_recorder::input(const void* data, size_t size)
+{
+	m_log.write(detail::replay_record::input);
+	m_log.write(static_cast<uint32_t>(size));
+	m_log.write(data, size);
+}
+
+template<class T>
+inline void replay_recorder::input(const T& value)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "Input is logged as raw bytes");
+	input(&value, sizeof(T));
+}
+
+inline void replay_recorder::update(float dt)
+{
+	m_world.update(dt);
+	m_log.write(detail::replay_record::update);
+	m_log.write(dt);
+	m_log.write(m_world.state_hash());
+	m_frames++;
+}
+
+inline bool replay_recorder::save(const std::string& filename) const
+{
+	return io::write_binary_file(m_log.data(), filename);
+}
+
+inline replay_result replay(io::binary_reader& log, entity_container& world, const replay_input_handler& on_input)
+{
+	replay_result result;
+
+	uint32_t magic = 0, version = 0;
+	uint64_t snapshot_size = 0;
+	if (!log.read(magic) || magic != detail::replay_magic || !log.read(version) || version != detail::replay_version)
+		return result;
+	if (!log.read(snapshot_size) || snapshot_size > log.remaining())
+		return result;
+
+	io::binary_reader snapshot(log.current(), snapshot_size);
+	if (!world.read_snapshot(snapshot))
+		return result;
+	log.skip(snapshot_size);
+	world.set_deterministic(true);
+
+	while (log.good() && log.remaining() > 0)
+	{
+		detail::replay_record record;
+		uint64_t id = 0, hash = 0;
+		uint32_t size = 0;
+		log.read(record);
+		switch (record)
+		{
+		case detail::replay_record::create:
+			log.read(id);
+			if (world.create().id().id != id)
+			{
+				result.first_mismatch = result.frames;
+				return result;
+			}
+			break;
+
+		case detail::replay_record::destroy:
+			log.read(id);
+			world.destroy({ id });
+			break;
+
+		case detail::replay_record::add_component:
+		{
+			log.read(id);
+			log.read(hash);
+			log.read(size);
+			if (!log.good() || size > log.remaining())
+				return result;
+
+			auto* info = component_registry::find(hash);
+			auto* e = world.try_get({ id });
+			if (info && e && e->valid())
+			{
+				io::binary_reader payload(log.current(), size);
+				info->add(*e).deserialize(payload);
+			}
+			log.skip(size);
+			break;
+		}
+
+		case detail::replay_record::remove_component:
+		{
+			log.read(id);
+			log.read(hash);
+			auto* info = component_registry::find(hash);
+			auto* e = world.try_get({ id });
+			if (info && e && e->valid())
+				info->remove(*e);
+			break;
+		}
+
+		case detail::replay_record::input:
+			log.read(size);
+			if (!log.good() || size > log.remaining())
+				return result;
+			if (on_input)
+			{
+				io::binary_reader input(log.current(), size);
+				on_input(world, input);
+			}
+			log.skip(size);
+			break;
+
+		case detail::replay_record::update:
+		{
+			float dt = 0.0f;
+			log.read(dt);
+			log.read(hash);
+			if (!log.good())
+				return result;
+
+			world.update(dt);
+			if (world.state_hash() != hash)
+			{
+				result.first_mismatch = result.frames;
+				return result;
+			}
+			result.frames++;
+			break;
+		}
+
+		default:
+			return result;
+		}
+	}
+
+	result.complete = log.good();
+	return result;
+}
+
+inline replay_result replay(const std::string& filename, entity_container& world, const replay_input_handler& on_input)
+{
+	io::mapped_file file(filename);
+	if (!file.is_open())
+		return {};
+
+	io::binary_reader log(file.data(), file.size());
+	return replay(log, world, on_input);
+}
+
+}
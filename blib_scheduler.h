@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cassert>
+
+namespace blib
+{
+
+// Runs groups of systems at fixed rates, driven by the variable frame time.
+// Every group keeps its own clock, so AI can tick at 10 Hz while physics runs at 60 Hz.
+// Steps of all groups are executed in the order of their simulated time, which keeps
+// the result independent of how real time happens to be sliced into frames.
+class frame_scheduler
+{
+public:
+	using system = std::function<void(float dt)>;
+	using group_id = uint32_t;
+
+	// No group runs more than max_steps steps per frame, any time beyond that is dropped
+	explicit frame_scheduler(uint32_t max_steps = 4) : m_max_steps(max_steps) { }
+
+	// The phase (0..1 of a step) offsets when a group ticks. Giving low frequency groups
+	// with the same rate different phases spreads their work across frames.
+	group_id add_group(const std::string& name, float rate_hz, float phase = 0.0f);
+	void add_system(group_id group, system fn);
+	void set_rate(group_id group, float rate_hz);
+	void set_max_steps(uint32_t max_steps) { m_max_steps = max_steps; }
+
+	// Advances real time by dt seconds and runs every step that became due
+	void advance(float dt);
+
+	// How far the group is between its last and its next step, in 0..1, for interpolating state
+	float alpha(group_id group) const;
+	float step(group_id group) const { return static_cast<float>(m_groups[group].step); }
+	uint64_t steps(group_id group) const { return m_groups[group].steps; }
+	uint64_t dropped_steps(group_id group) const { return m_groups[group].dropped; }
+	const std::string& name(group_id group) const { return m_groups[group].name; }
+	double time() const { return m_time; }
+
+private:
+	struct group
+	{
+		std::string name;
+		std::vector<system> systems;
+		double step = 0.0;
+		double next = 0.0;
+		uint64_t steps = 0;
+		uint64_t dropped = 0;
+		uint32_t frame_steps = 0;
+	};
+
+	std::vector<group> m_groups;
+	double m_time = 0.0;
+	uint32_t m_max_steps = 4;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+inline frame_scheduler::group_id frame_scheduler::add_group(const std::string& name, float rate_hz, float phase)
+{
+	assert(rate_hz > 0.0f);
+	group g;
+	g.name = name;
+	g.step = 1.0 / rate_hz;
+	g.next = m_time + g.step * (1.0 + phase);
+	m_groups.push_back(std::move(g));
+	return static_cast<group_id>(m_groups.size() - 1);
+}
+
+inline void frame_scheduler::add_system(group_id group, system fn)
+{
+	m_groups[group].systems.push_back(std::move(fn));
+}
+
+inline void frame_scheduler::set_rate(group_id group, float rate_hz)
+{
+	assert(rate_hz > 0.0f);
+	auto& g = m_groups[group];
+	double last = g.next - g.step;
+	g.step = 1.0 / rate_hz;
+	g.next = last + g.step;
+}
+
+inline void frame_scheduler::advance(float dt)
+{
+	m_time += dt;
+	for (auto& g : m_groups)
+		g.frame_steps = 0;
+
+	while (true)
+	{
+		// Earliest due step first, ties go to the group added first
+		group* due = nullptr;
+		for (auto& g : m_groups)
+			if (g.next <= m_time && g.frame_steps < m_max_steps && (!due || g.next < due->next))
+				due = &g;
+		if (!due)
+			break;
+
+		float step = static_cast<float>(due->step);
+		for (auto& fn : due->systems)
+			fn(step);
+
+		due->next += due->step;
+		due->steps++;
+		due->frame_steps++;
+	}
+
+	// Groups that hit the catch-up limit drop whole steps, so they keep their phase
+	for (auto& g : m_groups)
+		while (g.next <= m_time)
+		{
+			g.next += g.step;
+			g.dropped++;
+		}
+}
+
+inline float frame_scheduler::alpha(group_id group) const
+{
+	const auto& g = m_groups[group];
+	double a = (m_time - (g.next - g.step)) / g.step;
+	return static_cast<float>(a < 0.0 ? 0.0 : a);
+}
+
+}
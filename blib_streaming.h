@@ -0,0 +1,246 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "blib_ec.h"
+
+namespace blib
+{
+
+// Streams regions of a world in and out on a background thread.
+//
+// A region is an entity_container snapshot (see entity_container::save_snapshot). Reading
+// the file and creating its entities happens on the background thread, update then merges
+// finished regions into the world on the thread that owns it. Unloading detaches the
+// region right away and leaves saving and releasing it to the background thread.
+// Regions must use ids that no other region or the world itself uses.
+class region_streamer
+{
+public:
+	enum class state { unloaded, loading, loaded, failed };
+
+	explicit region_streamer(entity_container& world);
+	region_streamer(const region_streamer&) = delete;
+	region_streamer& operator=(const region_streamer&) = delete;
+	~region_streamer();
+
+	void load(const std::string& name, const std::string& filename);
+
+	// Saves the region to filename first, unless it is empty
+	void unload(const std::string& name, const std::string& filename = {});
+
+	// Merges the regions that finished loading, call once per frame outside of world.update
+	void update();
+
+	state get_state(const std::string& name) const;
+	const std::vector<entity_id>& entities(const std::string& name) const;
+
+	// True while loads, saves or releases are queued or running
+	bool busy();
+	void wait();
+
+private:
+	struct region
+	{
+		state status = state::unloaded;
+		uint64_t generation = 0;
+		std::vector<entity_id> ids;
+	};
+
+	struct finished_load
+	{
+		std::string name;
+		uint64_t generation;
+		std::unique_ptr<entity_container> container; // Null if the file could not be read
+	};
+
+	void post(std::function<void()> task);
+	void release(std::unique_ptr<entity_container> container);
+	void run();
+
+	entity_container& m_world;
+	std::unordered_map<std::string, region> m_regions;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	std::deque<std::function<void()>> m_tasks;
+	std::vector<finished_load> m_finished;
+	bool m_running = false;
+	bool m_stop = false;
+	std::thread m_thread;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////
+////						Implementation
+////
+////////////////////////////////////////////////////////////////////////////////
+
+inline region_streamer::region_streamer(entity_container& world) : m_world(world)
+{
+	m_thread = std::thread([this]() { run(); });
+}
+
+// Work still queued, like saving unloaded regions, is finished first
+inline region_streamer::~region_streamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+inline void region_streamer::load(const std::string& name, const std::string& filename)
+{
+	region& r = m_regions[name];
+	if (r.status == state::loading || r.status == state::loaded)
+		return;
+
+	r.status = state::loading;
+	const uint64_t generation = ++r.generation;
+	post([this, name, filename, generation]()
+	{
+		auto container = std::make_unique<entity_container>();
+		if (!container->load_snapshot(filename))
+			container.reset();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished.push_back({ name, generation, std::move(container) });
+	});
+}
+
+inline void region_streamer::unload(const std::string& name, const std::string& filename)
+{
+	auto itr = m_regions.find(name);
+	if (itr == m_regions.end())
+		return;
+
+	// A load still in flight is dropped when it finishes
+	region& r = itr->second;
+	r.generation++;
+	if (r.status == state::loaded)
+	{
+		auto container = std::make_shared<entity_container>();
+		m_world.detach(r.ids, *container);
+		post([container = std::move(container), filename]()
+		{
+			if (!filename.empty())
+				container->save_snapshot(filename);
+		});
+	}
+	r.status = state::unloaded;
+	r.ids.clear();
+}
+
+inline void region_streamer::update()
+{
+	std::vector<finished_load> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		finished.swap(m_finished);
+	}
+
+	for (auto& f : finished)
+	{
+		auto itr = m_regions.find(f.name);
+		if (itr == m_regions.end() || itr->second.generation != f.generation || itr->second.status != state::loading)
+		{
+			release(std::move(f.container));
+			continue;
+		}
+
+		region& r = itr->second;
+		if (f.container)
+			f.container->each_with_tags(0, [&](entity& e) { r.ids.push_back(e.id()); });
+
+		if (!f.container || !m_world.merge(*f.container))
+		{
+			r.status = state::failed;
+			r.ids.clear();
+			release(std::move(f.container));
+			continue;
+		}
+		r.status = state::loaded;
+	}
+}
+
+inline region_streamer::state region_streamer::get_state(const std::string& name) const
+{
+	auto itr = m_regions.find(name);
+	return itr != m_regions.end() ? itr->second.status : state::unloaded;
+}
+
+inline const std::vector<entity_id>& region_streamer::entities(const std::string& name) const
+{
+	static const std::vector<entity_id> empty;
+	auto itr = m_regions.find(name);
+	return itr != m_regions.end() ? itr->second.ids : empty;
+}
+
+inline bool region_streamer::busy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_running || !m_tasks.empty();
+}
+
+inline void region_streamer::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return !m_running && m_tasks.empty(); });
+}
+
+inline void region_streamer::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_wake.notify_one();
+}
+
+// Destroying a large region takes a while, so it happens in the background too
+inline void region_streamer::release(std::unique_ptr<entity_container> container)
+{
+	if (!container)
+		return;
+
+	post([shared = std::shared_ptr<entity_container>(std::move(container))]() { });
+}
+
+inline void region_streamer::run()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+			if (m_tasks.empty())
+				return;
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+			m_running = true;
+		}
+
+		// Captured containers are released here, on this thread
+		task();
+		task = nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_running = false;
+		}
+		m_idle.notify_all();
+	}
+}
+
+}
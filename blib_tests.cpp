@@ -0,0 +1,2099 @@
+// Regression tests for behavior that is easy to break without noticing
+//
+// Usage: blib_tests [--filter <substring>]
+// Prints failed checks on stderr and returns non zero if any test failed.
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include "blib_math.h"
+#include "blib_random.h"
+#include "blib_ec.h"
+#include "blib_replay.h"
+#include "blib_hierarchy.h"
+#include "blib_scheduler.h"
+#include "blib_profiler.h"
+#include "blib_streaming.h"
+#include "blib_broadphase.h"
+
+namespace
+{
+
+////////////////////////////////////////////////////////////////////////////////
+////							Harness
+////////////////////////////////////////////////////////////////////////////////
+
+struct test
+{
+	const char* name;
+	std::function<void()> fn;
+};
+
+std::vector<test>& tests()
+{
+	static std::vector<test> all;
+	return all;
+}
+
+int g_failures = 0;
+
+struct registration
+{
+	registration(const char* name, std::function<void()> fn) { tests().push_back({ name, std::move(fn) }); }
+};
+
+#define BLIB_TEST_CONCAT_INNER(a, b) a##b
+#define BLIB_TEST_CONCAT(a, b) BLIB_TEST_CONCAT_INNER(a, b)
+#define TEST(name) static void BLIB_TEST_CONCAT(test_, __LINE__)(); \
+	static registration BLIB_TEST_CONCAT(registration_, __LINE__)(name, &BLIB_TEST_CONCAT(test_, __LINE__)); \
+	static void BLIB_TEST_CONCAT(test_, __LINE__)()
+
+// Records the failure and goes on, so one run reports every broken check
+#define CHECK(condition) do { if (!(condition)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); g_failures++; } } while (0)
+
+////////////////////////////////////////////////////////////////////////////////
+////							Replay
+////////////////////////////////////////////////////////////////////////////////
+
+blib::entity_container* g_world = nullptr;
+
+struct replay_a : blib::component
+{
+	float value = 1.0f;
+	void update(float dt) override { value = value * 0.5f + dt; }
+	void serialize(blib::io::binary_writer& writer) const override { writer.write(value); }
+	void deserialize(blib::io::binary_reader& reader) override { reader.read(value); }
+};
+
+// Reads the replay_a of entity 2, so its result depends on which type updates first
+struct replay_b : blib::component
+{
+	float value = 0.0f;
+	void update(float) override { value += g_world->get({ 2 }).get_component<replay_a>().value; }
+	void serialize(blib::io::binary_writer& writer) const override { writer.write(value); }
+	void deserialize(blib::io::binary_reader& reader) override { reader.read(value); }
+};
+
+// The recording world saw replay_a first, the snapshot lists entity 1 and its
+// replay_b first, so both only agree if update order doesn't depend on history
+TEST("replay/update_order_independent_of_creation_order")
+{
+	blib::register_component<replay_a>("replay_a");
+	blib::register_component<replay_b>("replay_b");
+
+	blib::entity_container world;
+	g_world = &world;
+	auto& first = world.create();
+	auto& second = world.create();
+	second.create_component<replay_a>();
+	first.create_component<replay_b>();
+
+	blib::replay_recorder recorder(world);
+	for (int i = 0; i < 5; i++)
+		recorder.update(0.1f);
+
+	blib::entity_container replayed;
+	g_world = &replayed;
+	blib::io::binary_reader log(recorder.data().data(), recorder.data().size());
+	blib::replay_result result = blib::replay(log, replayed);
+	CHECK(result.complete);
+	CHECK(result.frames == 5);
+	CHECK(result.first_mismatch == ~0ull);
+	g_world = nullptr;
+}
+
+// Components created out of id order update by id in deterministic mode
+TEST("replay/components_update_in_id_order")
+{
+	blib::register_component<replay_a>("replay_a");
+	blib::register_component<replay_b>("replay_b");
+
+	blib::entity_container world;
+	g_world = &world;
+	std::vector<blib::entity*> entities;
+	for (int i = 0; i < 4; i++)
+		entities.push_back(&world.create());
+	entities[1]->create_component<replay_a>();
+	entities[3]->create_component<replay_b>();
+	entities[0]->create_component<replay_b>();
+	entities[2]->create_component<replay_b>();
+
+	blib::replay_recorder recorder(world);
+	for (int i = 0; i < 5; i++)
+	{
+		if (i == 2)
+			recorder.create_component<replay_b>(entities[1]->id());
+		recorder.update(0.1f);
+	}
+
+	blib::entity_container replayed;
+	g_world = &replayed;
+	blib::io::binary_reader log(recorder.data().data(), recorder.data().size());
+	CHECK(blib::replay(log, replayed).ok());
+	g_world = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Update Order
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<std::pair<char, uint64_t>> g_updates;
+
+template<char Type>
+struct logged : blib::component
+{
+	void update(float) override { g_updates.emplace_back(Type, m_parent->id().id); }
+};
+
+// Inherits the update of logged<'d'>, so it runs as a group of its own
+struct logged_derived : logged<'d'> { };
+
+// Not visited at all
+struct quiet : blib::component
+{
+};
+
+// Components update grouped by type, types in the order they first showed up and the
+// components of a type in creation order
+TEST("update/grouped_by_type")
+{
+	blib::entity_container world;
+	std::vector<blib::entity*> e;
+	for (int i = 0; i < 4; i++)
+		e.push_back(&world.create());
+	e[2]->create_component<logged<'b'>>();
+	e[0]->create_component<logged<'a'>>();
+	e[3]->create_component<quiet>();
+	e[1]->create_component<logged<'b'>>();
+	e[3]->create_component<logged_derived>();
+	e[0]->create_component<logged<'b'>>();
+	e[3]->create_component<logged<'a'>>();
+
+	g_updates.clear();
+	world.update(0.0f);
+	const std::vector<std::pair<char, uint64_t>> expected = { { 'b', 3 }, { 'b', 2 }, { 'b', 1 }, { 'a', 1 }, { 'a', 4 }, { 'd', 4 } };
+	CHECK(g_updates == expected);
+
+	g_updates.clear();
+	world.update(0.0f);
+	CHECK(g_updates == expected);
+}
+
+blib::entity_container* g_update_world = nullptr;
+
+// On entity 1 it removes the one of entity 2, on entity 3 it adds one to a new entity
+struct churning : blib::component
+{
+	void update(float) override
+	{
+		g_updates.emplace_back('c', m_parent->id().id);
+		const uint64_t id = m_parent->id().id;
+		if (id == 1)
+			g_update_world->get({ 2 }).destroy_component<churning>();
+		if (id == 3)
+			g_update_world->create().create_component<churning>();
+	}
+};
+
+// Removed components are skipped, added ones still update in the same loop
+TEST("update/changes_during_update")
+{
+	blib::entity_container world;
+	g_update_world = &world;
+	for (int i = 0; i < 3; i++)
+		world.create().create_component<churning>();
+
+	g_updates.clear();
+	world.update(0.0f);
+	const std::vector<std::pair<char, uint64_t>> expected = { { 'c', 1 }, { 'c', 3 }, { 'c', 4 } };
+	CHECK(g_updates == expected);
+
+	g_updates.clear();
+	world.update(0.0f);
+	CHECK(g_updates.size() == 4 && g_updates[2].second == 4 && g_updates[3].second == 5);
+	g_update_world = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Snapshots
+////////////////////////////////////////////////////////////////////////////////
+
+struct snap_value : blib::component
+{
+	int32_t value = 0;
+	void serialize(blib::io::binary_writer& writer) const override { writer.write(value); }
+	void deserialize(blib::io::binary_reader& reader) override { reader.read(value); }
+};
+
+struct snap_sparse : blib::component
+{
+	float value = 0.0f;
+	void serialize(blib::io::binary_writer& writer) const override { writer.write(value); }
+	void deserialize(blib::io::binary_reader& reader) override { reader.read(value); }
+};
+
+}
+
+template<> struct blib::component_storage<snap_sparse> { static constexpr blib::storage value = blib::storage::sparse_set; };
+
+namespace
+{
+
+void register_snapshot_types()
+{
+	blib::register_component<snap_value>("snap_value");
+	blib::register_component<snap_sparse>("snap_sparse");
+}
+
+size_t entity_count(blib::entity_container& world)
+{
+	size_t count = 0;
+	world.each_with_tags(0, [&](blib::entity&) { count++; });
+	return count;
+}
+
+// Entities 1..count, every one with a snap_value, every third also with a
+// snap_sparse, odd ones tagged and named. Entity 2 is destroyed.
+void fill_world(blib::entity_container& world, int count)
+{
+	for (int i = 1; i <= count; i++)
+	{
+		auto& e = world.create();
+		e.create_component<snap_value>().value = i * 10;
+		if (i % 3 == 0)
+			e.create_component<snap_sparse>().value = i * 0.5f;
+		if (i % 2)
+		{
+			e.set_tag(uint64_t(1) << (i % 64));
+			e.set_name("entity " + std::to_string(i));
+		}
+	}
+	world.destroy({ 2 });
+	world.update(0.0f);
+}
+
+std::vector<char> snapshot_of(const blib::entity_container& world)
+{
+	blib::io::binary_writer writer;
+	world.write_snapshot(writer);
+	return writer.data();
+}
+
+bool read_snapshot(blib::entity_container& world, const std::vector<char>& data, size_t size)
+{
+	blib::io::binary_reader reader(data.data(), size);
+	return world.read_snapshot(reader);
+}
+
+TEST("snapshot/round_trip")
+{
+	register_snapshot_types();
+	blib::entity_container world;
+	fill_world(world, 10);
+	auto data = snapshot_of(world);
+
+	blib::entity_container loaded;
+	CHECK(read_snapshot(loaded, data, data.size()));
+	CHECK(loaded.state_hash() == world.state_hash());
+	CHECK(entity_count(loaded) == 9);
+	CHECK(!loaded.try_get({ 2 }));
+	CHECK(loaded.get({ 9 }).get_component<snap_value>().value == 90);
+	CHECK(loaded.get({ 9 }).get_component<snap_sparse>().value == 4.5f);
+	CHECK(!loaded.get({ 4 }).try_get_component<snap_sparse>());
+	CHECK(loaded.get({ 7 }).tag() == uint64_t(1) << 7);
+	CHECK(loaded.find("entity 7") == &loaded.get({ 7 }));
+	CHECK(loaded.create().id().id == 11);
+}
+
+TEST("snapshot/save_and_load_file")
+{
+	register_snapshot_types();
+	blib::entity_container world;
+	fill_world(world, 10);
+
+	const std::string filename = "blib_tests_snapshot.bin";
+	CHECK(world.save_snapshot(filename));
+	blib::entity_container loaded;
+	CHECK(loaded.load_snapshot(filename));
+	CHECK(loaded.state_hash() == world.state_hash());
+	std::remove(filename.c_str());
+	CHECK(!loaded.load_snapshot(filename));
+	CHECK(loaded.state_hash() == world.state_hash());
+}
+
+// A failed load leaves the container as it was, wherever the input ends
+TEST("snapshot/truncated_input_keeps_world")
+{
+	register_snapshot_types();
+	blib::entity_container source;
+	fill_world(source, 100);
+	auto data = snapshot_of(source);
+
+	blib::entity_container world;
+	fill_world(world, 5);
+	const uint64_t hash = world.state_hash();
+	CHECK(!read_snapshot(world, data, data.size() / 2));
+	CHECK(world.state_hash() == hash);
+	CHECK(entity_count(world) == 4);
+
+	for (size_t size = 0; size < data.size(); size += 7)
+		CHECK(!read_snapshot(world, data, size));
+	CHECK(world.state_hash() == hash);
+}
+
+// Sections of types this build doesn't know are skipped
+TEST("snapshot/unknown_component_is_skipped")
+{
+	register_snapshot_types();
+	blib::entity_container world;
+	fill_world(world, 10);
+	auto data = snapshot_of(world);
+
+	const uint64_t known = blib::component_registry::find(typeid(snap_value))->hash;
+	const uint64_t unknown = 0x0123456789abcdefull;
+	bool patched = false;
+	for (size_t i = 0; i + sizeof(known) <= data.size() && !patched; i++)
+		if (!std::memcmp(data.data() + i, &known, sizeof(known)))
+		{
+			std::memcpy(data.data() + i, &unknown, sizeof(unknown));
+			patched = true;
+		}
+	CHECK(patched);
+
+	blib::entity_container loaded;
+	CHECK(read_snapshot(loaded, data, data.size()));
+	CHECK(entity_count(loaded) == 9);
+	CHECK(!loaded.get({ 3 }).try_get_component<snap_value>());
+	CHECK(loaded.get({ 3 }).get_component<snap_sparse>().value == 1.5f);
+}
+
+TEST("snapshot/rejects_bad_ids")
+{
+	blib::entity_container world;
+	world.create();
+	world.create();
+
+	// An id counter below the loaded ids doesn't lead to collisions
+	auto data = snapshot_of(world);
+	const uint64_t low = 0;
+	std::memcpy(data.data() + 8, &low, sizeof(low));
+	blib::entity_container loaded;
+	CHECK(read_snapshot(loaded, data, data.size()));
+	CHECK(loaded.create().id().id == 3);
+
+	// Duplicate ids and id 0 fail
+	data = snapshot_of(world);
+	auto first = data.begin() + 24;
+	std::copy(first, first + 8, first + 8 + 8 + 4);
+	CHECK(!read_snapshot(loaded, data, data.size()));
+	const uint64_t zero = 0;
+	std::memcpy(data.data() + 24, &zero, sizeof(zero));
+	CHECK(!read_snapshot(loaded, data, data.size()));
+	CHECK(entity_count(loaded) == 3);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Deltas
+////////////////////////////////////////////////////////////////////////////////
+
+// Copies 'world' into 'copy' and returns the version to write the next delta from
+uint64_t start_deltas(blib::entity_container& world, blib::entity_container& copy)
+{
+	auto data = snapshot_of(world);
+	read_snapshot(copy, data, data.size());
+	blib::io::binary_writer ignored;
+	return world.write_delta(ignored, 0);
+}
+
+// Changes every kind of state a delta carries
+void change_world(blib::entity_container& world)
+{
+	world.get({ 3 }).get_component<snap_value>().value = -3;
+	world.get({ 3 }).get_component<snap_value>().mark_dirty();
+	world.get({ 4 }).create_component<snap_sparse>().value = 8.0f;
+	world.get({ 6 }).destroy_component<snap_sparse>();
+	world.get({ 1 }).set_tag(0x30);
+	world.get({ 7 }).set_name("renamed");
+	world.destroy({ 5 });
+	world.create().create_component<snap_value>().value = 110;
+}
+
+std::vector<char> delta_of(blib::entity_container& world, uint64_t since)
+{
+	blib::io::binary_writer writer;
+	world.write_delta(writer, since);
+	return writer.data();
+}
+
+bool apply_delta(blib::entity_container& world, const std::vector<char>& data, size_t size)
+{
+	blib::io::binary_reader reader(data.data(), size);
+	return world.apply_delta(reader);
+}
+
+TEST("delta/round_trip")
+{
+	register_snapshot_types();
+	blib::entity_container world, copy;
+	fill_world(world, 10);
+	const uint64_t since = start_deltas(world, copy);
+	change_world(world);
+	world.update(0.0f);
+	auto data = delta_of(world, since);
+
+	CHECK(apply_delta(copy, data, data.size()));
+	CHECK(copy.state_hash() == world.state_hash());
+	CHECK(!copy.try_get({ 5 }) || !copy.try_get({ 5 })->valid());
+	CHECK(copy.get({ 3 }).get_component<snap_value>().value == -3);
+	CHECK(copy.get({ 4 }).get_component<snap_sparse>().value == 8.0f);
+	CHECK(!copy.get({ 6 }).try_get_component<snap_sparse>());
+	CHECK(copy.get({ 11 }).get_component<snap_value>().value == 110);
+	CHECK(copy.find("renamed") == &copy.get({ 7 }));
+
+	// A delta with nothing new in it changes nothing
+	copy.update(0.0f);
+	const uint64_t hash = copy.state_hash();
+	data = delta_of(world, world.version());
+	CHECK(apply_delta(copy, data, data.size()));
+	CHECK(copy.state_hash() == hash);
+}
+
+// A destroyed id that comes back in a later delta is a new entity with only its new state
+TEST("delta/destroyed_id_created_again")
+{
+	register_snapshot_types();
+	blib::entity_container world, copy;
+	fill_world(world, 10);
+	const uint64_t since = start_deltas(world, copy);
+
+	world.destroy({ 8 });
+	world.update(0.0f);
+	auto data = delta_of(world, since);
+	CHECK(apply_delta(copy, data, data.size()));
+	CHECK(!copy.try_get({ 8 }) || !copy.try_get({ 8 })->valid());
+
+	blib::entity_container other;
+	fill_world(other, 10);
+	blib::io::binary_writer ignored;
+	const uint64_t other_since = other.write_delta(ignored, 0);
+	other.get({ 8 }).get_component<snap_value>().value = 88;
+	other.get({ 8 }).get_component<snap_value>().mark_dirty();
+	other.get({ 8 }).set_name("back");
+	data = delta_of(other, other_since);
+	CHECK(apply_delta(copy, data, data.size()));
+	CHECK(copy.get({ 8 }).get_component<snap_value>().value == 88);
+	CHECK(copy.find("back") == &copy.get({ 8 }));
+}
+
+TEST("delta/unknown_component_is_skipped")
+{
+	register_snapshot_types();
+	blib::entity_container world, copy;
+	fill_world(world, 10);
+	const uint64_t since = start_deltas(world, copy);
+	change_world(world);
+	auto data = delta_of(world, since);
+
+	// Only the section header holds the hash of snap_sparse, the removed component
+	// records come first and keep it
+	const uint64_t known = blib::component_registry::find(typeid(snap_sparse))->hash;
+	const uint64_t unknown = 0x0123456789abcdefull;
+	size_t last = 0;
+	for (size_t i = 0; i + sizeof(known) <= data.size(); i++)
+		if (!std::memcmp(data.data() + i, &known, sizeof(known)))
+			last = i;
+	CHECK(last != 0);
+	std::memcpy(data.data() + last, &unknown, sizeof(unknown));
+
+	CHECK(apply_delta(copy, data, data.size()));
+	CHECK(copy.get({ 3 }).get_component<snap_value>().value == -3);
+	CHECK(!copy.get({ 4 }).try_get_component<snap_sparse>());
+	CHECK(!copy.get({ 6 }).try_get_component<snap_sparse>());
+}
+
+TEST("delta/truncated_input_fails")
+{
+	register_snapshot_types();
+	blib::entity_container world, copy;
+	fill_world(world, 10);
+	const uint64_t since = start_deltas(world, copy);
+	auto base = snapshot_of(copy);
+	change_world(world);
+	auto data = delta_of(world, since);
+
+	for (size_t size = 0; size < data.size(); size += 5)
+	{
+		blib::entity_container target;
+		read_snapshot(target, base, base.size());
+		CHECK(!apply_delta(target, data, size));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Sparse Pools
+////////////////////////////////////////////////////////////////////////////////
+
+struct sparse_item : blib::component
+{
+	uint64_t value = 0;
+	sparse_item() = default;
+	explicit sparse_item(uint64_t v) : value(v) { }
+};
+
+blib::entity_container* g_sparse_world = nullptr;
+
+// Removes the sparse_actor of the entity 'target' and toggles a sparse_flag on its own
+struct sparse_actor : blib::component
+{
+	uint64_t target = 0;
+	uint32_t updates = 0;
+	void update(float) override;
+};
+
+struct sparse_flag : blib::component
+{
+};
+
+}
+
+template<> struct blib::component_storage<sparse_item> { static constexpr blib::storage value = blib::storage::sparse_set; };
+template<> struct blib::component_storage<sparse_actor> { static constexpr blib::storage value = blib::storage::sparse_set; };
+template<> struct blib::component_storage<sparse_flag> { static constexpr blib::storage value = blib::storage::sparse_set; };
+
+namespace
+{
+
+void sparse_actor::update(float)
+{
+	updates++;
+	if (target)
+		g_sparse_world->get({ target }).destroy_component<sparse_actor>();
+	if (m_parent->try_get_component<sparse_flag>())
+		m_parent->destroy_component<sparse_flag>();
+	else
+		m_parent->create_component<sparse_flag>();
+}
+
+// Adds, removes and toggles ids over several pages, pages are freed and come back
+TEST("sparse/matches_model")
+{
+	blib::sparse_pool<sparse_item> pool;
+	std::mt19937 random(38);
+	std::vector<uint64_t> model(3 * 4096 + 100, 0);
+	size_t live = 0;
+	for (int i = 0; i < 100000; i++)
+	{
+		// Mostly a few hot ids, as toggled flags would be
+		const uint64_t id = 1 + (random() % 4 ? random() % 64 : random() % (model.size() - 1));
+		if (model[id])
+		{
+			pool.remove(id);
+			model[id] = 0;
+			live--;
+		}
+		else
+		{
+			pool.add(id, uint64_t(i + 1));
+			model[id] = i + 1;
+			live++;
+		}
+	}
+	CHECK(pool.size() == live);
+	size_t wrong = 0;
+	for (uint64_t id = 1; id < model.size(); id++)
+	{
+		sparse_item* item = pool.find(id);
+		wrong += (model[id] ? item && item->value == model[id] : !item) ? 0 : 1;
+	}
+	CHECK(wrong == 0);
+	for (size_t i = 0; i < pool.size(); i++)
+		wrong += pool.find(pool.ids()[i]) == pool.data() + i ? 0 : 1;
+	CHECK(wrong == 0);
+
+	pool.sort_by_id();
+	CHECK(std::is_sorted(pool.ids(), pool.ids() + pool.size()));
+	for (size_t i = 0; i < pool.size(); i++)
+		wrong += pool.data()[i].value == model[pool.ids()[i]] ? 0 : 1;
+	CHECK(wrong == 0);
+}
+
+// Components removed during update before their turn don't update, the gaps close
+// after the loop, and other sparse types can come and go meanwhile
+TEST("sparse/changes_during_update")
+{
+	blib::entity_container world;
+	g_sparse_world = &world;
+	for (int i = 1; i <= 100; i++)
+	{
+		// Every tenth takes out the one five ahead, every tenth plus seven the one before it
+		auto& actor = world.create().create_component<sparse_actor>();
+		if (i % 10 == 0 && i + 5 <= 100)
+			actor.target = i + 5;
+		if (i % 10 == 7)
+			actor.target = i - 1;
+	}
+
+	world.update(0.0f);
+	size_t actors = 0, flags = 0, updated = 0;
+	world.each<sparse_actor>([&](blib::entity&, sparse_actor& a) { actors++; updated += a.updates; });
+	world.each<sparse_flag>([&](blib::entity&, sparse_flag&) { flags++; });
+	CHECK(actors == 100 - 9 - 10);
+	CHECK(world.pool<sparse_actor>().size() == actors);
+	CHECK(updated == actors);
+	// The ones taken out ahead never updated, the ones taken out behind did
+	CHECK(flags == 100 - 9);
+
+	world.update(0.0f);
+	flags = 0;
+	world.each<sparse_flag>([&](blib::entity& e, sparse_flag&) { flags++; CHECK(e.id().id % 10 == 6); });
+	CHECK(flags == 10);
+	CHECK(!world.get({ 15 }).try_get_component<sparse_actor>());
+	CHECK(!world.get({ 16 }).try_get_component<sparse_actor>());
+	CHECK(world.get({ 17 }).get_component<sparse_actor>().updates == 2);
+	g_sparse_world = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Streaming
+////////////////////////////////////////////////////////////////////////////////
+
+template<int N>
+struct late_type : blib::component
+{
+	int32_t value = N;
+	void serialize(blib::io::binary_writer& writer) const override { writer.write(value); }
+	void deserialize(blib::io::binary_reader& reader) override { reader.read(value); }
+};
+
+template<int... N>
+void register_late_types(std::integer_sequence<int, N...>)
+{
+	(blib::register_component<late_type<N>>("late_type " + std::to_string(N)), ...);
+}
+
+// A region loads in the background while the main thread keeps registering types, merges
+// into the world with its ids and values, and leaves it again when unloaded
+TEST("streaming/load_merge_unload")
+{
+	register_snapshot_types();
+	const std::string filename = "blib_tests_region.bin", saved = "blib_tests_region_saved.bin";
+	{
+		// Ids 1001 to 21000, clear of the world's
+		blib::entity_container region;
+		for (int i = 0; i < 21000; i++)
+			region.create();
+		for (uint64_t id = 1; id <= 1000; id++)
+			region.destroy({ id });
+		region.each_with_tags(0, [](blib::entity& e) { e.create_component<snap_value>().value = static_cast<int32_t>(e.id().id); });
+		region.get({ 1005 }).set_name("center");
+		CHECK(region.save_snapshot(filename));
+	}
+
+	blib::entity_container world;
+	fill_world(world, 10);
+	blib::region_streamer streamer(world);
+	streamer.load("region", filename);
+	streamer.load("missing", "blib_tests_missing.bin");
+	do
+		register_late_types(std::make_integer_sequence<int, 64>());
+	while (streamer.busy());
+	streamer.update();
+
+	CHECK(streamer.get_state("region") == blib::region_streamer::state::loaded);
+	CHECK(streamer.get_state("missing") == blib::region_streamer::state::failed);
+	CHECK(streamer.entities("region").size() == 20000);
+	CHECK(entity_count(world) == 9 + 20000);
+	CHECK(world.get({ 1007 }).get_component<snap_value>().value == 1007);
+	CHECK(world.find("center") == world.try_get({ 1005 }));
+	CHECK(world.get({ 3 }).get_component<snap_value>().value == 30);
+
+	// Loading it again while loaded does nothing
+	streamer.load("region", filename);
+	streamer.wait();
+	streamer.update();
+	CHECK(entity_count(world) == 9 + 20000);
+
+	world.get({ 1007 }).get_component<snap_value>().value = -1;
+	streamer.unload("region", saved);
+	CHECK(streamer.get_state("region") == blib::region_streamer::state::unloaded);
+	CHECK(entity_count(world) == 9);
+	CHECK(!world.try_get({ 1007 }) && !world.find("center"));
+	streamer.wait();
+
+	blib::entity_container reloaded;
+	CHECK(reloaded.load_snapshot(saved));
+	CHECK(entity_count(reloaded) == 20000);
+	CHECK(reloaded.get({ 1007 }).get_component<snap_value>().value == -1);
+	std::remove(filename.c_str());
+	std::remove(saved.c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Hierarchy
+////////////////////////////////////////////////////////////////////////////////
+
+// Close to identity, so long parent chains neither blow up nor vanish
+blib::mat4 random_transform(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> offset(-0.2f, 0.2f);
+	blib::mat4 m;
+	for (auto& row : m.value)
+	{
+		row.x += offset(random);
+		row.y += offset(random);
+		row.z += offset(random);
+		row.w += offset(random);
+	}
+	return m;
+}
+
+bool nearly_equal(const blib::mat4& a, const blib::mat4& b)
+{
+	for (int row = 0; row < 4; row++)
+		for (int column = 0; column < 4; column++)
+			if (std::fabs(a.value[row][column] - b.value[row][column]) > 1e-4f * (1.0f + std::fabs(b.value[row][column])))
+				return false;
+	return true;
+}
+
+blib::mat4 parent_chain_world(const blib::transform_hierarchy& h, blib::transform_hierarchy::node n)
+{
+	blib::mat4 world = h.local(n);
+	for (auto p = h.parent(n); p != blib::transform_hierarchy::invalid; p = h.parent(p))
+		world = blib::mul(h.local(p), world);
+	return world;
+}
+
+// Mixes every kind of change, many at once to force re-sorts and a few at a time to
+// go through the tail, holes and dirty subtrees. Odd rounds only make changes that
+// keep the sorted levels, new leaves, destroyed leaves and tail nodes reparented up.
+TEST("hierarchy/world_matches_parent_chain")
+{
+	using node = blib::transform_hierarchy::node;
+	const node none = blib::transform_hierarchy::invalid;
+
+	blib::transform_hierarchy h;
+	std::mt19937 random(29);
+	std::vector<node> live;
+	auto pick = [&]() { return live[random() % live.size()]; };
+	for (int round = 0; round < 60; round++)
+	{
+		const int changes = round % 10 == 0 ? 2000 : 30;
+		const size_t old_count = live.size();
+		std::vector<node> leaves; // Created this round, without children
+		for (int i = 0; i < changes; i++)
+		{
+			const uint32_t kind = live.size() < 8 ? 0 : random() % 10;
+			if (kind < 3)
+			{
+				node p = live.empty() || random() % 4 == 0 ? none : pick();
+				leaves.erase(std::remove(leaves.begin(), leaves.end(), p), leaves.end());
+				node n = h.create(p);
+				h.set_local(n, random_transform(random));
+				live.push_back(n);
+				leaves.push_back(n);
+			}
+			else if (kind == 3 && round % 2 == 0)
+			{
+				size_t index = random() % live.size();
+				h.destroy(live[index]);
+				live[index] = live.back();
+				live.pop_back();
+				leaves.clear();
+			}
+			else if (kind == 3 && !leaves.empty())
+			{
+				node n = leaves[random() % leaves.size()];
+				h.destroy(n);
+				live.erase(std::find(live.begin(), live.end(), n));
+				leaves.erase(std::find(leaves.begin(), leaves.end(), n));
+			}
+			else if (kind == 4 && round % 2 == 0)
+			{
+				node n = pick();
+				node p = random() % 4 == 0 ? none : pick();
+				for (node a = p; a != none; a = h.parent(a))
+					if (a == n)
+						p = none;
+				h.set_parent(n, p);
+				leaves.clear();
+			}
+			else if (kind == 4 && !leaves.empty() && old_count > 0)
+				h.set_parent(leaves[random() % leaves.size()], live[random() % old_count]);
+			else
+				h.set_local(pick(), random_transform(random));
+		}
+
+		h.propagate();
+		CHECK(h.size() == live.size());
+		size_t wrong = 0;
+		for (node n : live)
+			wrong += nearly_equal(h.world(n), parent_chain_world(h, n)) ? 0 : 1;
+		CHECK(wrong == 0);
+	}
+}
+
+// Children of a destroyed node are roots right away, not only after the next propagate
+TEST("hierarchy/destroyed_parent_unlinks_children")
+{
+	blib::transform_hierarchy h;
+	std::mt19937 random(3);
+	auto root = h.create();
+	auto middle = h.create(root);
+	auto leaf = h.create(middle);
+	h.set_local(root, random_transform(random));
+	h.set_local(leaf, random_transform(random));
+	h.propagate();
+
+	h.destroy(middle);
+	CHECK(h.parent(leaf) == blib::transform_hierarchy::invalid);
+	CHECK(h.size() == 2);
+	h.propagate();
+	CHECK(h.parent(leaf) == blib::transform_hierarchy::invalid);
+	CHECK(nearly_equal(h.world(leaf), h.local(leaf)));
+
+	// The handle comes back once the sort let go of it
+	auto reused = h.create(root);
+	CHECK(reused == middle && h.parent(leaf) == blib::transform_hierarchy::invalid);
+}
+
+// Prefab copies get their own node under the parent of the prototype, compaction
+// moves the component but keeps the node
+TEST("hierarchy/prefab_copies_get_own_nodes")
+{
+	blib::transform_hierarchy h;
+	blib::entity_container world;
+	auto& root = world.create().create_component<blib::hierarchy>(h);
+	const auto root_node = root.node();
+	std::mt19937 random(1);
+	root.set_local(random_transform(random));
+
+	blib::prefab child;
+	auto& prototype = child.add<blib::hierarchy>(h);
+	prototype.set_parent(root);
+	prototype.set_local(random_transform(random));
+
+	auto range = world.instantiate(child, 3);
+	std::vector<blib::transform_hierarchy::node> nodes;
+	for (auto id : range)
+	{
+		auto& c = world.get(id).get_component<blib::hierarchy>();
+		CHECK(c.node() != prototype.node());
+		CHECK(h.parent(c.node()) == root_node);
+		nodes.push_back(c.node());
+	}
+	CHECK(nodes[0] != nodes[1] && nodes[1] != nodes[2]);
+	CHECK(h.size() == 5);
+
+	world.compact();
+	h.propagate();
+	for (size_t i = 0; i < range.size(); i++)
+	{
+		auto& c = world.get(range[i]).get_component<blib::hierarchy>();
+		CHECK(c.node() == nodes[i]);
+		CHECK(nearly_equal(c.world(), blib::mul(h.local(root_node), prototype.local())));
+	}
+	CHECK(h.size() == 5);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Names
+////////////////////////////////////////////////////////////////////////////////
+
+// The index finds the lowest id with a name like the scan does, also after the lowest
+// one was renamed or destroyed
+TEST("names/index_matches_scan")
+{
+	blib::entity_container indexed, scanned;
+	indexed.enable_name_index(true);
+	std::mt19937 random(33);
+	std::vector<uint64_t> live;
+	const char* names[] = { "", "a", "b", "c", "d" };
+	for (int i = 0; i < 4000; i++)
+	{
+		const uint32_t kind = live.size() < 4 ? 0 : random() % 4;
+		if (kind == 0)
+		{
+			const char* name = names[random() % 5];
+			indexed.create().set_name(name);
+			live.push_back(scanned.create().id().id);
+			scanned.get({ live.back() }).set_name(name);
+		}
+		else if (kind == 1)
+		{
+			// Mostly the lowest holders, which the index has to replace
+			size_t index = random() % 2 ? 0 : random() % live.size();
+			indexed.destroy({ live[index] });
+			scanned.destroy({ live[index] });
+			live.erase(live.begin() + index);
+		}
+		else
+		{
+			const uint64_t id = live[random() % 2 ? random() % std::min<size_t>(live.size(), 8) : random() % live.size()];
+			const char* name = names[random() % 5];
+			indexed.get({ id }).set_name(name);
+			scanned.get({ id }).set_name(name);
+		}
+
+		for (const char* name : names)
+		{
+			blib::entity* a = indexed.find(name);
+			blib::entity* b = scanned.find(name);
+			CHECK((a ? a->id().id : 0) == (b ? b->id().id : 0));
+		}
+		if (i % 500 == 0)
+		{
+			indexed.update(0.0f);
+			scanned.update(0.0f);
+		}
+	}
+
+	CHECK(!indexed.find(""));
+	indexed.enable_name_index(false);
+	indexed.enable_name_index(true);
+	for (const char* name : names)
+	{
+		blib::entity* a = indexed.find(name);
+		blib::entity* b = scanned.find(name);
+		CHECK((a ? a->id().id : 0) == (b ? b->id().id : 0));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Tags
+////////////////////////////////////////////////////////////////////////////////
+
+// Filtering visits exactly the entities a full scan picks, in id order, across several
+// bitset blocks and with holes left by destroyed entities
+TEST("tags/each_with_tags_matches_scan")
+{
+	blib::entity_container world;
+	std::mt19937 random(34);
+	std::vector<uint64_t> tags(1, 0); // By id
+	for (int i = 0; i < 20000; i++)
+	{
+		uint64_t tag = 0;
+		for (int bit = 0; bit < 6; bit++)
+			if (random() % 3 == 0)
+				tag |= uint64_t(1) << (bit * 11);
+		world.create().set_tag(tag);
+		tags.push_back(tag);
+	}
+	for (uint64_t id = 1; id < tags.size(); id += 1 + random() % 5)
+	{
+		world.destroy({ id });
+		tags[id] = ~0ull;
+	}
+	world.update(0.0f);
+
+	const uint64_t masks[][2] = { { 1, 0 }, { uint64_t(1) << 11 | uint64_t(1) << 55, 0 },
+		{ uint64_t(1) << 22, uint64_t(1) << 33 | 1 }, { 0, uint64_t(1) << 44 }, { uint64_t(1) << 63, 0 } };
+	for (auto& m : masks)
+	{
+		std::vector<uint64_t> expected, visited;
+		for (uint64_t id = 1; id < tags.size(); id++)
+			if (tags[id] != ~0ull && (tags[id] & m[0]) == m[0] && (tags[id] & m[1]) == 0)
+				expected.push_back(id);
+		world.each_with_tags(m[0], m[1], [&](blib::entity& e) { visited.push_back(e.id().id); });
+		// Without a mask all entities are walked, in id order only in deterministic mode
+		if (m[0] == 0)
+			std::sort(visited.begin(), visited.end());
+		CHECK(visited == expected);
+	}
+}
+
+// fn may change tags, also the ones being filtered on
+TEST("tags/retag_during_iteration")
+{
+	blib::entity_container world;
+	for (int i = 0; i < 10000; i++)
+		world.create().set_tag(i % 2 ? 3 : 1);
+
+	size_t visited = 0;
+	world.each_with_tags(1, [&](blib::entity& e)
+	{
+		visited++;
+		e.set_tag(e.tag() & 2 ? 4 : 0);
+	});
+	CHECK(visited == 10000);
+
+	size_t ones = 0, fours = 0;
+	world.each_with_tags(1, [&](blib::entity&) { ones++; });
+	world.each_with_tags(4, [&](blib::entity&) { fours++; });
+	CHECK(ones == 0);
+	CHECK(fours == 5000);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Events
+////////////////////////////////////////////////////////////////////////////////
+
+struct hit
+{
+	uint64_t entity;
+	float damage;
+};
+
+// Coalesced events keep the position of the first and the value of the last, until a
+// handler has seen them
+TEST("events/coalesce_per_key")
+{
+	blib::event_bus bus;
+	bus.coalesce<hit>([](const hit& h) { return h.entity; });
+	std::vector<hit> first, second;
+	bus.subscribe<hit>(0, [&](const hit* events, size_t count) { first.insert(first.end(), events, events + count); });
+	bus.subscribe<hit>(1, [&](const hit* events, size_t count) { second.insert(second.end(), events, events + count); });
+
+	bus.emit(hit{ 1, 1.0f });
+	bus.emit(hit{ 2, 2.0f });
+	bus.emit(hit{ 1, 3.0f });
+	bus.dispatch(0);
+	CHECK(first.size() == 2 && first[0].entity == 1 && first[0].damage == 3.0f && first[1].entity == 2);
+
+	// Seen by the first handler, so a new hit on entity 1 can't replace it any more
+	bus.emit(hit{ 1, 4.0f });
+	bus.emit(hit{ 2, 5.0f });
+	bus.emit(hit{ 1, 6.0f });
+	bus.dispatch(1);
+	CHECK(second.size() == 4 && second[2].damage == 6.0f && second[3].damage == 5.0f);
+	CHECK(bus.pending<hit>() == 2);
+	bus.dispatch(0);
+	CHECK(first.size() == 4);
+	CHECK(bus.pending<hit>() == 0);
+}
+
+// A handler subscribed during dispatch only gets the events emitted after it
+TEST("events/subscribe_during_dispatch")
+{
+	blib::event_bus bus;
+	std::vector<float> late;
+	int subscribed = 0;
+	bus.subscribe<hit>(0, [&](const hit*, size_t)
+	{
+		// Enough to move a vector, the handler that runs stays where it is
+		for (int i = 0; i < 64; i++, subscribed++)
+			bus.subscribe<hit>(0, [&](const hit* events, size_t count)
+			{
+				for (size_t j = 0; j < count; j++)
+					late.push_back(events[j].damage);
+			});
+	});
+
+	bus.emit(hit{ 1, 1.0f });
+	bus.dispatch(0);
+	CHECK(subscribed == 64);
+	CHECK(late.empty());
+
+	bus.emit(hit{ 1, 2.0f });
+	bus.dispatch(0);
+	CHECK(subscribed == 128);
+	CHECK(late.size() == 64);
+	CHECK(std::count(late.begin(), late.end(), 2.0f) == 64);
+}
+
+TEST("events/emit_from_several_threads")
+{
+	blib::event_bus bus;
+	size_t received = 0;
+	float total = 0.0f;
+	bus.subscribe<hit>(0, [&](const hit* events, size_t count)
+	{
+		received += count;
+		for (size_t i = 0; i < count; i++)
+			total += events[i].damage;
+	});
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+		threads.emplace_back([&bus]()
+		{
+			for (int i = 0; i < 1000; i++)
+				bus.emit(hit{ uint64_t(i), 1.0f });
+		});
+	for (auto& t : threads)
+		t.join();
+	bus.dispatch(0);
+	CHECK(received == 4000);
+	CHECK(total == 4000.0f);
+}
+
+blib::entity_container* g_event_world = nullptr;
+
+struct hitter : blib::component
+{
+	void update(float) override { g_event_world->events().emit(hit{ m_parent->id().id, 1.0f }); }
+};
+
+// Events emitted by components reach post update handlers in the same update and pre
+// update handlers in the next one
+TEST("events/dispatched_by_container_update")
+{
+	blib::entity_container world;
+	g_event_world = &world;
+	for (int i = 0; i < 10; i++)
+		world.create().create_component<hitter>();
+
+	size_t before = 0, after = 0;
+	world.events().subscribe<hit>(blib::entity_container::pre_update_phase, [&](const hit*, size_t count) { before += count; });
+	world.events().subscribe<hit>(blib::entity_container::post_update_phase, [&](const hit* events, size_t count)
+	{
+		after += count;
+		world.destroy({ events[0].entity });
+	});
+
+	world.update(0.1f);
+	CHECK(before == 0 && after == 10);
+	world.update(0.1f);
+	CHECK(before == 10 && after == 19);
+	CHECK(!world.try_get({ 1 }) && !world.try_get({ 2 }) && world.try_get({ 3 }));
+	g_event_world = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Scheduler
+////////////////////////////////////////////////////////////////////////////////
+
+// Steps past max_steps are dropped whole, so the group keeps its phase
+TEST("scheduler/catch_up_is_limited")
+{
+	blib::frame_scheduler scheduler(4);
+	auto physics = scheduler.add_group("physics", 50.0f);
+	int runs = 0;
+	float step = 0.0f;
+	scheduler.add_system(physics, [&](float dt) { runs++; step = dt; });
+
+	scheduler.advance(0.13f);
+	CHECK(runs == 4);
+	CHECK(scheduler.steps(physics) == 4);
+	CHECK(scheduler.dropped_steps(physics) == 2);
+	CHECK(step == 0.02f);
+	CHECK(std::fabs(scheduler.alpha(physics) - 0.5f) < 1e-3f);
+
+	scheduler.advance(0.05f);
+	CHECK(runs == 6);
+	CHECK(scheduler.dropped_steps(physics) == 2);
+}
+
+TEST("scheduler/alpha_between_steps")
+{
+	blib::frame_scheduler scheduler;
+	auto group = scheduler.add_group("group", 10.0f);
+	scheduler.advance(0.05f);
+	CHECK(scheduler.steps(group) == 0);
+	CHECK(std::fabs(scheduler.alpha(group) - 0.5f) < 1e-3f);
+	scheduler.advance(0.075f);
+	CHECK(scheduler.steps(group) == 1);
+	CHECK(std::fabs(scheduler.alpha(group) - 0.25f) < 1e-3f);
+	scheduler.advance(0.075f);
+	CHECK(scheduler.steps(group) == 2);
+	CHECK(scheduler.alpha(group) < 1e-3f);
+}
+
+// Steps run in simulated time order across groups, however the frames slice real time
+TEST("scheduler/steps_in_time_order")
+{
+	auto run = [](const std::vector<float>& frames)
+	{
+		std::string order;
+		blib::frame_scheduler scheduler(100);
+		auto fast = scheduler.add_group("fast", 30.0f);
+		auto slow = scheduler.add_group("slow", 20.0f);
+		scheduler.add_system(fast, [&](float) { order += 'f'; });
+		scheduler.add_system(slow, [&](float) { order += 's'; });
+		for (float dt : frames)
+			scheduler.advance(dt);
+		return order;
+	};
+
+	CHECK(run({ 0.09f }) == "fsf");
+	CHECK(run({ 0.01f, 0.02f, 0.03f, 0.02f, 0.01f }) == "fsf");
+	CHECK(run({ 0.2f, 0.19f }) == run({ 0.39f }));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Profiler
+////////////////////////////////////////////////////////////////////////////////
+
+struct profiled : blib::component
+{
+	float value = 0.0f;
+	void update(float dt) override { value += dt; }
+};
+
+const blib::profiler::scope_stats* find_scope(const blib::profiler::frame_stats& frame, const std::string& name)
+{
+	for (auto& scope : frame.scopes)
+		if (scope.name.find(name) != std::string::npos)
+			return &scope;
+	return nullptr;
+}
+
+// A component type counts one call per component, however its batch is timed
+TEST("profiler/counts_components_per_type")
+{
+	blib::entity_container world;
+	for (int i = 0; i < 100; i++)
+		world.create().create_component<profiled>();
+
+	blib::profiler::end_frame();
+	world.update(0.1f);
+	world.update(0.1f);
+	blib::profiler::end_frame();
+
+	auto* type = find_scope(blib::profiler::last_frame(), "profiled");
+	auto* update = find_scope(blib::profiler::last_frame(), "entity_container::update");
+	CHECK(type && type->calls == 200);
+	CHECK(update && update->calls == 2);
+}
+
+// Names of scopes and types end up in JSON strings
+TEST("profiler/capture_escapes_names")
+{
+	const std::string filename = "blib_tests_capture.json";
+	blib::profiler::begin_capture();
+	{
+		blib::profiler::scope scope("quote\" backslash\\ tab\t bell\a");
+	}
+	CHECK(blib::profiler::end_capture(filename));
+
+	const std::string json = blib::io::read_text_file(filename);
+	std::remove(filename.c_str());
+	CHECK(json.find("\"quote\\\" backslash\\\\ tab\\u0009 bell\\u0007\"") != std::string::npos);
+	for (char c : json)
+		CHECK(static_cast<unsigned char>(c) >= 0x20 || c == '\n');
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Allocator
+////////////////////////////////////////////////////////////////////////////////
+
+struct compacted : blib::component
+{
+	float values[10] = {};
+	void update(float dt) override { values[0] += dt; }
+};
+
+// Every compaction moves all components into new memory, the blocks they leave
+// behind must go back instead of piling up
+TEST("allocator/compact_returns_emptied_blocks")
+{
+	blib::entity_container world;
+	for (int i = 0; i < 20000; i++)
+		world.create().create_component<compacted>();
+	world.update(0.0f);
+
+	world.compact();
+	const size_t reserved = blib::component_allocator::reserved_bytes();
+	for (int i = 0; i < 10; i++)
+		world.compact();
+	CHECK(blib::component_allocator::reserved_bytes() <= reserved + 64 * 1024);
+}
+
+// Both in the same size class of the allocator
+struct pooled_value : blib::component
+{
+	float values[4] = {};
+};
+
+struct churned : blib::component
+{
+	float values[4] = {};
+};
+
+}
+
+template<> struct blib::component_storage<pooled_value> { static constexpr blib::storage value = blib::storage::sparse_set; };
+
+namespace
+{
+
+// A prefab of sparse_set components must not reserve allocator memory, nothing would
+// use the reservation up and the size class would skip freed slots until it did
+TEST("allocator/prefab_reserves_only_allocated_types")
+{
+	static_assert(blib::component_allocator::size_class_of(sizeof(pooled_value)) == blib::component_allocator::size_class_of(sizeof(churned)));
+
+	blib::entity_container world;
+	blib::prefab p;
+	p.add<pooled_value>();
+	world.instantiate(p, 50000);
+
+	auto& e = world.create();
+	void* freed = &e.create_component<churned>();
+	e.destroy_component<churned>();
+	CHECK(&e.create_component<churned>() == freed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Memory
+////////////////////////////////////////////////////////////////////////////////
+
+// Counts and names per component type, in both storages, and totals that follow the
+// entities in and out of the world
+TEST("memory/stats_per_type")
+{
+	register_snapshot_types();
+	blib::entity_container world;
+	const size_t empty = world.memory_usage().total();
+	for (int i = 0; i < 300; i++)
+	{
+		auto& e = world.create();
+		e.create_component<snap_value>();
+		if (i % 3 == 0)
+			e.create_component<snap_sparse>();
+		if (i % 10 == 0)
+			e.set_name("entity " + std::to_string(i));
+	}
+	world.update(0.0f);
+
+	const blib::memory_stats stats = world.memory_usage();
+	CHECK(stats.entity_count == 300);
+	CHECK(stats.components.size() == 2);
+	const blib::memory_stats::component_type* values = stats.find(typeid(snap_value));
+	const blib::memory_stats::component_type* sparse = stats.find(typeid(snap_sparse));
+	CHECK(values && values->count == 300 && values->name == "snap_value" && values->bytes >= 300 * sizeof(snap_value));
+	CHECK(sparse && sparse->count == 100 && sparse->name == "snap_sparse" && sparse->bytes >= 100 * sizeof(snap_sparse));
+	CHECK(!stats.find(typeid(replay_a)));
+	CHECK(stats.component_bytes == values->bytes + sparse->bytes);
+	CHECK(stats.name_bytes > 0 && stats.total() > empty);
+
+	for (int i = 0; i < 300; i += 2)
+		world.destroy({ static_cast<uint64_t>(i + 1) });
+	world.update(0.0f);
+	const blib::memory_stats after = world.memory_usage();
+	CHECK(after.entity_count == 150);
+	CHECK(after.find(typeid(snap_value))->count == 150 && after.find(typeid(snap_sparse))->count == 50);
+	CHECK(after.component_bytes < stats.component_bytes);
+}
+
+// A budget calls back once when a sample goes over its limit, and again only after a
+// sample was back under it
+TEST("memory/budgets")
+{
+	blib::entity_container world;
+	blib::memory_budgets budgets;
+	std::vector<std::string> calls;
+	size_t last_used = 0, last_limit = 0;
+	auto on_exceeded = [&](const std::string& name, size_t used, size_t limit) { calls.push_back(name); last_used = used; last_limit = limit; };
+	auto entities = [](const blib::memory_stats& stats) { return stats.entity_count; };
+	budgets.set("entities", 100, entities, on_exceeded);
+	budgets.set("components", 1 << 30, [](const blib::memory_stats& stats) { return stats.component_bytes; }, on_exceeded);
+
+	auto grow = [&](int count)
+	{
+		for (int i = 0; i < count; i++)
+			world.create().create_component<snap_value>();
+		world.update(0.0f);
+	};
+	grow(100);
+	budgets.check(world.memory_usage());
+	CHECK(calls.empty());
+
+	grow(1);
+	budgets.check(world.memory_usage());
+	CHECK(calls.size() == 1 && calls[0] == "entities" && last_used == 101 && last_limit == 100);
+	grow(10);
+	budgets.check(world.memory_usage());
+	CHECK(calls.size() == 1);
+
+	for (uint64_t id = 1; id <= 20; id++)
+		world.destroy({ id });
+	world.update(0.0f);
+	budgets.check(world.memory_usage());
+	grow(20);
+	budgets.check(world.memory_usage());
+	CHECK(calls.size() == 2 && last_used == 111);
+
+	// Setting a budget again replaces it, removing one stops its calls
+	budgets.set("entities", 200, entities, on_exceeded);
+	budgets.check(world.memory_usage());
+	CHECK(calls.size() == 2);
+	budgets.set("entities", 50, entities, on_exceeded);
+	budgets.check(world.memory_usage());
+	CHECK(calls.size() == 3 && last_limit == 50);
+	budgets.remove("entities");
+	grow(100);
+	budgets.check(world.memory_usage());
+	CHECK(calls.size() == 3);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Concurrent Mode
+////////////////////////////////////////////////////////////////////////////////
+
+struct concurrent_value : blib::component
+{
+	float value = 0.0f;
+	void update(float dt) override { value += dt; }
+};
+
+// A merged id that falls into the id block of a thread must be skipped by that thread
+TEST("concurrent/merged_ids_are_not_handed_out")
+{
+	blib::entity_container region;
+	for (int i = 0; i < 3; i++)
+		region.create();
+	region.destroy({ 1 });
+	region.destroy({ 2 });
+	region.update(0.0f);
+
+	blib::entity_container world;
+	world.set_concurrent(true);
+	blib::entity_id first = world.create_concurrent();
+	world.update(0.0f);
+	CHECK(world.merge(region));
+
+	std::vector<blib::entity_id> created;
+	for (int i = 0; i < 4; i++)
+		created.push_back(world.create_concurrent([](blib::entity& e) { e.create_component<concurrent_value>(); }));
+	world.update(0.1f);
+
+	blib::entity* merged = world.try_get({ 3 });
+	CHECK(merged && merged->valid() && !merged->try_get_component<concurrent_value>());
+	for (blib::entity_id id : created)
+	{
+		blib::entity* e = world.try_get(id);
+		CHECK(id.id != 3 && id.id != first.id);
+		CHECK(e && e->valid() && e->try_get_component<concurrent_value>());
+	}
+}
+
+// An id still being set up on another thread can't be merged over
+TEST("concurrent/merge_rejects_staged_ids")
+{
+	blib::entity_container region;
+	region.create();
+
+	blib::entity_container world;
+	world.set_concurrent(true);
+	blib::entity_id staged = world.create_concurrent();
+	CHECK(staged.id == 1);
+	CHECK(!world.merge(region));
+	world.update(0.0f);
+	CHECK(world.try_get(staged) && world.try_get(staged)->valid());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Math
+////////////////////////////////////////////////////////////////////////////////
+
+// Odd count so the scalar tail runs after the SSE2 loop
+std::vector<float> math_inputs(float lo, float hi, size_t count = 4099)
+{
+	std::vector<float> values(count);
+	for (size_t i = 0; i < count; i++)
+		values[i] = lo + (hi - lo) * static_cast<float>(i) / static_cast<float>(count - 1);
+	return values;
+}
+
+// The array kernels give the scalar result for every element, whichever lane it lands in
+TEST("math/fast_kernels_match_scalar")
+{
+	std::vector<float> angles = math_inputs(-8192.0f, 8192.0f);
+	std::vector<float> sines(angles.size()), cosines(angles.size()), s(angles.size()), c(angles.size());
+	blib::fast_sin(angles.data(), sines.data(), angles.size());
+	blib::fast_cos(angles.data(), cosines.data(), angles.size());
+	blib::fast_sincos(angles.data(), s.data(), c.data(), angles.size());
+	bool same = true, accurate = true;
+	for (size_t i = 0; i < angles.size(); i++)
+	{
+		same &= sines[i] == blib::fast_sin(angles[i]) && cosines[i] == blib::fast_cos(angles[i]);
+		same &= s[i] == sines[i] && c[i] == cosines[i];
+		accurate &= std::fabs(sines[i] - std::sin(static_cast<double>(angles[i]))) < 1e-6;
+	}
+	CHECK(same);
+	CHECK(accurate);
+
+	std::vector<float> values = math_inputs(1e-6f, 1e6f);
+	std::vector<float> rsqrt(values.size());
+	blib::fast_rsqrt(values.data(), rsqrt.data(), values.size());
+	same = accurate = true;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		same &= rsqrt[i] == blib::fast_rsqrt(values[i]);
+		double exact = 1.0 / std::sqrt(static_cast<double>(values[i]));
+		accurate &= std::fabs(rsqrt[i] - exact) <= 5e-6 * exact;
+	}
+	CHECK(same);
+	CHECK(accurate);
+}
+
+// Fills of any length, started at any point in the four lane buffer, continue the
+// sequence next gives
+TEST("math/rng_fill_matches_next")
+{
+	blib::rng reference(42, 7);
+	std::vector<uint32_t> expected(5000);
+	for (uint32_t& value : expected)
+		value = reference.next();
+
+	blib::rng mixed(42, 7);
+	std::vector<uint32_t> values;
+	const size_t lengths[] = { 1, 0, 3, 4, 5, 2, 17, 1000, 7, 64 };
+	for (size_t i = 0; values.size() < expected.size(); i++)
+	{
+		if (i % 3 == 1)
+		{
+			values.push_back(mixed.next());
+			continue;
+		}
+		size_t n = std::min(lengths[i % 10], expected.size() - values.size());
+		values.resize(values.size() + n);
+		mixed.fill(values.data() + values.size() - n, n);
+	}
+	CHECK(values == expected);
+
+	blib::rng floats(42, 7), single(42, 7);
+	std::vector<float> uniform(1001);
+	floats.next();
+	single.next();
+	floats.fill(uniform.data(), uniform.size());
+	bool same = true;
+	for (float value : uniform)
+		same &= value == single.next_float() && value >= 0.0f && value < 1.0f;
+	CHECK(same);
+
+	// Streams of one seed are different sequences
+	blib::rng other(42, 8);
+	CHECK(other.next() != expected[0] || other.next() != expected[1]);
+}
+
+TEST("math/noise_arrays_match_scalar")
+{
+	std::vector<blib::vec2> points2(1003);
+	std::vector<blib::vec3> points3(1003);
+	blib::rng random(3);
+	for (size_t i = 0; i < points2.size(); i++)
+	{
+		points2[i] = { random.range(-100.0f, 100.0f), random.range(-100.0f, 100.0f) };
+		points3[i] = { random.range(-100.0f, 100.0f), random.range(-100.0f, 100.0f), random.range(-100.0f, 100.0f) };
+	}
+
+	std::vector<float> value2(points2.size()), gradient2(points2.size()), value3(points3.size()), gradient3(points3.size());
+	blib::value_noise(points2.data(), value2.data(), points2.size(), 5);
+	blib::gradient_noise(points2.data(), gradient2.data(), points2.size(), 5);
+	blib::value_noise(points3.data(), value3.data(), points3.size(), 5);
+	blib::gradient_noise(points3.data(), gradient3.data(), points3.size(), 5);
+	bool same = true;
+	for (size_t i = 0; i < points2.size(); i++)
+	{
+		same &= value2[i] == blib::value_noise(points2[i], 5) && gradient2[i] == blib::gradient_noise(points2[i], 5);
+		same &= value3[i] == blib::value_noise(points3[i], 5) && gradient3[i] == blib::gradient_noise(points3[i], 5);
+	}
+	CHECK(same);
+}
+
+bool half_is_nan(uint16_t h)
+{
+	return (h & 0x7c00) == 0x7c00 && (h & 0x3ff);
+}
+
+// Every half survives the trip to float and back, through both the scalar and the array
+// conversions. NaNs only have to stay NaNs.
+TEST("math/half_round_trip")
+{
+	std::vector<uint16_t> halves(65536), back(65536);
+	std::vector<float> floats(65536);
+	for (uint32_t i = 0; i < 65536; i++)
+		halves[i] = static_cast<uint16_t>(i);
+	blib::half_to_float(halves.data(), floats.data(), halves.size());
+	blib::float_to_half(floats.data(), back.data(), floats.size());
+
+	bool scalar = true, array = true;
+	for (uint32_t i = 0; i < 65536; i++)
+	{
+		uint16_t h = halves[i];
+		float f = blib::half_to_float(h);
+		uint16_t r = blib::float_to_half(f);
+		scalar &= half_is_nan(h) ? half_is_nan(r) && std::isnan(f) : r == h;
+		array &= half_is_nan(h) ? half_is_nan(back[i]) && std::isnan(floats[i]) : back[i] == h && floats[i] == f;
+	}
+	CHECK(scalar);
+	CHECK(array);
+
+	// Halfway between two halves rounds to the even one, past the largest half is infinity
+	CHECK(blib::float_to_half(1.0f + 1.0f / 2048.0f) == 0x3c00);
+	CHECK(blib::float_to_half(1.0f + 3.0f / 2048.0f) == 0x3c02);
+	CHECK(blib::float_to_half(65520.0f) == 0x7c00 && blib::float_to_half(-1e10f) == 0xfc00);
+	CHECK(blib::float_to_half(65519.0f) == 0x7bff);
+
+	// Floats between the halves go the same way in both conversions
+	blib::rng random(11);
+	std::vector<float> values(4099);
+	for (float& value : values)
+	{
+		uint32_t bits = random.next();
+		std::memcpy(&value, &bits, sizeof(value));
+	}
+	std::vector<uint16_t> packed(values.size());
+	blib::float_to_half(values.data(), packed.data(), values.size());
+	bool same = true;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		uint16_t expected = blib::float_to_half(values[i]);
+		same &= half_is_nan(expected) ? half_is_nan(packed[i]) : packed[i] == expected;
+	}
+	CHECK(same);
+}
+
+// Points ten thousand kilometers out keep sub millimeter precision next to the origin,
+// where converting them to float first would round them to a meter
+TEST("math/to_relative_precision")
+{
+	const blib::vec3_t<double> origin(1.0e7 + 0.123456, -2.5e7 + 0.654321, 4.0e6 + 0.5);
+	blib::rng random(17);
+	std::vector<blib::vec3_t<double>> points(1003);
+	for (auto& p : points)
+		p = { origin.x + random.range(-10.0f, 10.0f) + 0.0001 * random.below(1000), origin.y + random.range(-10.0f, 10.0f), origin.z + random.range(-10.0f, 10.0f) };
+
+	std::vector<blib::vec3_t<float>> relative(points.size());
+	blib::to_relative(points.data(), origin, relative.data(), points.size());
+	bool same = true, precise = true, lossy = false;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		const blib::vec3_t<float> scalar = blib::to_relative(points[i], origin);
+		same &= relative[i].x == scalar.x && relative[i].y == scalar.y && relative[i].z == scalar.z;
+		precise &= std::fabs(relative[i].x - (points[i].x - origin.x)) < 1e-6;
+		precise &= std::fabs(relative[i].y - (points[i].y - origin.y)) < 1e-6;
+		precise &= std::fabs(relative[i].z - (points[i].z - origin.z)) < 1e-6;
+
+		const blib::vec3_t<double> back = blib::from_relative(relative[i], origin);
+		precise &= std::fabs(back.x - points[i].x) < 1e-6 && std::fabs(back.y - points[i].y) < 1e-6;
+		lossy |= std::fabs((static_cast<float>(points[i].x) - static_cast<float>(origin.x)) - (points[i].x - origin.x)) > 0.1;
+	}
+	CHECK(same);
+	CHECK(precise);
+	CHECK(lossy);
+
+	// Only the translation of a transform moves, in both the scalar and the array version
+	std::vector<blib::mat4_t<double>> transforms(5);
+	for (size_t i = 0; i < transforms.size(); i++)
+		for (uint32_t row = 0; row < 3; row++)
+			transforms[i].value[row] = { 0.5 * row, 0.25 * i, 1.0, points[i][row] };
+	std::vector<blib::mat4_t<float>> relative_transforms(transforms.size());
+	blib::to_relative(transforms.data(), origin, relative_transforms.data(), transforms.size());
+	same = precise = true;
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		const blib::mat4_t<float> scalar = blib::to_relative(transforms[i], origin);
+		for (uint32_t row = 0; row < 4; row++)
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				const float value = relative_transforms[i].value[row][column];
+				const double expected = transforms[i].value[row][column] - (row < 3 && column == 3 ? origin[row] : 0.0);
+				same &= value == scalar.value[row][column];
+				precise &= std::fabs(value - expected) < 1e-6;
+			}
+	}
+	CHECK(same);
+	CHECK(precise);
+}
+
+// Cells round toward negative infinity for negative coordinates, with power of two and odd
+// divisors, in the scalar and the array versions
+TEST("math/floor_divmod")
+{
+	CHECK(blib::floor_div(-1, 16) == -1 && blib::floor_mod(-1, 16) == 15);
+	CHECK(blib::floor_div(-16, 16) == -1 && blib::floor_mod(-16, 16) == 0);
+	CHECK(blib::floor_div(-17, 16) == -2 && blib::floor_mod(-17, 16) == 15);
+	CHECK(blib::floor_div(-7, 3) == -3 && blib::floor_mod(-7, 3) == 2);
+	CHECK(blib::floor_div(7, 3) == 2 && blib::floor_mod(7, 3) == 1);
+	CHECK(blib::floor_div(INT32_MIN, 7) == -306783379 && blib::floor_mod(INT32_MIN, 7) == 5);
+	CHECK(blib::floor_div(INT32_MAX, 1) == INT32_MAX && blib::floor_mod(INT32_MIN, 1) == 0);
+
+	std::vector<blib::vec3_t<int32_t>> points;
+	for (int32_t x = -50; x <= 50; x++)
+		points.push_back({ x, -x * 997, x * 65537 });
+	points.push_back({ INT32_MIN, INT32_MAX, INT32_MIN + 1 });
+	points.push_back({ INT32_MAX - 1, 0, -1 });
+
+	for (int32_t divisor : { 1, 2, 3, 7, 16, 33, 1000, 1 << 20, 999999937 })
+	{
+		std::vector<blib::vec3_t<int32_t>> cells(points.size()), locals(points.size()), only_cells(points.size());
+		blib::floor_divmod(points.data(), divisor, cells.data(), locals.data(), points.size());
+		blib::floor_divmod(points.data(), divisor, only_cells.data(), nullptr, points.size());
+		bool correct = true;
+		for (size_t i = 0; i < points.size(); i++)
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const int64_t p = points[i][axis], cell = cells[i][axis], local = locals[i][axis];
+				correct &= cell == blib::floor_div(points[i][axis], divisor) && local == blib::floor_mod(points[i][axis], divisor);
+				correct &= cell * divisor + local == p && local >= 0 && local < divisor;
+				correct &= only_cells[i][axis] == cell;
+			}
+		CHECK(correct);
+	}
+
+	std::vector<blib::vec2_t<int32_t>> points2 = { { -1, -3 }, { -7, 8 }, { 100, -101 }, { INT32_MIN, INT32_MAX }, { 0, 5 } };
+	std::vector<blib::vec2_t<int32_t>> cells2(points2.size()), locals2(points2.size());
+	blib::floor_divmod(points2.data(), 3, cells2.data(), locals2.data(), points2.size());
+	bool correct = true;
+	for (size_t i = 0; i < points2.size(); i++)
+	{
+		correct &= cells2[i].x == blib::floor_div(points2[i].x, 3) && cells2[i].y == blib::floor_div(points2[i].y, 3);
+		correct &= locals2[i].x == blib::floor_mod(points2[i].x, 3) && locals2[i].y == blib::floor_mod(points2[i].y, 3);
+	}
+	CHECK(correct);
+}
+
+// Codes decode to the points they came from, and the array versions agree with the scalar ones
+TEST("math/morton_round_trip")
+{
+	blib::rng random(23);
+	std::vector<blib::vec2_t<int32_t>> signed2(1003);
+	std::vector<blib::vec2_t<uint32_t>> unsigned2(signed2.size());
+	std::vector<blib::vec3_t<int32_t>> signed3(signed2.size());
+	std::vector<blib::vec3_t<uint32_t>> unsigned3(signed2.size());
+	for (size_t i = 0; i < signed2.size(); i++)
+	{
+		signed2[i] = { static_cast<int32_t>(random.next()), static_cast<int32_t>(random.next()) };
+		unsigned2[i] = { random.next(), random.next() };
+		signed3[i] = { static_cast<int32_t>(random.below(1u << 21)) - (1 << 20), static_cast<int32_t>(random.below(1u << 21)) - (1 << 20), static_cast<int32_t>(random.below(1u << 21)) - (1 << 20) };
+		unsigned3[i] = { random.below(1u << 21), random.below(1u << 21), random.below(1u << 21) };
+	}
+	signed2[0] = { INT32_MIN, INT32_MAX };
+	signed3[0] = { -(1 << 20), (1 << 20) - 1, 0 };
+	unsigned3[0] = { (1u << 21) - 1, 0, (1u << 21) - 1 };
+
+	const size_t n = signed2.size();
+	std::vector<uint64_t> codes_s2(n), codes_u2(n), codes_s3(n), codes_u3(n);
+	blib::morton_encode(signed2.data(), codes_s2.data(), n);
+	blib::morton_encode(unsigned2.data(), codes_u2.data(), n);
+	blib::morton_encode(signed3.data(), codes_s3.data(), n);
+	blib::morton_encode(unsigned3.data(), codes_u3.data(), n);
+
+	std::vector<blib::vec2_t<int32_t>> back_s2(n);
+	std::vector<blib::vec2_t<uint32_t>> back_u2(n);
+	std::vector<blib::vec3_t<int32_t>> back_s3(n);
+	std::vector<blib::vec3_t<uint32_t>> back_u3(n);
+	blib::morton_decode(codes_s2.data(), back_s2.data(), n);
+	blib::morton_decode(codes_u2.data(), back_u2.data(), n);
+	blib::morton_decode(codes_s3.data(), back_s3.data(), n);
+	blib::morton_decode(codes_u3.data(), back_u3.data(), n);
+
+	bool same = true, round_trip = true;
+	for (size_t i = 0; i < n; i++)
+	{
+		same &= codes_s2[i] == blib::morton_encode(signed2[i]) && codes_u2[i] == blib::morton_encode(unsigned2[i]);
+		same &= codes_s3[i] == blib::morton_encode(signed3[i]) && codes_u3[i] == blib::morton_encode(unsigned3[i]);
+
+		blib::vec2_t<int32_t> s2;
+		blib::vec3_t<int32_t> s3;
+		blib::morton_decode(codes_s2[i], s2);
+		blib::morton_decode(codes_s3[i], s3);
+		round_trip &= s2.x == signed2[i].x && s2.y == signed2[i].y;
+		round_trip &= s3.x == signed3[i].x && s3.y == signed3[i].y && s3.z == signed3[i].z;
+		round_trip &= back_s2[i].x == signed2[i].x && back_s2[i].y == signed2[i].y;
+		round_trip &= back_u2[i].x == unsigned2[i].x && back_u2[i].y == unsigned2[i].y;
+		round_trip &= back_s3[i].x == signed3[i].x && back_s3[i].y == signed3[i].y && back_s3[i].z == signed3[i].z;
+		round_trip &= back_u3[i].x == unsigned3[i].x && back_u3[i].y == unsigned3[i].y && back_u3[i].z == unsigned3[i].z;
+	}
+	CHECK(same);
+	CHECK(round_trip);
+
+	// Bits interleave x first, and signed codes keep the order of each axis across zero
+	CHECK(blib::morton_encode(blib::vec2_t<uint32_t>(1, 0)) == 1 && blib::morton_encode(blib::vec2_t<uint32_t>(0, 1)) == 2);
+	CHECK(blib::morton_encode(blib::vec3_t<uint32_t>(0, 0, 1)) == 4 && blib::morton_encode(blib::vec3_t<uint32_t>(3, 3, 3)) == 63);
+	CHECK(blib::morton_encode(blib::vec2_t<int32_t>(-1, 5)) < blib::morton_encode(blib::vec2_t<int32_t>(0, 5)));
+	CHECK(blib::morton_encode(blib::vec3_t<int32_t>(2, -1, 2)) < blib::morton_encode(blib::vec3_t<int32_t>(2, 0, 2)));
+}
+
+blib::vec3 project(const blib::mat4& m, const blib::vec3& p)
+{
+	blib::vec4 clip = blib::mul(m, blib::vec4(p.x, p.y, p.z, 1.0f));
+	return { clip.x / clip.w, clip.y / clip.w, clip.z / clip.w };
+}
+
+bool near_ndc(const blib::vec3& ndc, float x, float y, float z)
+{
+	return std::fabs(ndc.x - x) < 1e-4f && std::fabs(ndc.y - y) < 1e-4f && std::fabs(ndc.z - z) < 1e-4f;
+}
+
+// Points on the near and far planes in front of a camera land on the near and far depth of
+// every clip space. Screen right is forward x up in right-handed spaces, up x forward in
+// left-handed ones.
+TEST("math/projection_depth_ranges")
+{
+	using blib::clip_space;
+	const blib::vec3 eye(3.0f, 2.0f, -5.0f), forward(0.6f, 0.0f, 0.8f), up(0.0f, 1.0f, 0.0f);
+	const float near = 0.5f, far = 200.0f, fov = 1.2f, aspect = 1.5f;
+	const float tan_y = std::tan(fov * 0.5f);
+
+	for (clip_space space : { clip_space::rh_zo, clip_space::rh_no, clip_space::lh_zo, clip_space::lh_no })
+	{
+		const bool rh = space == clip_space::rh_zo || space == clip_space::rh_no;
+		const float near_z = space == clip_space::rh_zo || space == clip_space::lh_zo ? 0.0f : -1.0f;
+		const blib::vec3 right = rh ? blib::cross(forward, up) : blib::cross(up, forward);
+		const blib::mat4 view = blib::lookAt(space, eye, eye + forward, up);
+
+		// Right-handed views look down -z, left-handed ones down +z
+		blib::vec4 ahead = blib::mul(view, blib::vec4(eye.x + forward.x, eye.y + forward.y, eye.z + forward.z, 1.0f));
+		CHECK(std::fabs(ahead.x) < 1e-5f && std::fabs(ahead.y) < 1e-5f && std::fabs(ahead.z - (rh ? -1.0f : 1.0f)) < 1e-5f);
+		blib::vec4 side = blib::mul(view, blib::vec4(eye.x + right.x, eye.y + right.y, eye.z + right.z, 1.0f));
+		CHECK(std::fabs(side.x - 1.0f) < 1e-5f);
+
+		const blib::mat4 perspective = blib::mul(blib::perspective(space, fov, aspect, near, far), view);
+		CHECK(near_ndc(project(perspective, eye + forward * near), 0.0f, 0.0f, near_z));
+		CHECK(near_ndc(project(perspective, eye + forward * far), 0.0f, 0.0f, 1.0f));
+		// The top right corner of the far plane
+		const blib::vec3 corner = eye + forward * far + right * (far * tan_y * aspect) + up * (far * tan_y);
+		CHECK(near_ndc(project(perspective, corner), 1.0f, 1.0f, 1.0f));
+
+		const blib::mat4 ortho = blib::mul(blib::ortho(space, -4.0f, 4.0f, -2.0f, 2.0f, near, far), view);
+		CHECK(near_ndc(project(ortho, eye + forward * near + right * 4.0f), 1.0f, 0.0f, near_z));
+		CHECK(near_ndc(project(ortho, eye + forward * far - up * 2.0f), 0.0f, -1.0f, 1.0f));
+
+		// The batched builder gives the same matrices as multiplying them out
+		blib::camera_desc camera;
+		camera.position = eye;
+		camera.forward = forward;
+		camera.up = up;
+		camera.fov = fov;
+		camera.aspectRatio = aspect;
+		camera.near = near;
+		camera.far = far;
+		blib::mat4 batched;
+		blib::view_projections(&camera, &batched, 1, space);
+		bool same = true;
+		for (uint32_t row = 0; row < 4; row++)
+			for (uint32_t column = 0; column < 4; column++)
+				same &= std::fabs(batched[row][column] - perspective[row][column]) < 1e-5f;
+		CHECK(same);
+	}
+
+	// The defaults are right-handed with OpenGL depth
+	const blib::mat4 view = blib::lookAt(eye, eye + forward, up);
+	CHECK(near_ndc(project(blib::mul(blib::perspective(fov, aspect, near, far), view), eye + forward * near), 0.0f, 0.0f, -1.0f));
+	CHECK(near_ndc(project(blib::mul(blib::ortho(-1.0f, 1.0f, -1.0f, 1.0f, near, far), view), eye + forward * far), 0.0f, 0.0f, 1.0f));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////							Broadphase
+////////////////////////////////////////////////////////////////////////////////
+
+struct broadphase_body
+{
+	blib::vec3 min, max;
+	blib::sweep_and_prune::proxy proxy = blib::sweep_and_prune::invalid;
+};
+
+using id_pair = std::pair<uint64_t, uint64_t>;
+
+// Bodies are keyed by entity id, removed ones have an invalid proxy
+std::vector<id_pair> brute_force_pairs(const std::vector<broadphase_body>& bodies)
+{
+	std::vector<id_pair> pairs;
+	for (size_t i = 0; i < bodies.size(); i++)
+		for (size_t j = i + 1; j < bodies.size(); j++)
+		{
+			const broadphase_body& a = bodies[i];
+			const broadphase_body& b = bodies[j];
+			if (a.proxy == blib::sweep_and_prune::invalid || b.proxy == blib::sweep_and_prune::invalid)
+				continue;
+			bool overlap = true;
+			for (uint32_t axis = 0; axis < 3; axis++)
+				overlap &= a.min[axis] <= b.max[axis] && b.min[axis] <= a.max[axis];
+			if (overlap)
+				pairs.push_back({ i + 1, j + 1 });
+		}
+	return pairs;
+}
+
+// Runs an update and compares its pairs with the brute force ones. Also checks that
+// the first body of a pair comes first along the sweep axis.
+bool broadphase_matches(blib::sweep_and_prune& sap, const std::vector<broadphase_body>& bodies)
+{
+	const std::vector<blib::broadphase_pair>& found = sap.update();
+	std::vector<id_pair> pairs;
+	bool ordered = true;
+	for (const blib::broadphase_pair& pair : found)
+	{
+		const uint64_t a = pair.a.id, b = pair.b.id;
+		ordered &= bodies[a - 1].min[sap.axis()] <= bodies[b - 1].min[sap.axis()];
+		pairs.push_back({ std::min(a, b), std::max(a, b) });
+	}
+	std::sort(pairs.begin(), pairs.end());
+	return ordered && pairs == brute_force_pairs(bodies);
+}
+
+void random_bounds(blib::rng& random, broadphase_body& body, const blib::vec3& extent, float size)
+{
+	blib::vec3 center(random.range(-extent.x, extent.x), random.range(-extent.y, extent.y), random.range(-extent.z, extent.z));
+	blib::vec3 half(random.range(0.0f, size), random.range(0.0f, size), random.range(0.0f, size));
+	body.min = center - half;
+	body.max = center + half;
+}
+
+std::vector<broadphase_body> add_bodies(blib::sweep_and_prune& sap, blib::rng& random, size_t count, const blib::vec3& extent, float size)
+{
+	std::vector<broadphase_body> bodies(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		random_bounds(random, bodies[i], extent, size);
+		bodies[i].proxy = sap.add({ i + 1 }, bodies[i].min, bodies[i].max);
+	}
+	return bodies;
+}
+
+// Small sets take the four wide SSE2 sweep, also with counts that leave a scalar tail,
+// touching bounds, and bodies that move between updates
+TEST("broadphase/matches_brute_force")
+{
+	for (size_t count : { 2, 5, 37, 203 })
+	{
+		blib::rng random(count);
+		blib::sweep_and_prune sap;
+		std::vector<broadphase_body> bodies = add_bodies(sap, random, count, blib::vec3(10.0f, 10.0f, 10.0f), 2.0f);
+		CHECK(broadphase_matches(sap, bodies));
+
+		for (int step = 0; step < 5; step++)
+		{
+			for (broadphase_body& body : bodies)
+			{
+				blib::vec3 move(random.range(-0.5f, 0.5f), random.range(-0.5f, 0.5f), random.range(-0.5f, 0.5f));
+				body.min = body.min + move;
+				body.max = body.max + move;
+				sap.set_bounds(body.proxy, body.min, body.max);
+			}
+			CHECK(broadphase_matches(sap, bodies));
+		}
+	}
+
+	// Boxes that share a face touch
+	blib::sweep_and_prune sap;
+	std::vector<broadphase_body> bodies(3);
+	bodies[0].min = { 0.0f, 0.0f, 0.0f };
+	bodies[0].max = { 1.0f, 1.0f, 1.0f };
+	bodies[1].min = { 1.0f, 0.0f, 0.0f };
+	bodies[1].max = { 2.0f, 1.0f, 1.0f };
+	bodies[2].min = { 2.5f, 0.0f, 0.0f };
+	bodies[2].max = { 3.0f, 1.0f, 1.0f };
+	for (size_t i = 0; i < bodies.size(); i++)
+		bodies[i].proxy = sap.add({ i + 1 }, bodies[i].min, bodies[i].max);
+	CHECK(sap.update().size() == 1);
+	CHECK(broadphase_matches(sap, bodies));
+}
+
+// More than one batch of bodies is swept in parallel, with the pairs in the same order as
+// a single threaded sweep
+TEST("broadphase/parallel_batches")
+{
+	blib::rng random(5);
+	blib::sweep_and_prune sap;
+	std::vector<broadphase_body> bodies = add_bodies(sap, random, 5000, blib::vec3(100.0f, 20.0f, 20.0f), 1.5f);
+	CHECK(broadphase_matches(sap, bodies));
+	CHECK(!sap.pairs().empty());
+
+	for (int step = 0; step < 3; step++)
+	{
+		for (broadphase_body& body : bodies)
+		{
+			blib::vec3 move(random.range(-0.3f, 0.3f), random.range(-0.3f, 0.3f), random.range(-0.3f, 0.3f));
+			body.min = body.min + move;
+			body.max = body.max + move;
+			sap.set_bounds(body.proxy, body.min, body.max);
+		}
+		CHECK(broadphase_matches(sap, bodies));
+	}
+
+	// A single threaded sweep lists the pairs by their first body along the axis
+	bool in_order = true;
+	const uint32_t axis = sap.axis();
+	for (size_t i = 1; i < sap.pairs().size(); i++)
+		in_order &= bodies[sap.pairs()[i - 1].a.id - 1].min[axis] <= bodies[sap.pairs()[i].a.id - 1].min[axis];
+	CHECK(in_order);
+}
+
+// Removed bodies leave the pairs right away, their handles come back after the next update
+TEST("broadphase/remove_and_reuse")
+{
+	blib::rng random(9);
+	blib::sweep_and_prune sap;
+	std::vector<broadphase_body> bodies = add_bodies(sap, random, 300, blib::vec3(10.0f, 10.0f, 10.0f), 1.5f);
+	CHECK(broadphase_matches(sap, bodies));
+
+	std::vector<blib::sweep_and_prune::proxy> removed;
+	for (size_t i = 0; i < bodies.size(); i += 3)
+	{
+		removed.push_back(bodies[i].proxy);
+		sap.remove(bodies[i].proxy);
+		bodies[i].proxy = blib::sweep_and_prune::invalid;
+	}
+	CHECK(sap.size() == 200);
+
+	// Not recycled before an update
+	broadphase_body extra;
+	random_bounds(random, extra, blib::vec3(10.0f, 10.0f, 10.0f), 1.5f);
+	extra.proxy = sap.add({ bodies.size() + 1 }, extra.min, extra.max);
+	CHECK(std::find(removed.begin(), removed.end(), extra.proxy) == removed.end());
+	bodies.push_back(extra);
+	CHECK(broadphase_matches(sap, bodies));
+
+	// Afterwards new bodies take the old handles, which point at the new entities
+	bool reused = true;
+	for (size_t i = 0; i < removed.size(); i++)
+	{
+		broadphase_body body;
+		random_bounds(random, body, blib::vec3(10.0f, 10.0f, 10.0f), 1.5f);
+		body.proxy = sap.add({ bodies.size() + 1 }, body.min, body.max);
+		reused &= std::find(removed.begin(), removed.end(), body.proxy) != removed.end();
+		bodies.push_back(body);
+	}
+	CHECK(reused);
+	CHECK(sap.size() == 201 + removed.size());
+	CHECK(broadphase_matches(sap, bodies));
+	bool entities = true;
+	for (size_t i = 0; i < bodies.size(); i++)
+		if (bodies[i].proxy != blib::sweep_and_prune::invalid)
+			entities &= sap.entity(bodies[i].proxy).id == i + 1;
+	CHECK(entities);
+}
+
+// When the bodies spread out along another axis the sweep moves to it
+TEST("broadphase/axis_change")
+{
+	blib::rng random(13);
+	blib::sweep_and_prune sap;
+	std::vector<broadphase_body> bodies = add_bodies(sap, random, 500, blib::vec3(100.0f, 5.0f, 5.0f), 1.0f);
+	CHECK(broadphase_matches(sap, bodies));
+	CHECK(sap.axis() == 0);
+
+	for (broadphase_body& body : bodies)
+	{
+		random_bounds(random, body, blib::vec3(5.0f, 5.0f, 100.0f), 1.0f);
+		sap.set_bounds(body.proxy, body.min, body.max);
+	}
+	CHECK(broadphase_matches(sap, bodies));
+	CHECK(sap.axis() == 2);
+	CHECK(broadphase_matches(sap, bodies));
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	for (int i = 1; i < argc; i++)
+		if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+			filter = argv[++i];
+
+	int failed = 0;
+	for (auto& t : tests())
+	{
+		if (!filter.empty() && std::string(t.name).find(filter) == std::string::npos)
+			continue;
+
+		int before = g_failures;
+		t.fn();
+		bool ok = g_failures == before;
+		failed += ok ? 0 : 1;
+		std::fprintf(stderr, "%s %s\n", ok ? "ok  " : "FAIL", t.name);
+	}
+	return failed ? 1 : 0;
+}